@@ -0,0 +1,158 @@
+#include "alloc_stats.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+
+namespace {
+
+const char * const subsystem_names[AllocSubsystemCount] = {
+  "other", "parse", "eval", "environment", "procedures", "plotting"
+};
+
+#ifdef PLOTSCRIPT_ALLOC_STATS
+
+// relaxed counters, a snapshot need not be consistent across subsystems
+struct Counter {
+  std::atomic<std::size_t> allocations;
+  std::atomic<std::size_t> bytes;
+};
+
+Counter counters[AllocSubsystemCount];
+
+thread_local AllocSubsystem current_subsystem = OtherAllocs;
+
+inline void count(std::size_t size) noexcept {
+  Counter & c = counters[current_subsystem];
+  c.allocations.fetch_add(1, std::memory_order_relaxed);
+  c.bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+#endif
+
+}
+
+const char * alloc_subsystem_name(AllocSubsystem subsystem) noexcept{
+  return (subsystem < AllocSubsystemCount) ? subsystem_names[subsystem] : "unknown";
+}
+
+AllocCount AllocStats::total() const noexcept{
+
+  AllocCount sum = {0, 0};
+  for(const AllocCount & c : counts){
+    sum.allocations += c.allocations;
+    sum.bytes += c.bytes;
+  }
+  return sum;
+}
+
+bool alloc_stats_enabled() noexcept{
+#ifdef PLOTSCRIPT_ALLOC_STATS
+  return true;
+#else
+  return false;
+#endif
+}
+
+AllocStats alloc_stats() noexcept{
+
+  AllocStats stats;
+  for(std::size_t i = 0; i < AllocSubsystemCount; ++i){
+#ifdef PLOTSCRIPT_ALLOC_STATS
+    stats.counts[i].allocations = counters[i].allocations.load(std::memory_order_relaxed);
+    stats.counts[i].bytes = counters[i].bytes.load(std::memory_order_relaxed);
+#else
+    stats.counts[i] = AllocCount{0, 0};
+#endif
+  }
+  return stats;
+}
+
+void reset_alloc_stats() noexcept{
+#ifdef PLOTSCRIPT_ALLOC_STATS
+  for(Counter & c : counters){
+    c.allocations.store(0, std::memory_order_relaxed);
+    c.bytes.store(0, std::memory_order_relaxed);
+  }
+#endif
+}
+
+AllocStats operator-(const AllocStats & later, const AllocStats & earlier) noexcept{
+
+  AllocStats diff;
+  for(std::size_t i = 0; i < AllocSubsystemCount; ++i){
+    diff.counts[i].allocations = later.counts[i].allocations - earlier.counts[i].allocations;
+    diff.counts[i].bytes = later.counts[i].bytes - earlier.counts[i].bytes;
+  }
+  return diff;
+}
+
+std::ostream & operator<<(std::ostream & out, const AllocStats & stats){
+
+  auto line = [&out](const char * name, const AllocCount & c){
+    out << std::left << std::setw(12) << name << std::right
+        << std::setw(12) << c.allocations << " allocations "
+        << std::setw(14) << c.bytes << " bytes\n";
+  };
+
+  for(std::size_t i = 0; i < AllocSubsystemCount; ++i){
+    if(stats.counts[i].allocations != 0)
+      line(subsystem_names[i], stats.counts[i]);
+  }
+  line("total", stats.total());
+
+  return out;
+}
+
+#ifdef PLOTSCRIPT_ALLOC_STATS
+
+AllocScope::AllocScope(AllocSubsystem subsystem) noexcept
+  : saved(current_subsystem) {
+  current_subsystem = subsystem;
+}
+
+AllocScope::~AllocScope(){
+  current_subsystem = saved;
+}
+
+/***********************************************************************
+The replaced allocation functions. The array, nothrow and sized forms
+forward to these, as the standard library's defaults do.
+**********************************************************************/
+
+void * operator new(std::size_t size){
+
+  count(size);
+  while(true){
+    if(void * p = std::malloc(size ? size : 1))
+      return p;
+
+    std::new_handler handler = std::get_new_handler();
+    if(handler == nullptr)
+      throw std::bad_alloc();
+    handler();
+  }
+}
+
+void * operator new[](std::size_t size){
+  return operator new(size);
+}
+
+void operator delete(void * p) noexcept{
+  std::free(p);
+}
+
+void operator delete[](void * p) noexcept{
+  std::free(p);
+}
+
+void operator delete(void * p, std::size_t) noexcept{
+  std::free(p);
+}
+
+void operator delete[](void * p, std::size_t) noexcept{
+  std::free(p);
+}
+
+#endif
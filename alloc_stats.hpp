@@ -0,0 +1,85 @@
+/*! \file alloc_stats.hpp
+Defines the allocation statistics, heap allocations counted by the
+interpreter subsystem that made them.
+
+Counting is compiled in only when the interpreter library is configured
+with ALLOC_STATS (cmake -DALLOC_STATS=ON), which defines
+PLOTSCRIPT_ALLOC_STATS and replaces the global allocation functions.
+Otherwise an AllocScope compiles to nothing and the statistics stay zero.
+ */
+#ifndef ALLOC_STATS_HPP
+#define ALLOC_STATS_HPP
+
+// system includes
+#include <cstddef>
+#include <ostream>
+
+/*! \enum AllocSubsystem
+\brief The subsystem an allocation is counted against.
+ */
+enum AllocSubsystem {
+  OtherAllocs,       //< outside any of the subsystems below
+  ParseAllocs,       //< lexing and building the AST
+  EvalAllocs,        //< evaluation, in either mode, and folding
+  EnvironmentAllocs, //< binding, looking up and remembering symbols
+  ProcedureAllocs,   //< the built-in procedures
+  PlotAllocs,        //< properties and the plot forms
+  AllocSubsystemCount
+};
+
+/// Name of a subsystem, as printed
+const char * alloc_subsystem_name(AllocSubsystem subsystem) noexcept;
+
+/// Allocations made and bytes requested
+struct AllocCount {
+  std::size_t allocations;
+  std::size_t bytes;
+};
+
+/// Allocation counts of every subsystem
+struct AllocStats {
+  AllocCount counts[AllocSubsystemCount];
+
+  /// the sum over the subsystems
+  AllocCount total() const noexcept;
+};
+
+/// true if this build counts allocations
+bool alloc_stats_enabled() noexcept;
+
+/// The counts since the start of the process or the last reset, over all threads
+AllocStats alloc_stats() noexcept;
+
+/// Start the counts again from zero
+void reset_alloc_stats() noexcept;
+
+/// The difference of two snapshots, what happened between them
+AllocStats operator-(const AllocStats & later, const AllocStats & earlier) noexcept;
+
+/// Print one line per subsystem with allocations, and the total
+std::ostream & operator<<(std::ostream & out, const AllocStats & stats);
+
+/*! \class AllocScope
+\brief Counts the calling thread's allocations against a subsystem while
+in scope, restoring the previous subsystem after.
+ */
+class AllocScope {
+public:
+
+#ifdef PLOTSCRIPT_ALLOC_STATS
+  explicit AllocScope(AllocSubsystem subsystem) noexcept;
+  ~AllocScope();
+#else
+  explicit AllocScope(AllocSubsystem) noexcept {}
+#endif
+
+  AllocScope(const AllocScope &) = delete;
+  AllocScope & operator=(const AllocScope &) = delete;
+
+#ifdef PLOTSCRIPT_ALLOC_STATS
+private:
+  AllocSubsystem saved;
+#endif
+};
+
+#endif
@@ -0,0 +1,73 @@
+#include "catch.hpp"
+
+#include <sstream>
+#include <string>
+
+#include "alloc_stats.hpp"
+#include "interpreter.hpp"
+
+TEST_CASE( "Test allocation statistics arithmetic and printing", "[alloc_stats]" ) {
+
+  AllocStats earlier = AllocStats(), later = AllocStats();
+  later.counts[ParseAllocs] = AllocCount{5, 100};
+  later.counts[EvalAllocs] = AllocCount{2, 30};
+  earlier.counts[ParseAllocs] = AllocCount{1, 10};
+
+  AllocStats diff = later - earlier;
+  REQUIRE(diff.counts[ParseAllocs].allocations == 4);
+  REQUIRE(diff.counts[ParseAllocs].bytes == 90);
+  REQUIRE(diff.total().allocations == 6);
+  REQUIRE(diff.total().bytes == 120);
+
+  std::ostringstream out;
+  out << diff;
+  REQUIRE(out.str().find("parse") != std::string::npos);
+  REQUIRE(out.str().find("eval") != std::string::npos);
+  REQUIRE(out.str().find("plotting") == std::string::npos);
+  REQUIRE(out.str().find("total") != std::string::npos);
+
+  REQUIRE(std::string(alloc_subsystem_name(EnvironmentAllocs)) == "environment");
+}
+
+TEST_CASE( "Test allocations are counted by subsystem", "[alloc_stats]" ) {
+
+  AllocStats before = alloc_stats();
+
+  Interpreter interp;
+  std::istringstream program("(begin (define f (lambda (x) (list x (* 2 x)))) "
+                             "(discrete-plot (map f (range 0 10 1)) (list)))");
+  REQUIRE(interp.parseStream(program));
+  interp.evaluate();
+
+  AllocStats counted = alloc_stats() - before;
+
+  if(!alloc_stats_enabled()){
+    INFO("without ALLOC_STATS nothing is counted");
+    REQUIRE(counted.total().allocations == 0);
+    return;
+  }
+
+  for(AllocSubsystem s : {ParseAllocs, EvalAllocs, EnvironmentAllocs, ProcedureAllocs, PlotAllocs}){
+    INFO(alloc_subsystem_name(s));
+    REQUIRE(counted.counts[s].allocations > 0);
+    REQUIRE(counted.counts[s].bytes > 0);
+  }
+
+  {
+    INFO("a scope counts against its subsystem until it ends");
+    AllocStats start = alloc_stats();
+    {
+      AllocScope outer(PlotAllocs);
+      {
+        AllocScope inner(ParseAllocs);
+        ::operator delete(::operator new(400));
+      }
+      ::operator delete(::operator new(200));
+    }
+    AllocStats scoped = alloc_stats() - start;
+    REQUIRE(scoped.counts[ParseAllocs].allocations == 1);
+    REQUIRE(scoped.counts[ParseAllocs].bytes == 400);
+    REQUIRE(scoped.counts[PlotAllocs].allocations == 1);
+    REQUIRE(scoped.counts[PlotAllocs].bytes == 200);
+  }
+}
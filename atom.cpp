@@ -1,43 +1,161 @@
 #include "atom.hpp"
 
-#include <sstream>
 #include <cctype>
 #include <cmath>
 #include <limits>
 #include <iostream>
+#include <atomic>
+#include <deque>
+#include <mutex>
+
+/***********************************************************************
+Symbol interning. The table is a function-local static so it is safe to
+use during static initialization; names live in a deque so references
+handed out by symbol_name stay valid as the table grows.
+**********************************************************************/
+
+namespace {
+
+struct SymbolTable {
+  std::mutex mutex;
+  std::unordered_map<std::string, SymbolId> ids;
+  std::deque<std::string> names;
+};
+
+SymbolTable & symbol_table(){
+  static SymbolTable table;
+  return table;
+}
+
+// intern name, also returning the address of the interned copy
+SymbolId intern(const std::string & name, const std::string ** text){
+
+  SymbolTable & table = symbol_table();
+  std::lock_guard<std::mutex> lock(table.mutex);
+
+  auto result = table.ids.find(name);
+  if(result != table.ids.end()){
+    *text = &table.names[result->second];
+    return result->second;
+  }
+
+  SymbolId id = table.names.size();
+  table.names.push_back(name);
+  table.ids.emplace(name, id);
+  *text = &table.names.back();
+  return id;
+}
+
+const std::string empty_text;
+
+}
+
+SymbolId intern_symbol(const std::string & name){
 
-Atom::Atom(): m_type(NoneKind) {}
+  const std::string * text;
+  return intern(name, &text);
+}
 
-Atom::Atom(double value){
+const std::string & symbol_name(SymbolId id){
+
+  SymbolTable & table = symbol_table();
+  std::lock_guard<std::mutex> lock(table.mutex);
+
+  return table.names.at(id);
+}
+
+std::size_t interned_symbol_count(){
+
+  SymbolTable & table = symbol_table();
+  std::lock_guard<std::mutex> lock(table.mutex);
+
+  return table.names.size();
+}
+
+/***********************************************************************
+Quoted text is held in a block shared by the Atoms holding it, counted so
+the last to let go frees it. Atoms are copied across threads (the pool's
+evaluators), so the count is atomic.
+**********************************************************************/
+
+struct Atom::SharedText {
+  explicit SharedText(const std::string & text): refs(1), text(text) {}
+
+  std::atomic<std::size_t> refs;
+  std::string text;
+};
+
+void Atom::retain() const noexcept{
+  sharedValue.text->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Atom::release() noexcept{
+  if(sharedValue.text->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    delete sharedValue.text;
+}
+
+void Atom::setText(Type type, const std::string & value){
+
+  SharedText * text = nullptr;
+  if(!value.empty() && value.front() == '\"')
+    text = new SharedText(value);
+
+  clear();
+  if(text){
+    sharedValue.id = NoSymbolId;
+    sharedValue.text = text;
+  }
+  else{
+    textValue.id = intern(value, &textValue.name);
+  }
+  m_type = type;
+}
+
+Atom::Atom(): m_type(NoneKind), textValue{NoSymbolId, nullptr} {}
+
+Atom::Atom(double value): Atom(){
 
   setNumber(value);
 }
 
-Atom::Atom(std::complex<double> value) {
+Atom::Atom(std::complex<double> value): Atom() {
   setComplex(value);
 }
 
 Atom::Atom(const Token & token): Atom(){
 
+  const std::string text = token.asString();
+  setFromToken(text.data(), text.size());
+}
+
+Atom::Atom(const char * text, std::size_t length): Atom(){
+
+  setFromToken(text, length);
+}
+
+void Atom::setFromToken(const char * text, std::size_t length){
+
+  if(length == 0) return;
+
   // is token a number?
   double temp;
-  std::istringstream iss(token.asString());
-  if(iss >> temp){
-    // check for trailing characters if >> succeeds
-    if(iss.rdbuf()->in_avail() == 0)
-      setNumber(temp);
+  NumberScan scan = scan_number(text, text + length, temp);
+  if(scan == Number){
+    setNumber(temp);
   }
-  else{ // else assume symbol
+  else if(scan == NotANumber){ // else assume symbol
 
-    if(token.asString() == "list")
+    std::string value(text, length);
+    if(value == "list")
       setList();
     // make sure does not start with number
-    if(token.asString().front() == '\"') {
-      setString(token.asString());
+    if(value.front() == '\"') {
+      setString(value);
     }
-    else if(!std::isdigit(token.asString()[0]))
-      setSymbol(token.asString());
+    else if(!std::isdigit(static_cast<unsigned char>(value[0])))
+      setSymbol(value);
   }
+  // a number with trailing characters is not an atom
 }
 
 Atom::Atom(const std::string & value): Atom() {
@@ -47,47 +165,6 @@ Atom::Atom(const std::string & value): Atom() {
     setSymbol(value);
 }
 
-Atom::Atom(const Atom & x): Atom(){
-  if(x.isNumber())
-    setNumber(x.numberValue);
-  else if(x.isComplex())
-    setComplex(x.complexValue);
-  else if(x.isSymbol())
-    setSymbol(x.stringValue);
-  else if(x.isList())
-    setList();
-}
-
-Atom & Atom::operator=(const Atom & x){
-
-  if(this != &x){
-    if(x.m_type == NoneKind){
-      m_type = NoneKind;
-    }
-    else if(x.m_type == NumberKind){
-      setNumber(x.numberValue);
-    }
-    else if(x.m_type == ComplexKind) {
-      setComplex(x.complexValue);
-    }
-    else if(x.m_type == SymbolKind){
-      setSymbol(x.stringValue);
-    }
-    else if(x.m_type == ListKind) {
-      setList();
-    }
-  }
-  return *this;
-}
-
-Atom::~Atom(){
-
-  // we need to ensure the destructor of the symbol string is called
-  if(m_type == SymbolKind){
-    stringValue.~basic_string();
-  }
-}
-
 bool Atom::isNone() const noexcept{
   return m_type == NoneKind;
 }
@@ -119,46 +196,34 @@ bool Atom::isString() const noexcept {
 
 void Atom::setNumber(double value){
 
+  clear();
   m_type = NumberKind;
   numberValue = value;
 }
 
 void Atom::setComplex(std::complex<double> value) {
+  clear();
   m_type = ComplexKind;
-  complexValue = value;
+  complexValue[0] = value.real();
+  complexValue[1] = value.imag();
 }
 
 void Atom::setSymbol(const std::string & value){
-
-  // we need to ensure the destructor of the symbol string is called
-  if(m_type == SymbolKind){
-    stringValue.~basic_string();
-  }
-
-  m_type = SymbolKind;
-
-  // copy construct in place
-  new (&stringValue) std::string(value);
+  setText(SymbolKind, value);
 }
 
 void Atom::setList() { //const std::vector<Atom> & value_list
+  clear();
   m_type = ListKind;
 }
 
 void Atom::setLambda() {
+  clear();
   m_type = LambdaKind;
 }
 
 void Atom::setString(const std::string & value) {
-  // we need to ensure the destructor of the symbol string is called
-  if(m_type == StringKind){
-    stringValue.~basic_string();
-  }
-
-  m_type = StringKind;
-
-  // copy construct in place
-  new (&stringValue) std::string(value);
+  setText(StringKind, value);
 }
 
 
@@ -176,28 +241,30 @@ std::complex<double> Atom::asComplex() const noexcept {
     return turned_complex;
   }
   else if(m_type == ComplexKind)
-    return complexValue;
+    return std::complex<double>(complexValue[0], complexValue[1]);
   else
     return 0.+0i; // if NaN return complex object of (0,0)
 }
 
 
-std::string Atom::asSymbol() const noexcept{
-
-  std::string result;
+const std::string & Atom::asSymbol() const noexcept{
 
+  if(shares_text()){
+    return sharedValue.text->text;
+  }
   if(m_type == SymbolKind || m_type == StringKind){
-    result = stringValue;
+    return *textValue.name;
   }
 
-  return result;
+  return empty_text;
 }
 
-std::string Atom::asString() const noexcept {
-  if(m_type == SymbolKind || m_type == StringKind)
-    return stringValue;
-  else
-    return std::string();
+const std::string & Atom::asString() const noexcept {
+  return asSymbol();
+}
+
+SymbolId Atom::symbolId() const noexcept {
+  return (m_type == SymbolKind) ? textValue.id : NoSymbolId;
 }
 
 bool Atom::operator==(const Atom & right) const noexcept{
@@ -221,8 +288,8 @@ bool Atom::operator==(const Atom & right) const noexcept{
   case ComplexKind:
     {
       if(right.m_type != ComplexKind) return false;
-      std::complex<double> dleft = complexValue;
-      std::complex<double> dright = right.complexValue;
+      std::complex<double> dleft = asComplex();
+      std::complex<double> dright = right.asComplex();
       std::complex<double> diff = fabs(dleft - dright);
       if(diff!=diff) return false; //|| (diff > std::numeric_limits<double>::epsilon())) return false;
     }
@@ -231,7 +298,10 @@ bool Atom::operator==(const Atom & right) const noexcept{
     {
       if(right.m_type != SymbolKind) return false;
 
-      return stringValue == right.stringValue;
+      // interned, so equal names have equal ids; quoted text has none
+      if(shares_text() || right.shares_text())
+        return asSymbol() == right.asSymbol();
+      return textValue.id == right.textValue.id;
     }
     break;
   default:
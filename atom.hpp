@@ -12,11 +12,43 @@ using namespace std;
 #include <vector>
 #include <list>
 #include <unordered_map>
+#include <string>
+#include <cstddef>
+#include <cstring>
+
+/*! \typedef SymbolId
+\brief Integer handle for an interned symbol name.
+
+Every distinct symbol name is assigned a small, dense id the first time it is
+interned. Ids are stable for the lifetime of the process and shared by all
+threads, so two symbols are equal exactly when their ids are equal.
+*/
+typedef std::size_t SymbolId;
+
+/// The id carried by Atoms that are not symbols
+const SymbolId NoSymbolId = static_cast<SymbolId>(-1);
+
+/// Intern a symbol name, returning its id (thread-safe)
+SymbolId intern_symbol(const std::string & name);
+
+/// Return the name an id was interned from (thread-safe)
+const std::string & symbol_name(SymbolId id);
+
+/// Return the number of symbols interned so far
+std::size_t interned_symbol_count();
 
 /*! \class Atom
 \brief A variant type that may be a Number or Symbol or the default type None.
 
-This class provides value semantics.
+This class provides value semantics. An Atom is a type tag and a 16 byte
+payload: numbers and complex numbers are stored inline, and symbols are
+interned and stored as their id and a pointer to the interned text, so
+copying them is a plain copy of the payload.
+
+Quoted text (string literals, and plot labels, which are built as symbols)
+is not interned: a program may make any amount of it, and the intern table
+is never emptied. It is held in a reference-counted block shared by the
+Atom's copies and freed with the last of them; such an Atom has no id.
 */
 class Atom {
 public:
@@ -36,14 +68,42 @@ public:
   /// Construct an Atom directly from a Token
   Atom(const Token & token);
 
-  /// Copy-construct an Atom
-  Atom(const Atom & x);
+  /// Construct an Atom from the text of a token, length characters at text
+  Atom(const char * text, std::size_t length);
 
-  /// Assign an Atom
-  Atom & operator=(const Atom & x);
+  /// Copy-construct an Atom, sharing any quoted text
+  Atom(const Atom & x) noexcept: m_type(x.m_type) {
+    copy_payload(x);
+    if(shares_text()) retain();
+  }
 
-  /// Atom destructor
-  ~Atom();
+  /// Move-construct an Atom, leaving x None
+  Atom(Atom && x) noexcept: m_type(x.m_type) {
+    copy_payload(x);
+    x.m_type = NoneKind;
+  }
+
+  /// Assign an Atom
+  Atom & operator=(const Atom & x) noexcept {
+    if(x.shares_text()) x.retain();
+    clear();
+    m_type = x.m_type;
+    copy_payload(x);
+    return *this;
+  }
+
+  /// Move-assign an Atom, leaving x None
+  Atom & operator=(Atom && x) noexcept {
+    if(this != &x){
+      clear();
+      m_type = x.m_type;
+      copy_payload(x);
+      x.m_type = NoneKind;
+    }
+    return *this;
+  }
+
+  ~Atom() { clear(); }
 
   /// predicate to determine if an Atom is of type None
   bool isNone() const noexcept;
@@ -72,10 +132,14 @@ public:
   /// value of Atom as a complex, return (0,0) if not a complex
   std::complex<double> asComplex() const noexcept;
 
-  /// value of Atom as a number, returns empty-string if not a Symbol
-  std::string asSymbol() const noexcept;
+  /// name of the Atom if a Symbol, text if a String, else the empty string
+  const std::string & asSymbol() const noexcept;
 
-  std::string asString() const noexcept;
+  /// text of the Atom if a String, name if a Symbol, else the empty string
+  const std::string & asString() const noexcept;
+
+  /// interned id of the Atom, NoSymbolId if not a Symbol or if quoted text
+  SymbolId symbolId() const noexcept;
 
   // helper to set type to list
   void setList();
@@ -97,22 +161,62 @@ public:
 private:
 
   // internal enum of known types
-  enum Type {NoneKind, NumberKind, SymbolKind, ComplexKind, ListKind, LambdaKind, StringKind};
+  enum Type : unsigned char {NoneKind, NumberKind, SymbolKind, ComplexKind, ListKind, LambdaKind, StringKind};
+
+  // an interned name, valid when m_type is SymbolKind or StringKind and id
+  // is not NoSymbolId
+  struct Text {
+    SymbolId id;
+    const std::string * name; // owned by the intern table, never freed
+  };
+
+  // quoted text, valid when m_type is SymbolKind or StringKind and id is
+  // NoSymbolId; id is where it is in Text, so either may read it
+  struct SharedText;
+  struct Shared {
+    SymbolId id;
+    SharedText * text;
+  };
+
+  // true if the payload is Shared
+  bool shares_text() const noexcept {
+    return (m_type == SymbolKind || m_type == StringKind) && (textValue.id == NoSymbolId);
+  }
+
+  // count another holder of the shared text, or let one go
+  void retain() const noexcept;
+  void release() noexcept;
+
+  // let go of any shared text, leaving the Atom None
+  void clear() noexcept {
+    if(shares_text()) release();
+    m_type = NoneKind;
+  }
+
+  void copy_payload(const Atom & x) noexcept {
+    std::memcpy(complexValue, x.complexValue, sizeof(complexValue));
+  }
+
+  // hold value, interned unless it is quoted text
+  void setText(Type type, const std::string & value);
 
   // track the type
   Type m_type;
 
-  // values for the known types. Note the use of a union requires care
-  // when setting non POD values (see setSymbol)
+  // values for the known types; only shared text is counted
   union {
     double numberValue;
-    std::string stringValue;
-    std::complex<double> complexValue;
+    double complexValue[2]; // real and imaginary parts
+    Text textValue;
+    Shared sharedValue;
   };
 
   // Helper to set type and value of Complex
   void setComplex(std::complex<double> value);
 
+  // Helper to set type and value from the text of a token
+  void setFromToken(const char * text, std::size_t length);
+
 };
 
 /// inequality comparison for Atom
@@ -257,3 +257,105 @@ TEST_CASE( "test comparison", "[atom]" ) {
   }
 
 }
+
+TEST_CASE( "Test symbol interning", "[atom]" ) {
+
+  {
+    INFO("same name, same id");
+    Atom a("interned");
+    Atom b(Token("interned"));
+    Atom c(a);
+    REQUIRE(a.symbolId() != NoSymbolId);
+    REQUIRE(a.symbolId() == b.symbolId());
+    REQUIRE(a.symbolId() == c.symbolId());
+    REQUIRE(symbol_name(a.symbolId()) == "interned");
+  }
+
+  {
+    INFO("different names, different ids");
+    Atom a("left");
+    Atom b("right");
+    REQUIRE(a.symbolId() != b.symbolId());
+    REQUIRE(intern_symbol("left") == a.symbolId());
+  }
+
+  {
+    INFO("non-symbols have no id");
+    Atom a(1.0);
+    Atom b;
+    REQUIRE(a.symbolId() == NoSymbolId);
+    REQUIRE(b.symbolId() == NoSymbolId);
+
+    Atom c("temp");
+    c.setNumber(2.0);
+    REQUIRE(c.symbolId() == NoSymbolId);
+  }
+}
+
+TEST_CASE( "Test compact representation", "[atom]" ) {
+
+  REQUIRE(sizeof(Atom) <= 24);
+
+  {
+    INFO("text accessors refer to interned storage");
+    Atom a("shared");
+    Atom b("shared");
+    REQUIRE(&a.asSymbol() == &b.asSymbol());
+    REQUIRE(a.asString() == "shared");
+  }
+
+  {
+    INFO("strings are not interned, but copies share their text");
+    Atom a(Token("\"text\""));
+    Atom b(Token("\"text\""));
+    Atom copy = a;
+    REQUIRE(a.isString());
+    REQUIRE(a.symbolId() == NoSymbolId);
+    REQUIRE(&a.asString() != &b.asString());
+    REQUIRE(&copy.asString() == &a.asString());
+    REQUIRE(copy.asString() == "\"text\"");
+  }
+
+  {
+    INFO("shared text outlives the atom it came from");
+    Atom * a = new Atom(Token("\"kept\""));
+    Atom b(*a);
+    Atom c;
+    c = *a;
+    delete a;
+    REQUIRE(b.asString() == "\"kept\"");
+    c = Atom(2.);
+    REQUIRE(c.isNumber());
+    Atom d(std::move(b));
+    REQUIRE(d.asString() == "\"kept\"");
+    REQUIRE(b.isNone());
+  }
+
+  {
+    INFO("quoted text is compared by its characters");
+    REQUIRE(Atom("\"label\"") == Atom("\"label\""));
+    REQUIRE(Atom("\"label\"") != Atom("\"other\""));
+    REQUIRE(Atom("\"label\"").isSymbol());
+    REQUIRE(Atom("\"label\"").symbolId() == NoSymbolId);
+  }
+
+  {
+    INFO("new quoted text does not grow the symbol table");
+    Atom("\"warm\"");
+    std::size_t before = interned_symbol_count();
+    for(int i = 0; i < 100; ++i){
+      Atom a("\"literal " + std::to_string(i) + "\"");
+      Atom b(Token("\"token " + std::to_string(i) + "\""));
+    }
+    REQUIRE(interned_symbol_count() == before);
+  }
+
+  {
+    INFO("complex values survive a copy");
+    Atom a(std::complex<double>(1.5, -2.));
+    Atom b = a;
+    REQUIRE(b.isComplex());
+    REQUIRE(b.asComplex() == std::complex<double>(1.5, -2.));
+    REQUIRE(Atom(3.).asSymbol().empty());
+  }
+}
@@ -0,0 +1,417 @@
+#include "bytecode.hpp"
+
+// system includes
+#include <iostream>
+#include <unordered_map>
+
+// module includes
+#include "semantic_error.hpp"
+
+/***********************************************************************
+The compiler walks the AST once, emitting code that performs the same
+steps, in the same order, as Expression::eval would. Checks that the
+tree-walker makes on the shape of a special form are made here, and a
+failing check compiles to an OP_ERROR at the point the tree-walker would
+have thrown.
+**********************************************************************/
+
+namespace {
+
+// the compiler recurses on the native stack, once per level of nesting;
+// deeper expressions are handed to the tree-walker, which keeps its frames
+// on the heap, so --vm accepts the same depth as tree-walking
+const std::size_t MaxNesting = 10000;
+
+class Compiler {
+public:
+
+  Compiler(Chunk & output): chunk(output), nesting(0) {}
+
+  // bind argument names to local slots, the last of duplicate names wins
+  void arguments(const Expression & params){
+    for(auto & p : params.getTail()){
+      slots[p.head().symbolId()] = static_cast<std::uint32_t>(chunk.params.size());
+      chunk.params.push_back(p.head().symbolId());
+    }
+  }
+
+  // compile exp, tail when its value is the value of the lambda body
+  void expression(const Expression & exp, bool tail = false);
+
+  std::uint32_t emit(OpCode op, std::uint32_t a = 0, std::uint32_t b = 0){
+    chunk.code.push_back(Instruction{op, a, b});
+    return static_cast<std::uint32_t>(chunk.code.size() - 1);
+  }
+
+private:
+
+  std::uint32_t here() const {
+    return static_cast<std::uint32_t>(chunk.code.size());
+  }
+
+  std::uint32_t constant(const Expression & value){
+    chunk.constants.push_back(value);
+    return static_cast<std::uint32_t>(chunk.constants.size() - 1);
+  }
+
+  std::uint32_t symbol(const Atom & sym){
+    auto found = symbol_index.find(sym.symbolId());
+    if((sym.symbolId() != NoSymbolId) && (found != symbol_index.end())){
+      return found->second;
+    }
+
+    chunk.symbols.push_back(sym);
+    std::uint32_t index = static_cast<std::uint32_t>(chunk.symbols.size() - 1);
+    if(sym.symbolId() != NoSymbolId){
+      symbol_index.emplace(sym.symbolId(), index);
+    }
+    return index;
+  }
+
+  void error(const std::string & message){
+    chunk.messages.push_back(message);
+    emit(OP_ERROR, static_cast<std::uint32_t>(chunk.messages.size() - 1));
+  }
+
+  void terminal(const Atom & head);
+  void procedure(const Expression & exp, bool tail);
+  void begin(const Expression & exp, bool tail);
+  void define(const Expression & exp);
+  void lambda(const Expression & exp);
+  void apply(const Expression & exp);
+  void map(const Expression & exp);
+  void folded(const Expression & exp, bool tail);
+
+  Chunk & chunk;
+
+  // current depth of nested expressions
+  std::size_t nesting;
+
+  // symbol pool index of each symbol already in the pool
+  std::unordered_map<SymbolId, std::uint32_t> symbol_index;
+
+  // local slot of each lambda argument
+  std::unordered_map<SymbolId, std::uint32_t> slots;
+};
+
+void Compiler::expression(const Expression & exp, bool tail){
+
+  if(exp.getTail().empty()){
+    terminal(exp.head());
+    return;
+  }
+
+  if(nesting == MaxNesting){
+    emit(OP_EVAL, constant(exp));
+    return;
+  }
+
+  struct Nest {
+    std::size_t & n;
+    Nest(std::size_t & n): n(n) { ++n; }
+    ~Nest() { --n; }
+  } nest(nesting);
+
+  switch(exp.form()){
+  case Expression::BeginForm:
+    begin(exp, tail);
+    break;
+  case Expression::DefineForm:
+    define(exp);
+    break;
+  case Expression::LambdaForm:
+    lambda(exp);
+    break;
+  case Expression::ApplyForm:
+    apply(exp);
+    break;
+  case Expression::MapForm:
+    map(exp);
+    break;
+  case Expression::ConstantForm:
+    folded(exp, tail);
+    break;
+  case Expression::SetPropertyForm:
+  case Expression::GetPropertyForm:
+  case Expression::DiscretePlotForm:
+  case Expression::ContinuousPlotForm:
+  case Expression::PMapForm:
+    // property and plot forms are not on any hot path, and pmap spends its
+    // time in the pool's evaluators, so they are handed back to the
+    // tree-walker
+    emit(OP_EVAL, constant(exp));
+    break;
+  default:
+    procedure(exp, tail);
+  }
+}
+
+// mirrors Expression::handle_lookup
+void Compiler::terminal(const Atom & head){
+
+  const std::string & name = head.asString();
+
+  if(!name.empty() && (name.front() == '\"')){
+    emit(OP_CONSTANT, constant(Expression(head)));
+  }
+  else if(head.isSymbol()){
+    if(name == "list"){
+      Expression empty;
+      empty.setHeadList();
+      emit(OP_CONSTANT, constant(empty));
+      return;
+    }
+
+    auto slot = slots.find(head.symbolId());
+    if(slot != slots.end()){
+      emit(OP_LOCAL, slot->second);
+    }
+    else{
+      emit(OP_LOOKUP, symbol(head));
+    }
+  }
+  else if(head.isNumber()){
+    emit(OP_CONSTANT, constant(Expression(Atom(head.asNumber()))));
+  }
+  else if(head.isComplex()){
+    emit(OP_CONSTANT, constant(Expression(head.asComplex())));
+  }
+  else{
+    error("Error during evaluation: Invalid type in terminal expression");
+  }
+}
+
+// mirrors Expression::handle_procedure and Expression::apply
+void Compiler::procedure(const Expression & exp, bool tail){
+
+  for(auto & arg : exp.getTail()){
+    expression(arg);
+  }
+
+  const Atom & op = exp.head();
+  std::uint32_t nargs = static_cast<std::uint32_t>(exp.getTail().size());
+
+  if(op.isSymbol()){
+    emit(tail ? OP_TAIL_CALL : OP_CALL, symbol(op), nargs);
+  }
+  else if(op.isString() || op.isLambda()){
+    error("Error during evaluation: symbol does not name a procedure or lambda.");
+  }
+  else{
+    error("Error during evaluation: procedure name not symbol or lambda.");
+  }
+}
+
+// mirrors Expression::handle_begin
+void Compiler::begin(const Expression & exp, bool tail){
+
+  const std::vector<Expression> & args = exp.getTail();
+
+  for(std::size_t i = 0; i < args.size(); ++i){
+    if(i != 0) emit(OP_POP);
+    expression(args[i], tail && (i + 1 == args.size()));
+  }
+}
+
+// mirrors Expression::handle_define
+void Compiler::define(const Expression & exp){
+
+  const std::vector<Expression> & tail = exp.getTail();
+
+  if(tail.size() != 2){
+    error("Error during evaluation: invalid number of arguments to define");
+    return;
+  }
+
+  if(!tail[0].isHeadSymbol()){
+    error("Error during evaluation: first argument to define not symbol");
+    return;
+  }
+
+  const std::string & s = tail[0].head().asSymbol();
+  if((s == "define") || (s == "begin") || (s == "lambda")){
+    error("Error during evaluation: attempt to redefine a special-form");
+    return;
+  }
+
+  // the tree-walker's built-in check can never fire: only the global
+  // environment binds procedures, and it never binds "define"
+  expression(tail[1]);
+  emit(OP_DEFINE, symbol(tail[0].head()));
+}
+
+// mirrors Expression::handle_lambda, the value is built at compile time
+void Compiler::lambda(const Expression & exp){
+
+  const std::vector<Expression> & tail = exp.getTail();
+
+  if(tail.size() != 2){
+    error("Error during evaluation: invalid number of arguments to define");
+    return;
+  }
+
+  emit(OP_CONSTANT, constant(Expression::makeLambda(tail[0], tail[1])));
+}
+
+// mirrors Expression::handle_apply
+void Compiler::apply(const Expression & exp){
+
+  const std::vector<Expression> & tail = exp.getTail();
+
+  if(tail.size() != 2){
+    error("Error in call to apply: invalid number of arguments");
+    return;
+  }
+
+  if(!tail[1].isHeadList()){
+    error("Error in call to apply: invalid list argument");
+    return;
+  }
+
+  if(!tail[0].getTail().empty()){
+    error("Error in call to apply: invalid symbol argument");
+    return;
+  }
+
+  std::uint32_t op = symbol(tail[0].head());
+
+  // a procedure gets the list's elements evaluated one by one
+  std::uint32_t not_proc = emit(OP_IF_NOT_PROC, op);
+  for(auto & arg : tail[1].getTail()){
+    expression(arg);
+  }
+  emit(OP_CALL, op, static_cast<std::uint32_t>(tail[1].getTail().size()));
+  std::uint32_t done_proc = emit(OP_JUMP);
+
+  // a lambda gets the evaluated list
+  chunk.code[not_proc].b = here();
+  std::uint32_t not_exp = emit(OP_IF_NOT_EXP, op);
+  expression(tail[1]);
+  emit(OP_APPLY_LAMBDA, op);
+  std::uint32_t done_exp = emit(OP_JUMP);
+
+  chunk.code[not_exp].b = here();
+  error("Error in call to apply: invalid symbol argument");
+
+  chunk.code[done_proc].a = here();
+  chunk.code[done_exp].a = here();
+}
+
+// mirrors Expression::handle_map
+void Compiler::map(const Expression & exp){
+
+  const std::vector<Expression> & tail = exp.getTail();
+
+  if(tail.size() != 2){
+    error("Error in call to map: invalid number of arguments");
+    return;
+  }
+
+  if(!tail[1].isHeadList() && tail[1].head().asString() != "range"){
+    error("Error in call to mapy: invalid list argument");
+    return;
+  }
+
+  if(!tail[0].getTail().empty()){
+    error("Error in call to map: invalid symbol argument");
+    return;
+  }
+
+  std::uint32_t op = symbol(tail[0].head());
+
+  // a procedure is applied to each argument of the list expression
+  std::uint32_t not_proc = emit(OP_IF_NOT_PROC, op);
+  for(auto & arg : tail[1].getTail()){
+    expression(arg);
+  }
+  emit(OP_MAP_PROC, op, static_cast<std::uint32_t>(tail[1].getTail().size()));
+  std::uint32_t done_proc = emit(OP_JUMP);
+
+  // a lambda is applied to each element of the evaluated list
+  chunk.code[not_proc].b = here();
+  std::uint32_t not_exp = emit(OP_IF_NOT_EXP, op);
+  expression(tail[1]);
+  emit(OP_MAP_LAMBDA, op);
+  std::uint32_t done_exp = emit(OP_JUMP);
+
+  chunk.code[not_exp].b = here();
+  error("Error in call to apply: invalid symbol argument.");
+
+  chunk.code[done_proc].a = here();
+  chunk.code[done_exp].a = here();
+}
+
+}
+
+// a folded constant, with the original compiled after it for where the
+// fold does not hold (see fold_holds)
+void Compiler::folded(const Expression & exp, bool tail){
+
+  std::uint32_t check = emit(OP_FOLDED, constant(exp));
+  expression(exp.getTail()[1], tail);
+  chunk.code[check].b = here();
+}
+
+Chunk compile(const Expression & program){
+
+  Chunk chunk;
+  Compiler compiler(chunk);
+
+  compiler.expression(program);
+  compiler.emit(OP_RETURN);
+
+  return chunk;
+}
+
+Chunk compile_lambda(const Expression & params, const Expression & body){
+
+  Chunk chunk;
+  Compiler compiler(chunk);
+
+  compiler.arguments(params);
+  compiler.expression(body, true);
+  compiler.emit(OP_RETURN);
+
+  return chunk;
+}
+
+std::ostream & operator<<(std::ostream & out, const Chunk & chunk){
+
+  static const char * names[] = {
+    "CONSTANT", "LOCAL", "LOOKUP", "POP", "CALL", "TAIL_CALL", "DEFINE", "JUMP",
+    "IF_NOT_PROC", "IF_NOT_EXP", "MAP_PROC", "MAP_LAMBDA", "APPLY_LAMBDA",
+    "EVAL", "FOLDED", "ERROR", "RETURN"
+  };
+
+  for(std::size_t pc = 0; pc < chunk.code.size(); ++pc){
+    const Instruction & ins = chunk.code[pc];
+    out << pc << '\t' << names[ins.op] << '\t' << ins.a << '\t' << ins.b;
+
+    switch(ins.op){
+    case OP_CONSTANT:
+    case OP_EVAL:
+    case OP_FOLDED:
+      out << "\t; " << chunk.constants[ins.a];
+      break;
+    case OP_LOOKUP:
+    case OP_CALL:
+    case OP_TAIL_CALL:
+    case OP_DEFINE:
+    case OP_IF_NOT_PROC:
+    case OP_IF_NOT_EXP:
+    case OP_MAP_PROC:
+    case OP_MAP_LAMBDA:
+    case OP_APPLY_LAMBDA:
+      out << "\t; " << chunk.symbols[ins.a];
+      break;
+    case OP_ERROR:
+      out << "\t; " << chunk.messages[ins.a];
+      break;
+    default:
+      break;
+    }
+    out << '\n';
+  }
+
+  return out;
+}
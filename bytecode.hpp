@@ -0,0 +1,91 @@
+/*! \file bytecode.hpp
+Defines the bytecode instruction set and the compiler that lowers a parsed
+Expression (AST) into it.
+
+The compiled form is executed by the VirtualMachine (see vm.hpp). It is an
+optional alternative to walking the AST with Expression::eval; both must
+produce the same results, so the compiler mirrors the tree-walker's
+evaluation order and error checks exactly.
+ */
+#ifndef BYTECODE_HPP
+#define BYTECODE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "atom.hpp"
+#include "expression.hpp"
+
+/*! \enum OpCode
+\brief The operations of the plotscript stack machine.
+
+Operands are indices into the constants, symbols or messages pools of the
+enclosing Chunk, slot numbers, argument counts or jump targets.
+ */
+enum OpCode {
+  OP_CONSTANT,      //< push constants[a]
+  OP_LOCAL,         //< push the lambda argument in slot a
+  OP_LOOKUP,        //< push the value symbols[a] is bound to
+  OP_POP,           //< discard the top of the stack
+  OP_CALL,          //< call symbols[a] with the top b values as arguments
+  OP_TAIL_CALL,     //< OP_CALL in tail position of a lambda body, may reuse its frame
+  OP_DEFINE,        //< bind symbols[a] to the top of the stack, leaving it
+  OP_JUMP,          //< continue at instruction a
+  OP_IF_NOT_PROC,   //< continue at b unless symbols[a] names a procedure
+  OP_IF_NOT_EXP,    //< continue at b unless symbols[a] names an expression
+  OP_MAP_PROC,      //< pop b values, push the list of procedure symbols[a] applied to each
+  OP_MAP_LAMBDA,    //< pop a list, push the list of lambda symbols[a] applied to each element
+  OP_APPLY_LAMBDA,  //< pop a list, call lambda symbols[a] with its elements as arguments
+  OP_EVAL,          //< push the tree-walking evaluation of constants[a]
+  OP_FOLDED,        //< push the value of folded constants[a] and continue at b, if it holds
+  OP_ERROR,         //< raise a SemanticError with messages[a]
+  OP_RETURN         //< return the top of the stack from the chunk
+};
+
+/*! \struct Instruction
+\brief A single bytecode instruction: an opcode and up to two operands.
+ */
+struct Instruction {
+  OpCode op;
+  std::uint32_t a;
+  std::uint32_t b;
+};
+
+/*! \struct Chunk
+\brief A compiled program or lambda body.
+
+The symbols pool holds interned Atoms, so symbol resolution at run time is an
+id-indexed environment lookup. For a lambda body, params lists the argument
+names in slot order.
+ */
+struct Chunk {
+  std::vector<Instruction> code;
+  std::vector<Expression> constants;
+  std::vector<Atom> symbols;
+  std::vector<std::string> messages;
+  std::vector<SymbolId> params;
+};
+
+/*! \fn compile
+\brief Compile a program (the root of a parsed AST) into a Chunk.
+
+\param program the expression to compile
+\return the compiled chunk, ending with OP_RETURN; subexpressions nested
+too deeply to compile are left to the tree-walker (OP_EVAL)
+ */
+Chunk compile(const Expression & program);
+
+/*! \fn compile_lambda
+\brief Compile the body of a lambda whose arguments are named by params.
+
+\param params the lambda's argument list (as built by Expression::makeLambda)
+\param body the lambda body
+\return the compiled chunk, ending with OP_RETURN
+ */
+Chunk compile_lambda(const Expression & params, const Expression & body);
+
+/// Render a chunk as a human readable listing, for debugging
+std::ostream & operator<<(std::ostream & out, const Chunk & chunk);
+
+#endif
@@ -0,0 +1,106 @@
+#include "call_cache.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+const std::size_t CallCache::Capacity;
+
+// the bit pattern of a double, so 0 and -0 (and NaNs) are distinct keys
+static std::uint64_t bits(double x) noexcept {
+  std::uint64_t b;
+  std::memcpy(&b, &x, sizeof(b));
+  return b;
+}
+
+bool CallCache::make_key(const Atom & op, const std::vector<Expression> & args, Key & key){
+
+  key.reserve(1 + 3 * args.size());
+  key.push_back(op.symbolId());
+
+  for(auto & a : args){
+    // tailSize, not getTail: a packed or lazy list must not be expanded
+    // only to be turned away
+    if(a.isHeadList() || a.tailSize() != 0 || !a.property_list.empty())
+      return false;
+
+    // a kind tag keeps the encodings of different kinds apart
+    const Atom & h = a.head();
+    if(h.isNumber()){
+      key.push_back(1);
+      key.push_back(bits(h.asNumber()));
+    }
+    else if(h.isComplex()){
+      key.push_back(2);
+      key.push_back(bits(h.asComplex().real()));
+      key.push_back(bits(h.asComplex().imag()));
+    }
+    else if(h.symbolId() != NoSymbolId){
+      key.push_back(3);
+      key.push_back(h.symbolId());
+    }
+    else if(h.isSymbol()){
+      // quoted text has no id: its length, then its characters packed
+      const std::string & text = h.asSymbol();
+      key.push_back(4);
+      key.push_back(text.size());
+      for(std::size_t i = 0; i < text.size(); i += sizeof(std::uint64_t)){
+        std::uint64_t word = 0;
+        std::memcpy(&word, text.data() + i, std::min(sizeof(word), text.size() - i));
+        key.push_back(word);
+      }
+    }
+    else{
+      return false;
+    }
+  }
+
+  return true;
+}
+
+std::size_t CallCache::KeyHash::operator()(const Key & key) const noexcept {
+
+  // FNV-1a over the words
+  std::uint64_t h = 14695981039346656037ull;
+  for(std::uint64_t word : key){
+    h ^= word;
+    h *= 1099511628211ull;
+  }
+  return static_cast<std::size_t>(h ^ (h >> 32));
+}
+
+bool CallCache::find(const Atom & op, const std::vector<Expression> & args, Expression & result) const{
+
+  Key key;
+  if(!make_key(op, args, key))
+    return false;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto found = entries.find(key);
+  if(found == entries.end())
+    return false;
+
+  result = found->second;
+  return true;
+}
+
+void CallCache::insert(const Atom & op, const std::vector<Expression> & args, const Expression & result){
+
+  Key key;
+  if(!make_key(op, args, key))
+    return;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if(entries.size() >= Capacity)
+    entries.clear();
+  entries[std::move(key)] = result;
+}
+
+void CallCache::clear(){
+  std::lock_guard<std::mutex> lock(mutex);
+  entries.clear();
+}
+
+std::size_t CallCache::size() const{
+  std::lock_guard<std::mutex> lock(mutex);
+  return entries.size();
+}
@@ -0,0 +1,73 @@
+/*! \file call_cache.hpp
+Defines the CallCache, the memo table of calls to pure lambdas.
+ */
+#ifndef CALL_CACHE_HPP
+#define CALL_CACHE_HPP
+
+// system includes
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// module includes
+#include "atom.hpp"
+#include "expression.hpp"
+
+/*! \class CallCache
+\brief Remembers the results of calls by the callee and its arguments.
+
+Only calls whose arguments are all Numbers, Complex numbers or Symbols are
+remembered; they are compared exactly, bit for bit, rather
+than with the tolerance of Atom's operator==. The cache is safe to use from
+several threads (the evaluators of a pmap). When it reaches Capacity it is
+emptied rather than evicting entries one by one.
+
+A copy starts empty: the copied environment may go on to bind symbols the
+remembered calls read differently than the original does.
+ */
+class CallCache {
+public:
+
+  /// Number of calls remembered before the cache is emptied
+  static const std::size_t Capacity = 4096;
+
+  CallCache() = default;
+
+  CallCache(const CallCache &) {}
+  CallCache & operator=(const CallCache &) { clear(); return *this; }
+
+  /*! Look up a call.
+    \param op the symbol naming the callee
+    \param args the arguments of the call
+    \param result set to the remembered result when found
+    \return true if the call was found
+   */
+  bool find(const Atom & op, const std::vector<Expression> & args, Expression & result) const;
+
+  /// Remember the result of a call, if its arguments can be compared exactly
+  void insert(const Atom & op, const std::vector<Expression> & args, const Expression & result);
+
+  /// Forget every call
+  void clear();
+
+  /// Number of calls remembered
+  std::size_t size() const;
+
+private:
+
+  typedef std::vector<std::uint64_t> Key;
+
+  struct KeyHash {
+    std::size_t operator()(const Key & key) const noexcept;
+  };
+
+  // the exact key of a call, false if an argument has none
+  static bool make_key(const Atom & op, const std::vector<Expression> & args, Key & key);
+
+  mutable std::mutex mutex;
+  std::unordered_map<Key, Expression, KeyHash> entries;
+};
+
+#endif
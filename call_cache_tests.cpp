@@ -0,0 +1,51 @@
+#include "catch.hpp"
+
+#include <complex>
+#include <vector>
+
+#include "call_cache.hpp"
+
+TEST_CASE( "Test call cache keys are exact", "[call_cache]" ) {
+
+  CallCache cache;
+  Expression result;
+
+  cache.insert(Atom("f"), {Expression(1.0), Expression(Atom("\"s\""))}, Expression(10.0));
+  cache.insert(Atom("f"), {Expression(0.0)}, Expression(20.0));
+  REQUIRE(cache.size() == 2);
+
+  REQUIRE(cache.find(Atom("f"), {Expression(1.0), Expression(Atom("\"s\""))}, result));
+  REQUIRE(result == Expression(10.0));
+  REQUIRE(cache.find(Atom("f"), {Expression(0.0)}, result));
+  REQUIRE(result == Expression(20.0));
+
+  // other callees, values within Atom's tolerance and other kinds miss
+  REQUIRE(!cache.find(Atom("g"), {Expression(0.0)}, result));
+  REQUIRE(!cache.find(Atom("f"), {Expression(-0.0)}, result));
+  REQUIRE(!cache.find(Atom("f"), {Expression(1e-20)}, result));
+  REQUIRE(!cache.find(Atom("f"), {Expression(std::complex<double>(0, 0))}, result));
+  REQUIRE(!cache.find(Atom("f"), {Expression(1.0)}, result));
+  REQUIRE(!cache.find(Atom("f"), {Expression(1.0), Expression(Atom("\"t\""))}, result));
+  REQUIRE(!cache.find(Atom("f"), {Expression(1.0), Expression(Atom("\"s \""))}, result));
+
+  // lists are not remembered
+  cache.insert(Atom("f"), {Expression::makeList({Expression(1.0)})}, Expression(1.0));
+  REQUIRE(cache.size() == 2);
+
+  // a copy starts empty
+  CallCache copy(cache);
+  REQUIRE(copy.size() == 0);
+
+  cache.clear();
+  REQUIRE(!cache.find(Atom("f"), {Expression(0.0)}, result));
+}
+
+TEST_CASE( "Test call cache capacity", "[call_cache]" ) {
+
+  CallCache cache;
+  for(std::size_t i = 0; i < CallCache::Capacity + 10; ++i){
+    cache.insert(Atom("f"), {Expression(double(i))}, Expression(double(i)));
+    REQUIRE(cache.size() <= CallCache::Capacity);
+  }
+  REQUIRE(cache.size() == 10);
+}
@@ -0,0 +1,50 @@
+#include "cancel_token.hpp"
+
+// system includes
+#include <limits>
+
+// module includes
+#include "eval_context.hpp"
+#include "semantic_error.hpp"
+
+namespace {
+const CancelToken::Clock::rep NoDeadline = std::numeric_limits<CancelToken::Clock::rep>::max();
+}
+
+CancelToken::CancelToken() noexcept
+  : requested(false), deadline(NoDeadline) {}
+
+void CancelToken::reset() noexcept{
+  requested.store(false, std::memory_order_relaxed);
+}
+
+void CancelToken::setDeadline(Clock::time_point when) noexcept{
+  deadline.store(when.time_since_epoch().count(), std::memory_order_relaxed);
+}
+
+void CancelToken::clearDeadline() noexcept{
+  deadline.store(NoDeadline, std::memory_order_relaxed);
+}
+
+bool CancelToken::expired() const noexcept{
+  Clock::rep when = deadline.load(std::memory_order_relaxed);
+  return (when != NoDeadline) && (Clock::now().time_since_epoch().count() >= when);
+}
+
+void CancelToken::check() const{
+
+  if(cancelled())
+    throw SemanticError("Error: interpreter kernel interrupted");
+
+  if(expired())
+    throw SemanticError("Error: evaluation exceeded its time budget");
+}
+
+CancelToken::Scope::Scope(CancelToken * token) noexcept
+  : saved(EvalContext::current().cancelToken()) {
+  EvalContext::current().setCancelToken(token);
+}
+
+CancelToken::Scope::~Scope(){
+  EvalContext::current().setCancelToken(saved);
+}
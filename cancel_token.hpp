@@ -0,0 +1,79 @@
+/*! \file cancel_token.hpp
+Defines the CancelToken, through which an evaluation is interrupted or
+limited in time.
+ */
+#ifndef CANCEL_TOKEN_HPP
+#define CANCEL_TOKEN_HPP
+
+// system includes
+#include <atomic>
+#include <chrono>
+
+/*! \class CancelToken
+\brief A request to stop an evaluation, and the deadline by which it must
+finish.
+
+cancel() may be called from any thread, or from a signal handler: it only
+stores to a lock-free atomic. The evaluating threads poll the token they
+are given (see Scope and EvalContext::poll) at each evaluation step, call
+and element of a map or plot, and throw a SemanticError once it is
+cancelled or past its deadline. The environment keeps whatever the
+evaluation defined before it stopped.
+ */
+class CancelToken {
+public:
+
+  typedef std::chrono::steady_clock Clock;
+
+  /// Make a token that is not cancelled and has no deadline
+  CancelToken() noexcept;
+
+  CancelToken(const CancelToken &) = delete;
+  CancelToken & operator=(const CancelToken &) = delete;
+
+  /// Ask the evaluations polling the token to stop
+  void cancel() noexcept { requested.store(true, std::memory_order_relaxed); }
+
+  /// True if cancel() was called since the last reset()
+  bool cancelled() const noexcept { return requested.load(std::memory_order_relaxed); }
+
+  /// Withdraw a cancel request, for the next evaluation
+  void reset() noexcept;
+
+  /// Stop evaluations that are still running at deadline
+  void setDeadline(Clock::time_point deadline) noexcept;
+
+  /// Let evaluations run however long they take
+  void clearDeadline() noexcept;
+
+  /// True if the deadline has passed
+  bool expired() const noexcept;
+
+  /// Throw SemanticError if cancelled or expired
+  void check() const;
+
+  /*! \class Scope
+  \brief Makes the calling thread poll a token while in scope, or no
+  token when it is null.
+   */
+  class Scope {
+  public:
+    explicit Scope(CancelToken * token) noexcept;
+    ~Scope();
+
+    Scope(const Scope &) = delete;
+    Scope & operator=(const Scope &) = delete;
+
+  private:
+    CancelToken * saved;
+  };
+
+private:
+
+  std::atomic<bool> requested;
+
+  // Clock ticks since its epoch, NoDeadline when there is none
+  std::atomic<Clock::rep> deadline;
+};
+
+#endif
@@ -0,0 +1,105 @@
+#include "catch.hpp"
+
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "cancel_token.hpp"
+#include "eval_context.hpp"
+#include "interpreter.hpp"
+#include "semantic_error.hpp"
+
+// a program that would run for hours: every call of g maps f over a long range
+static const std::string runaway =
+  "(begin (define f (lambda (x) (* x 2))) "
+  "(define g (lambda (n) (length (map f (range 0 100000 1))))) "
+  "(map g (range 0 100000 1)))";
+
+// the message of the error evaluating program, empty if there is none
+static std::string evaluation_error(Interpreter & interp, const std::string & program){
+
+  std::istringstream stream(program);
+  REQUIRE(interp.parseStream(stream));
+  try{
+    interp.evaluate();
+  }
+  catch(const SemanticError & ex){
+    return ex.what();
+  }
+  return std::string();
+}
+
+TEST_CASE( "Test cancel token requests and deadlines", "[cancel_token]" ) {
+
+  CancelToken token;
+  REQUIRE_FALSE(token.cancelled());
+  REQUIRE_FALSE(token.expired());
+  REQUIRE_NOTHROW(token.check());
+
+  token.cancel();
+  REQUIRE(token.cancelled());
+  REQUIRE_THROWS_AS(token.check(), SemanticError);
+  token.reset();
+  REQUIRE_NOTHROW(token.check());
+
+  token.setDeadline(CancelToken::Clock::now() - std::chrono::milliseconds(1));
+  REQUIRE(token.expired());
+  REQUIRE_THROWS_AS(token.check(), SemanticError);
+  token.clearDeadline();
+  REQUIRE_FALSE(token.expired());
+
+  {
+    INFO("a thread polls the token in scope only");
+    EvalContext & context = EvalContext::current();
+    token.cancel();
+    {
+      CancelToken::Scope scope(&token);
+      REQUIRE(context.cancelToken() == &token);
+      REQUIRE_THROWS_AS(context.poll(), SemanticError);
+    }
+    REQUIRE(context.cancelToken() == nullptr);
+    REQUIRE_NOTHROW(context.poll());
+  }
+}
+
+TEST_CASE( "Test evaluation time budget", "[cancel_token]" ) {
+
+  for(auto mode : {Interpreter::TreeWalk, Interpreter::Bytecode}){
+    Interpreter interp;
+    interp.setEvalMode(mode);
+    interp.setTimeBudget(std::chrono::milliseconds(50));
+    REQUIRE(interp.timeBudget() == std::chrono::milliseconds(50));
+
+    REQUIRE(evaluation_error(interp, runaway) == "Error: evaluation exceeded its time budget");
+
+    INFO("the definitions made before the budget ran out are kept");
+    REQUIRE(evaluation_error(interp, "(f 21)").empty());
+  }
+}
+
+TEST_CASE( "Test cancelling an evaluation from another thread", "[cancel_token]" ) {
+
+  for(auto mode : {Interpreter::TreeWalk, Interpreter::Bytecode}){
+    Interpreter interp;
+    interp.setEvalMode(mode);
+
+    {
+      INFO("a request made while no evaluation runs is discarded");
+      interp.cancelToken().cancel();
+      REQUIRE(evaluation_error(interp, "(define a 1)").empty());
+    }
+
+    // a copy shares the token, as the kernel thread's does
+    Interpreter kernel = interp;
+    std::string message;
+    std::thread evaluating([&](){ message = evaluation_error(kernel, runaway); });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    interp.cancelToken().cancel();
+    evaluating.join();
+
+    REQUIRE(message == "Error: interpreter kernel interrupted");
+    REQUIRE(evaluation_error(kernel, "(+ a (f 1))").empty());
+  }
+}
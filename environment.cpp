@@ -1,11 +1,14 @@
 #include "environment.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 
+#include "alloc_stats.hpp"
 #include "environment.hpp"
 #include "interpreter.hpp"
 #include "semantic_error.hpp"
+#include "vector_kernels.hpp"
 #include <iostream>
 
 /***********************************************************************
@@ -17,6 +20,88 @@ bool nargs_equal(const std::vector<Expression> & args, unsigned nargs){
   return args.size() == nargs;
 }
 
+/***********************************************************************
+Element-wise (broadcast) application of the arithmetic procedures. When
+any argument is a list, the procedure is applied to the lists element by
+element, with non-list arguments repeated for every element. Arguments that
+are all Numbers or packed lists of Numbers are combined by the vector
+kernels in one pass; anything else calls the scalar procedure per element.
+**********************************************************************/
+
+// true, with the common length n, if any argument is a list
+static bool broadcast_length(const std::vector<Expression> & args, const std::string & name, std::size_t & n){
+
+  bool found = false;
+  for(auto & a : args){
+    if(!a.isHeadList())
+      continue;
+    if(found && (a.tailSize() != n))
+      throw SemanticError("Error in call to " + name + ": list arguments differ in length.");
+    n = a.tailSize();
+    found = true;
+  }
+  return found;
+}
+
+// true if every argument is a Number or a packed list of Numbers
+static bool packed_numbers(const std::vector<Expression> & args){
+
+  for(auto & a : args){
+    const NumberArray * numbers = a.numbers();
+    if(numbers != nullptr){
+      if(numbers->isComplex())
+        return false;
+    }
+    else if(!a.isHeadNumber() || a.isHeadList() || (a.tailSize() != 0))
+      return false;
+  }
+  return true;
+}
+
+// apply proc to element i of each list argument, for each i below n
+static Expression broadcast(const std::vector<Expression> & args, Procedure proc, std::size_t n){
+
+  std::vector<Expression> results;
+  results.reserve(n);
+
+  std::vector<Expression> elements(args.size());
+  for(std::size_t i = 0; i < n; ++i){
+    for(std::size_t j = 0; j < args.size(); ++j)
+      elements[j] = args[j].isHeadList() ? args[j].tailAt(i) : args[j];
+    results.push_back(proc(elements));
+  }
+
+  return Expression::makeList(std::move(results));
+}
+
+// combine the argument into acc element-wise (see packed_numbers)
+static void combine(ArithOp op, std::vector<double> & acc, const Expression & arg){
+
+  if(arg.numbers() != nullptr)
+    vector_op(op, acc.data(), arg.numbers()->real().data(), acc.size());
+  else
+    vector_op(op, acc.data(), arg.head().asNumber(), acc.size());
+}
+
+// an accumulator of n elements, holding the argument's values
+static std::vector<double> seed(const Expression & arg, std::size_t n){
+
+  if(arg.numbers() != nullptr)
+    return arg.numbers()->real();
+  return std::vector<double>(n, arg.head().asNumber());
+}
+
+// a packed list holding the values of fn applied to those of arg
+template <typename Fn>
+static Expression map_numbers(const Expression & arg, std::size_t n, Fn fn){
+
+  std::vector<double> values = seed(arg, n);
+  for(auto & v : values)
+    v = fn(v);
+
+  return Expression::makeList(NumberArray(std::move(values)));
+}
+
 /***********************************************************************
 Each of the functions below have the signature that corresponds to the
 typedef'd Procedure function pointer.
@@ -29,28 +114,10 @@ Expression default_proc(const std::vector<Expression> & args){
 };
 
 
-/// Builds a list of expressions
+/// Builds a list of expressions, packed when they are all numbers
 Expression buildList(const std::vector<Expression>& args) {
 
-  if(nargs_equal(args,0)) {
-    Expression toReturn;
-    toReturn.setHeadList();
-    return toReturn;
-  }
-
-  Expression result_exp;
-  //std::vector<Expression> result;
-  for(auto & a :args)
-    result_exp.append(Expression(a));
-
-   //= Expression(result);
-  result_exp.setHeadList();
-
-  //std::cout << result_exp << '\n';
-
-  //std::cout << "Here\n";
-
-  return result_exp;
+  return Expression::makeList(std::vector<Expression>(args));
 }
 
 // Unary function for getting the first value in a list
@@ -61,19 +128,10 @@ Expression first(const std::vector<Expression>& args) {
   if(!args[0].isHeadList())
     throw SemanticError("Error in call to first: argument to first is not a list.");
 
-  if(args[0].getTail() == std::vector<Expression>())
+  if(args[0].tailSize() == 0)
     throw SemanticError("Error in call to first: empty list.");
 
-  Expression list = buildList(args);
-
-  // Stupid but it works
-  // AT least it looks prettier now
-  for( auto & a : list.getTail())
-    return a.getTail().at(0);
-
-  // So that compiler doesn't get angry, this line never actually runs
-  return Expression();
-
+  return args[0].tailAt(0);
 }
 
 // Binary function that returns the list without the first item
@@ -84,15 +142,14 @@ Expression rest(const std::vector<Expression>& args) {
   if(!args[0].isHeadList())
     throw SemanticError("Error in call to rest: argument to first is not a list or is empty.");
 
-  if(args[0].getTail() == std::vector<Expression>())
+  if(args[0].tailSize() == 0)
     throw SemanticError("Error in call to rest: empty list.");
 
-  std::vector<Expression> result;
-  for( auto & a :args[0].getTail())
-    result.push_back(a);
+  if(args[0].numbers() != nullptr)
+    return Expression::makeList(args[0].numbers()->slice(1));
 
-  result.erase(result.begin()); // Erase first item in list
-  Expression result_exp = Expression(result);
+  std::vector<Expression> result(args[0].tailConstBegin() + 1, args[0].tailConstEnd());
+  Expression result_exp = Expression(std::move(result));
   result_exp.setHeadList();
 
   return result_exp;
@@ -109,9 +166,7 @@ Expression length(const std::vector<Expression>& args) {
   if(args[0] == Expression())
     return Expression(0);
 
-  //double result;
-  //result = args[0].getTail().size();
-  return Expression(args[0].getTail().size());
+  return Expression(args[0].tailSize());
 }
 
 // Adds a second list as last node of first list
@@ -123,6 +178,19 @@ Expression append(const std::vector<Expression>& args) {
     throw SemanticError("Error in call to append: argument to first is not a list.");
   }
 
+  // a number appended to a packed (or empty) list keeps it packed
+  const NumberArray * packed = args[0].numbers();
+  if((packed != nullptr) || (args[0].tailSize() == 0)) {
+    NumberArray numbers = packed ? *packed : NumberArray();
+    if(numbers.accepts(args[1].head())) {
+      numbers.push_back(args[1].head());
+
+      Expression toReturn = Expression::makeList(std::move(numbers));
+      toReturn.property_list = args[0].property_list;
+      return toReturn;
+    }
+  }
+
   Expression toReturn;
 
   if(args[0] == Expression())
@@ -157,6 +225,21 @@ Expression join(const std::vector<Expression>& args) {
   if(!args[0].isHeadList() || !args[1].isHeadList())
     throw SemanticError("Error in call to rest: argument to first is not a list or is empty.");
 
+  // two packed (or empty) lists of the same kind join without unpacking
+  const NumberArray * left = args[0].numbers();
+  const NumberArray * right = args[1].numbers();
+  if(((left != nullptr) || (args[0].tailSize() == 0)) &&
+     ((right != nullptr) || (args[1].tailSize() == 0)) &&
+     ((left != nullptr) || (right != nullptr))) {
+
+    if(!left || !right || (left->isComplex() == right->isComplex())) {
+      NumberArray numbers = left ? *left : NumberArray();
+      if(right)
+        numbers.append(*right);
+      return Expression::makeList(std::move(numbers));
+    }
+  }
+
   Expression toReturn;
 
   if(args[0] == Expression())
@@ -183,6 +266,10 @@ Expression join(const std::vector<Expression>& args) {
 
 }
 
+// the most elements a range may have, below which element counts and
+// indices are exact in a double
+static const double MaxRange = 9007199254740992.; // 2^53
+
 // Create a range of numbers from arg1 to arg2 in increments of arg3
 Expression range(const std::vector<Expression>& args) {
 
@@ -203,20 +290,50 @@ Expression range(const std::vector<Expression>& args) {
   double end = args[1].head().asNumber();
   double inc = args[2].head().asNumber();
 
-  std::vector<Expression> toReturn;
-  for(double i = begin; i <= end; i=i+inc)
-    toReturn.push_back(Atom(i));
+  double count = std::floor((end - begin) / inc) + 1;
+  if(!(count < MaxRange))
+    throw SemanticError("Error in call to range: too many elements.");
+
+  // The elements are begin, begin + inc, begin + inc + inc, ... while they
+  // do not pass end. With whole numbers every partial sum is exact and equal
+  // to begin + i * inc, so the range is computed as it is read (see
+  // NumberArray::sequence); otherwise rounding in the running sum decides
+  // the elements, and how many there are, so they are summed and stored.
+  if(begin == std::floor(begin) && inc == std::floor(inc) &&
+     std::fabs(begin) + std::fabs(end) + inc < MaxRange){
+
+    std::size_t n = static_cast<std::size_t>(count);
+    while(begin + n * inc <= end)
+      ++n;
+    while((n > 0) && (begin + (n - 1) * inc > end))
+      --n;
+
+    return Expression::makeList(NumberArray::sequence(begin, inc, n));
+  }
 
-  Expression final_exp = Expression(toReturn);
-  final_exp.setHeadList();
+  std::vector<double> elements;
+  elements.reserve(static_cast<std::size_t>(count) + 1);
+  for(double x = begin; x <= end; x = x + inc)
+    elements.push_back(x);
 
-  return final_exp;
+  return Expression::makeList(NumberArray(std::move(elements)));
 }
 
 // Method to add arguments together. Works for both Numbers and Complex types
 // If any complex type is found in arguments, complex type is returned
 Expression add(const std::vector<Expression> & args){
 
+  std::size_t n = 0;
+  if(broadcast_length(args, "add", n)){
+    if(!packed_numbers(args))
+      return broadcast(args, add, n);
+
+    std::vector<double> acc(n, 0.0);
+    for(auto & a : args)
+      combine(AddOp, acc, a);
+    return Expression::makeList(NumberArray(std::move(acc)));
+  }
+
   // check all aruments are numbers, while adding
   double result = 0.0;
   std::complex<double> comp_result(0,0);
@@ -267,12 +384,26 @@ Expression add(const std::vector<Expression> & args){
 // If any complex type is found in arguments, complex type is returned
 Expression mul(const std::vector<Expression> & args){
 
+  std::size_t n = 0;
+  if(broadcast_length(args, "mul", n)){
+    if(!packed_numbers(args))
+      return broadcast(args, mul, n);
+
+    std::vector<double> acc(n, 1.0);
+    for(auto & a : args)
+      combine(MulOp, acc, a);
+    return Expression::makeList(NumberArray(std::move(acc)));
+  }
+
   // check all aruments are numbers, while multiplying
   double result = 1;
   std::complex<double> comp_result;
   bool isComplex = false;
   bool first_arg = true;
-  Environment env;
+
+  // the built-ins, for an argument naming a procedure; built once rather
+  // than per call, as an environment is sized by the interned symbols
+  static const Environment env;
 
   for( auto & a :args){
     if(a.isHeadComplex() || isComplex) {
@@ -316,6 +447,19 @@ Expression subneg(const std::vector<Expression> & args){
   std::complex<double> comp_result(0,0);
   bool isComplex = false;
 
+  std::size_t n = 0;
+  if((nargs_equal(args,1) || nargs_equal(args,2)) && broadcast_length(args, "subtraction", n)){
+    if(!packed_numbers(args))
+      return broadcast(args, subneg, n);
+
+    std::vector<double> acc = seed(args[0], n);
+    if(nargs_equal(args,1))
+      vector_negate(acc.data(), n);
+    else
+      combine(SubOp, acc, args[1]);
+    return Expression::makeList(NumberArray(std::move(acc)));
+  }
+
   // preconditions
   if(nargs_equal(args,1)){
     if(args[0].isHeadNumber())
@@ -352,6 +496,23 @@ Expression div(const std::vector<Expression> & args){
   double result = 0;
   std::complex<double> comp_result(0,0);
 
+  std::size_t n = 0;
+  if((nargs_equal(args,1) || nargs_equal(args,2)) && broadcast_length(args, "division", n)){
+    if(!packed_numbers(args))
+      return broadcast(args, div, n);
+
+    std::vector<double> acc;
+    if(nargs_equal(args,1)){
+      acc.assign(n, 1.0);
+      combine(DivOp, acc, args[0]);
+    }
+    else{
+      acc = seed(args[0], n);
+      combine(DivOp, acc, args[1]);
+    }
+    return Expression::makeList(NumberArray(std::move(acc)));
+  }
+
   if(nargs_equal(args,2)){
     if( (args[0].isHeadNumber()) && (args[1].isHeadNumber()) ){ //result = args[0].head().asNumber() / args[1].head().asNumber();
       return Expression( (args[0].head().asNumber() / args[1].head().asNumber()) );
@@ -381,6 +542,18 @@ Expression div(const std::vector<Expression> & args){
 // Will add Complex types soon
 Expression sqrt(const std::vector<Expression>& args) {
 
+  std::size_t n = 0;
+  if(nargs_equal(args, 1) && broadcast_length(args, "square root", n)) {
+    // negative elements have complex roots, so only non-negative lists are packed
+    if(!packed_numbers(args) || !std::all_of(args[0].numbers()->real().begin(), args[0].numbers()->real().end(),
+                                            [](double v){ return v >= 0; }))
+      return broadcast(args, sqrt, n);
+
+    std::vector<double> acc = seed(args[0], n);
+    vector_sqrt(acc.data(), n);
+    return Expression::makeList(NumberArray(std::move(acc)));
+  }
+
   if(nargs_equal(args, 1)) {
     if(args[0].isHeadNumber()){
       // Get square root of argument given
@@ -407,6 +580,22 @@ Expression sqrt(const std::vector<Expression>& args) {
 // Returns calculation of a to the power b, able to calculate for Number and Complex type
 Expression pow(const std::vector<Expression>& args) {
 
+  std::size_t n = 0;
+  if(nargs_equal(args, 2) && broadcast_length(args, "power function", n)) {
+    if(!packed_numbers(args))
+      return broadcast(args, pow, n);
+
+    std::vector<double> acc = seed(args[0], n);
+    std::vector<double> exponent = seed(args[1], n);
+    for(std::size_t i = 0; i < n; ++i) {
+      if(exponent[i] == 0)
+        acc[i] = 1.0;
+      else if(exponent[i] != 1)
+        acc[i] = std::pow(acc[i], exponent[i]);
+    }
+    return Expression::makeList(NumberArray(std::move(acc)));
+  }
+
   if(nargs_equal(args, 2)) { // Make sure its binary
     if(args[0].isHeadNumber() && args[1].isHeadNumber()) {
 
@@ -440,6 +629,16 @@ Expression pow(const std::vector<Expression>& args) {
 // Returns the calculation of the natural log of the input
 Expression nlog(const std::vector<Expression>& args) {
 
+  std::size_t n = 0;
+  if(nargs_equal(args, 1) && broadcast_length(args, "natural log function", n)) {
+    // an element that is not positive raises the scalar error
+    if(!packed_numbers(args) || !std::all_of(args[0].numbers()->real().begin(), args[0].numbers()->real().end(),
+                                            [](double v){ return v > 0; }))
+      return broadcast(args, nlog, n);
+
+    return map_numbers(args[0], n, [](double v){ return std::log(v); });
+  }
+
   if(nargs_equal(args, 1)) {
     if(args[0].head().asNumber() > 0) {
       return Expression(std::log(args[0].head().asNumber()));
@@ -455,6 +654,14 @@ Expression nlog(const std::vector<Expression>& args) {
 // Returns the calculation of the sin of the input in terms of radians
 Expression sin(const std::vector<Expression>& args) {
 
+  std::size_t n = 0;
+  if(nargs_equal(args, 1) && broadcast_length(args, "sine function", n)) {
+    if(!packed_numbers(args))
+      return broadcast(args, sin, n);
+
+    return map_numbers(args[0], n, [](double v){ return std::sin(v); });
+  }
+
   if(nargs_equal(args, 1)) {
     return Expression(std::sin(args[0].head().asNumber()));
   }
@@ -466,6 +673,14 @@ Expression sin(const std::vector<Expression>& args) {
 // Returns the calculation of the cos of the input in terms of radians
 Expression cos(const std::vector<Expression>& args) {
 
+  std::size_t n = 0;
+  if(nargs_equal(args, 1) && broadcast_length(args, "cosine function", n)) {
+    if(!packed_numbers(args))
+      return broadcast(args, cos, n);
+
+    return map_numbers(args[0], n, [](double v){ return std::cos(v); });
+  }
+
   if(nargs_equal(args, 1)) {
     return Expression(std::cos(args[0].head().asNumber()));
   }
@@ -477,6 +692,14 @@ Expression cos(const std::vector<Expression>& args) {
 // Returns the calculation of the tan of the input in terms of radians
 Expression tan(const std::vector<Expression>& args) {
 
+  std::size_t n = 0;
+  if(nargs_equal(args, 1) && broadcast_length(args, "tan function", n)) {
+    if(!packed_numbers(args))
+      return broadcast(args, tan, n);
+
+    return map_numbers(args[0], n, [](double v){ return std::tan(v); });
+  }
+
   if(nargs_equal(args, 1)) {
     if(!args[0].head().isNumber())
       throw SemanticError("Error in call to tan function: invalid argument.");
@@ -571,36 +794,110 @@ const double PI = std::atan2(0, -1);
 const double EXP = std::exp(1);
 const std::complex<double> I(0, 1);
 
-Environment::Environment(){
+Environment::Environment()
+  : envmap(builtins()), parent(nullptr), global(nullptr), bound(0) {}
+
+Environment::Environment(std::shared_ptr<Table> table)
+  : envmap(std::move(table)), parent(nullptr), global(nullptr), bound(0) {}
+
+Environment::Environment(const Environment * parent)
+  : parent(parent), global(parent->parent ? parent->global : parent),
+    bound(parent->bound) {}
 
-  reset();
+const std::shared_ptr<Environment::Table> & Environment::builtins(){
 
-  // set flag as off to start
-  envmap.emplace("interrupt_flag", EnvResult(ExpressionType, Expression(0)));
+  static const std::shared_ptr<Table> table = [](){
+    Environment env(std::make_shared<Table>());
+    env.add_builtins();
+
+    // set flag as off to start
+    env.emplace("interrupt_flag", EnvResult(ExpressionType, Expression(0)));
+    return env.envmap;
+  }();
+
+  return table;
 }
 
-bool Environment::is_known(const Atom & sym) const{
-  if(!sym.isSymbol()) return false;
+bool Environment::shares_bindings(const Environment & other) const noexcept{
+  return envmap && (envmap == other.envmap);
+}
 
-  return envmap.find(sym.asSymbol()) != envmap.end();
+// the bit of id in a frame's bound mask
+static inline std::uint64_t bound_bit(SymbolId id) noexcept {
+  return std::uint64_t(1) << (id % 64);
 }
 
-bool Environment::is_exp(const Atom & sym) const{
-  if(!sym.isSymbol()) return false;
+const Environment::EnvResult * Environment::lookup(const Atom & sym) const noexcept{
+
+  SymbolId id = sym.symbolId();
+  if(id == NoSymbolId) return nullptr;
+
+  // walk out through the call frames that may bind id, then go to the
+  // global environment; deep recursion need not visit every frame
+  const std::uint64_t bit = bound_bit(id);
+  const Environment * env = this;
+  while((env->parent != nullptr) && (env->bound & bit)){
+    for(auto & binding : env->frame){
+      if(binding.first == id) return &binding.second;
+    }
+    env = env->parent;
+  }
+  if(env->parent != nullptr){
+    env = env->global;
+  }
+
+  const EnvResult * result = env->envmap->find(id);
+  return (result == nullptr || result->type == UnboundType) ? nullptr : result;
+}
+
+void Environment::bind(SymbolId id, const EnvResult & result){
+
+  // quoted text has no id, and lookup never finds it
+  if(id == NoSymbolId) return;
 
-  auto result = envmap.find(sym.asSymbol());
-  return (result != envmap.end()) && (result->second.type == ExpressionType);
+  AllocScope allocs(EnvironmentAllocs);
+
+  if(parent != nullptr){
+    for(auto & binding : frame){
+      if(binding.first == id){
+        binding.second = result;
+        return;
+      }
+    }
+    frame.emplace_back(id, result);
+    bound |= bound_bit(id);
+    return;
+  }
+
+  // the table is shared with copies, or is the built-ins', until now
+  if(envmap.use_count() != 1){
+    envmap = std::make_shared<Table>(*envmap);
+  }
+
+  (*envmap)[id] = result;
+}
+
+void Environment::emplace(const std::string & name, const EnvResult & result){
+  bind(intern_symbol(name), result);
+}
+
+bool Environment::is_known(const Atom & sym) const{
+  return lookup(sym) != nullptr;
+}
+
+bool Environment::is_exp(const Atom & sym) const{
+  const EnvResult * result = lookup(sym);
+  return (result != nullptr) && (result->type == ExpressionType);
 }
 
 Expression Environment::get_exp(const Atom & sym) const{
 
+  AllocScope allocs(EnvironmentAllocs);
   Expression exp;
 
-  if(sym.isSymbol()){
-    auto result = envmap.find(sym.asSymbol());
-    if((result != envmap.end()) && (result->second.type == ExpressionType)){
-      exp = result->second.exp;
-    }
+  const EnvResult * result = lookup(sym);
+  if((result != nullptr) && (result->type == ExpressionType)){
+    exp = result->exp;
   }
 
   return exp;
@@ -612,126 +909,269 @@ void Environment::add_exp(const Atom & sym, const Expression & exp, bool need_re
     throw SemanticError("Attempt to add non-symbol to environment");
   }
 
-  // error if overwriting symbol map
-  if((envmap.find(sym.asSymbol()) != envmap.end()) && !need_redef){
+  // error if overwriting symbol map, unless redefining a lambda argument
+  if((lookup(sym) != nullptr) && !need_redef){
     throw SemanticError("Attempt to overwrite symbol in environemnt");
   }
 
-  // If function is a lambda and we need to redefine variable
-  if(need_redef && (envmap.find(sym.asSymbol()) != envmap.end()))
-    envmap.erase(envmap.find(sym.asSymbol()));
+  AllocScope allocs(EnvironmentAllocs);
+  EnvResult result(ExpressionType, exp);
+
+  // classify top-level lambdas once, as they are defined; lambdas bound in
+  // a call frame are arguments and stay impure
+  if((parent == nullptr) && exp.head().isLambda() && (exp.getTail().size() == 2)){
+    Inference lambda = {sym.symbolId(), &exp.getTail()[0].getTail(), 0};
+    if(pure_expression(exp.getTail()[1], &lambda)){
+      result.effect = Pure;
+      result.free = lambda.free;
+    }
+  }
 
-  envmap.emplace(sym.asSymbol(), EnvResult(ExpressionType, exp));
+  bind(sym.symbolId(), result);
 }
 
-bool Environment::is_proc(const Atom & sym) const{
-  if(!sym.isSymbol()) return false;
+bool Environment::is_global(const Atom & sym) const{
+
+  SymbolId id = sym.symbolId();
+  const std::uint64_t bit = bound_bit(id);
+
+  // as lookup, but only the frames are searched
+  for(const Environment * env = this; (env->parent != nullptr) && (env->bound & bit); env = env->parent){
+    for(auto & binding : env->frame){
+      if(binding.first == id) return false;
+    }
+  }
 
-  auto result = envmap.find(sym.asSymbol());
-  return (result != envmap.end()) && (result->second.type == ProcedureType);
+  return true;
+}
+
+bool Environment::is_proc(const Atom & sym) const{
+  const EnvResult * result = lookup(sym);
+  return (result != nullptr) && (result->type == ProcedureType);
 }
 
 Procedure Environment::get_proc(const Atom & sym) const{
 
-  //Procedure proc = default_proc;
+  const EnvResult * result = lookup(sym);
+  if((result != nullptr) && (result->type == ProcedureType)){
+    return result->proc;
+  }
+
+  return default_proc;
+}
+
+bool Environment::is_pure(const Atom & sym) const{
+
+  const EnvResult * result = lookup(sym);
+  if((result == nullptr) || (result->effect != Pure)){
+    return false;
+  }
+
+  // a frame binding a symbol the lambda reads or calls changes its meaning
+  return (result->type == ProcedureType) || ((bound & result->free) == 0);
+}
+
+bool Environment::is_pure(const Expression & exp) const{
+  return pure_expression(exp, nullptr);
+}
+
+// the argument list of a lambda binds sym
+static bool is_param(const Atom & sym, const std::vector<Expression> & params) noexcept{
+  for(auto & p : params){
+    if(p.head().symbolId() == sym.symbolId()) return true;
+  }
+  return false;
+}
+
+bool Environment::pure_expression(const Expression & exp, Inference * lambda) const{
+
+  const std::vector<Expression> & tail = exp.getTail();
 
-  if(sym.isSymbol()){
-    auto result = envmap.find(sym.asSymbol());
-    if((result != envmap.end()) && (result->second.type == ProcedureType)){
-      return result->second.proc;
+  if(tail.empty()){
+    // reading a symbol has no effect, but it is free in a lambda body
+    const Atom & a = exp.head();
+    if((lambda != nullptr) && a.isSymbol() && !a.isString() && !is_param(a, *lambda->params)){
+      lambda->free |= bound_bit(a.symbolId());
     }
+    return true;
   }
 
-  return default_proc;
+  switch(exp.form()){
+  case Expression::DefineForm:
+  case Expression::LambdaForm:
+  case Expression::DiscretePlotForm:
+  case Expression::ContinuousPlotForm:
+    return false;
+  case Expression::ConstantForm:
+    // the original is evaluated instead wherever the fold does not hold
+    return pure_expression(tail[1], lambda);
+  case Expression::BeginForm:
+  case Expression::SetPropertyForm:
+  case Expression::GetPropertyForm:
+    break;
+  case Expression::ApplyForm:
+  case Expression::MapForm:
+  case Expression::PMapForm:
+    if((tail.size() != 2) || !pure_callee(tail[0].head(), lambda))
+      return false;
+    return pure_expression(tail[1], lambda);
+  default:
+    if(!pure_callee(exp.head(), lambda))
+      return false;
+    break;
+  }
+
+  for(auto & e : tail){
+    if(!pure_expression(e, lambda)) return false;
+  }
+  return true;
+}
+
+bool Environment::pure_callee(const Atom & op, Inference * lambda) const{
+
+  if(!op.isSymbol() || op.isString()){
+    return false;
+  }
+
+  if(lambda == nullptr){
+    return is_pure(op);
+  }
+
+  // an argument may be bound to anything
+  if(is_param(op, *lambda->params)){
+    return false;
+  }
+
+  lambda->free |= bound_bit(op.symbolId());
+  if(op.symbolId() == lambda->self){
+    return true;
+  }
+
+  const EnvResult * result = lookup(op);
+  if((result == nullptr) || (result->effect != Pure)){
+    return false;
+  }
+
+  // the callee's own free symbols must not be rebound by frames either
+  lambda->free |= result->free;
+  return true;
+}
+
+bool Environment::recall(const Atom & sym, const std::vector<Expression> & args, Expression & result) const{
+  const Environment & top = (parent == nullptr) ? *this : *global;
+  return top.calls.find(sym, args, result);
+}
+
+void Environment::remember(const Atom & sym, const std::vector<Expression> & args, const Expression & result) const{
+  const Environment & top = (parent == nullptr) ? *this : *global;
+  AllocScope allocs(EnvironmentAllocs);
+  top.calls.insert(sym, args, result);
 }
 
 /*
-Reset the environment to the default state. First remove all entries and
-then re-add the default ones.
+Reset the environment to the default state, sharing the built-ins' table
+again.
  */
 void Environment::reset(){
 
-  envmap.clear();
+  frame.clear();
+  calls.clear();
+
+  // a call frame starts empty, only the global environment has built-ins
+  if(parent != nullptr){
+    bound = parent->bound;
+    return;
+  }
+
+  envmap = builtins();
+}
+
+/*
+Add the built-in values and procedures, once per process (see builtins).
+ */
+void Environment::add_builtins(){
+
+  AllocScope allocs(EnvironmentAllocs);
 
   // Built-In value of pi
-  envmap.emplace("pi", EnvResult(ExpressionType, Expression(PI)));
+  emplace("pi", EnvResult(ExpressionType, Expression(PI)));
 
   // Built-In value of e
-  envmap.emplace("e", EnvResult(ExpressionType, Expression(EXP)));
+  emplace("e", EnvResult(ExpressionType, Expression(EXP)));
 
   // Built-In value of i
-  envmap.emplace("I", EnvResult(ExpressionType, Expression(I)));
+  emplace("I", EnvResult(ExpressionType, Expression(I)));
 
   // Procedure: add;
-  envmap.emplace("+", EnvResult(ProcedureType, add));
+  emplace("+", EnvResult(ProcedureType, add, Pure));
 
   // Procedure: subneg;
-  envmap.emplace("-", EnvResult(ProcedureType, subneg));
+  emplace("-", EnvResult(ProcedureType, subneg, Pure));
 
   // Procedure: mul;
-  envmap.emplace("*", EnvResult(ProcedureType, mul));
+  emplace("*", EnvResult(ProcedureType, mul, Pure));
 
   // Procedure: div;
-  envmap.emplace("/", EnvResult(ProcedureType, div));
+  emplace("/", EnvResult(ProcedureType, div, Pure));
 
   // Procedure: sqrt
-  envmap.emplace("sqrt", EnvResult(ProcedureType, sqrt));
+  emplace("sqrt", EnvResult(ProcedureType, sqrt, Pure));
 
   // Procedure: pow
-  envmap.emplace("^", EnvResult(ProcedureType, pow));
+  emplace("^", EnvResult(ProcedureType, pow, Pure));
 
   // Procedure: nlog
-  envmap.emplace("ln", EnvResult(ProcedureType, nlog));
+  emplace("ln", EnvResult(ProcedureType, nlog, Pure));
 
   //Procedure: sin
-  envmap.emplace("sin", EnvResult(ProcedureType, sin));
+  emplace("sin", EnvResult(ProcedureType, sin, Pure));
 
   // Procedure: cos
-  envmap.emplace("cos", EnvResult(ProcedureType, cos));
+  emplace("cos", EnvResult(ProcedureType, cos, Pure));
 
   //Procedure: tan
-  envmap.emplace("tan", EnvResult(ProcedureType, tan));
+  emplace("tan", EnvResult(ProcedureType, tan, Pure));
 
   // Procedure: real
-  envmap.emplace("real", EnvResult(ProcedureType, real));
+  emplace("real", EnvResult(ProcedureType, real, Pure));
 
   // Procedure: imag
-  envmap.emplace("imag", EnvResult(ProcedureType, imag));
+  emplace("imag", EnvResult(ProcedureType, imag, Pure));
 
   // Procedure: mag
-  envmap.emplace("mag", EnvResult(ProcedureType, mag));
+  emplace("mag", EnvResult(ProcedureType, mag, Pure));
 
   // Procedure: arg
-  envmap.emplace("arg", EnvResult(ProcedureType, arg));
+  emplace("arg", EnvResult(ProcedureType, arg, Pure));
 
   // Procedure: conj
-  envmap.emplace("conj", EnvResult(ProcedureType, conj));
+  emplace("conj", EnvResult(ProcedureType, conj, Pure));
 
   // Procedure: list
-  envmap.emplace("list", EnvResult(ProcedureType, buildList));
+  emplace("list", EnvResult(ProcedureType, buildList, Pure));
 
   // Procedure: first
-  envmap.emplace("first", EnvResult(ProcedureType, first));
+  emplace("first", EnvResult(ProcedureType, first, Pure));
 
   // Procedure: rest
-  envmap.emplace("rest", EnvResult(ProcedureType, rest));
+  emplace("rest", EnvResult(ProcedureType, rest, Pure));
 
   // Procedure: length
-  envmap.emplace("length", EnvResult(ProcedureType, length));
+  emplace("length", EnvResult(ProcedureType, length, Pure));
 
   // Procedure: append
-  envmap.emplace("append", EnvResult(ProcedureType, append));
+  emplace("append", EnvResult(ProcedureType, append, Pure));
 
   // Procedure: join
-  envmap.emplace("join", EnvResult(ProcedureType, join));
+  emplace("join", EnvResult(ProcedureType, join, Pure));
 
   // Procedure: range
-  envmap.emplace("range", EnvResult(ProcedureType, range));
+  emplace("range", EnvResult(ProcedureType, range, Pure));
 
   // Procedure: set-property
-  //envmap.emplace("set-property", EnvResult(ProcedureType, set_property));
+  //emplace("set-property", EnvResult(ProcedureType, set_property, Pure));
 
   // Procedure: get-property
-  //envmap.emplace("get-property", EnvResult(ProcedureType, get_property));
+  //emplace("get-property", EnvResult(ProcedureType, get_property, Pure));
 
 }
@@ -11,7 +11,9 @@ needed.
 #define ENVIRONMENT_HPP
 
 // system includes
+#include <cstdint>
 #include <map>
+#include <memory>
 #include <iostream>
 
 // For complex type
@@ -20,7 +22,9 @@ using namespace std;
 
 // module includes
 #include "atom.hpp"
+#include "call_cache.hpp"
 #include "expression.hpp"
+#include "symbol_map.hpp"
 
 /*! \typedef Procedure
 \brief A Procedure is a C++ function pointer taking a vector of
@@ -41,14 +45,35 @@ return you can obtain
 the mapped-to value using get_exp or get_proc.
 
 To add an symbol to expression mapping use the add_exp member function.
+
+An Environment is either the global environment, holding the built-ins and
+top-level definitions, or a call frame created for a lambda invocation. A
+frame holds only the symbols bound while it is active (the arguments and
+any definitions made in the body) and resolves everything else through its
+parent, so entering a lambda costs O(arity) rather than a copy of the
+global environment.
+
+The bindings of a global environment are shared, copy-on-write, by its
+copies: copying one, or resetting one to the built-ins, which are made once
+per process, takes constant time, and the first binding made afterwards
+copies the table.
+
+Every procedure and top-level lambda is classified as pure or impure (see
+is_pure). Calls to pure lambdas may be remembered with remember and looked
+up again with recall; the table belongs to the global environment and is
+emptied by reset.
  */
 class Environment {
 public:
   /*! Construct the default environment with built-in procedures and
-   * definitions. */
+   * definitions, sharing the built-ins' table. */
   Environment();
 
-  //Environment(const Environment & env);
+  /*! Construct an empty call frame chained to parent. Lookups that miss in
+    the frame continue in parent, which must outlive the frame.
+    \param parent the environment the frame is entered from
+   */
+  explicit Environment(const Environment * parent);
 
   /*! Determine if a symbol is known to the environment.
     \param sym the sumbol to lookup
@@ -87,6 +112,13 @@ public:
   };*/
 
 
+  /*! Determine if a symbol resolves to its binding in the global
+    environment, that is no enclosing call frame binds it.
+    \param sym the symbol to lookup
+    \return true if sym means here what it means at top level
+   */
+  bool is_global(const Atom &sym) const;
+
   /*! Determine if a symbol has been defined as a procedure
     \param sym the symbol to lookup
     \return true if thr symbol maps to a procedure
@@ -102,27 +134,123 @@ public:
   */
   Procedure get_proc(const Atom &sym) const;
 
-  /*! Reset the environment to its default state. */
+  /*! Determine if a symbol names a pure procedure or lambda, one whose
+    result depends only on its arguments and the symbols it reads, and
+    whose call changes no bindings.
+
+    Built-in procedures are classified where they are added. A top-level
+    lambda is classified when it is defined: it is pure if its body has no
+    define, lambda or plot form and calls only pure procedures, pure
+    lambdas defined before it, and itself. Since scoping is dynamic, a pure
+    lambda is only treated as pure where no enclosing call frame binds a
+    symbol it reads or calls.
+    \param sym the symbol to lookup
+    \return true if calling sym here can be memoized or reordered
+   */
+  bool is_pure(const Atom &sym) const;
+
+  /*! Determine if evaluating an expression here has no effect other than
+    producing its value, so it can be evaluated in any order with others.
+    \param exp the expression to classify
+    \return true if exp defines nothing and calls only pure procedures
+   */
+  bool is_pure(const Expression &exp) const;
+
+  /*! Look up the remembered result of a call to a pure lambda.
+    \param sym the symbol naming the lambda, which must satisfy is_pure
+    \param args the arguments of the call
+    \param result set to the result when found
+    \return true if the call was remembered
+   */
+  bool recall(const Atom &sym, const std::vector<Expression> &args, Expression &result) const;
+
+  /// Remember the result of a call to a pure lambda (see recall)
+  void remember(const Atom &sym, const std::vector<Expression> &args, const Expression &result) const;
+
+  /*! Reset the environment to its default state. A call frame is reset to
+    an empty frame. */
   void reset();
 
+  /// True if the two share one table of global bindings, as a copy does until either binds a symbol
+  bool shares_bindings(const Environment & other) const noexcept;
+
 private:
 
   // Environment is a mapping from symbols to expressions or procedures
-  enum EnvResultType { ExpressionType, ProcedureType };
+  enum EnvResultType { UnboundType, ExpressionType, ProcedureType };
+
+  // whether calling a procedure or lambda can have effects beyond its result
+  enum Effect { Impure, Pure };
 
   struct EnvResult {
     EnvResultType type;
     Expression exp; // used when type is ExpressionType
     Procedure proc; // used when type is ProcedureType
+    Effect effect;  // Pure for pure procedures and top-level lambdas
+    std::uint64_t free; // bound bits of the symbols a pure lambda reads or calls
 
     // constructors for use in container emplace
-    EnvResult(){};
-    EnvResult(EnvResultType t, Expression e) : type(t), exp(e){};
-    EnvResult(EnvResultType t, Procedure p) : type(t), proc(p){};
+    EnvResult() : type(UnboundType), proc(nullptr), effect(Impure), free(0) {};
+    EnvResult(EnvResultType t, Expression e) : type(t), exp(e), proc(nullptr), effect(Impure), free(0) {};
+    EnvResult(EnvResultType t, Procedure p, Effect f) : type(t), proc(p), effect(f), free(0) {};
+  };
+
+  // a lambda under classification
+  struct Inference {
+    SymbolId self; // the symbol it is being defined as
+    const std::vector<Expression> * params;
+    std::uint64_t free;
   };
 
-  // the environment map
-  std::map<std::string, EnvResult> envmap;
+  // true if exp can have no effect but its value. With a lambda under
+  // classification callees resolve to top-level bindings and the symbols
+  // the body reads or calls are collected, otherwise callees resolve here.
+  bool pure_expression(const Expression & exp, Inference * lambda) const;
+
+  // true if calling op from the expression is pure, see pure_expression
+  bool pure_callee(const Atom & op, Inference * lambda) const;
+
+  // return the entry bound to sym, or nullptr if sym is not a bound symbol
+  const EnvResult * lookup(const Atom & sym) const noexcept;
+
+  // bind the named symbol, used when building the default environment
+  void emplace(const std::string & name, const EnvResult & result);
+
+  // the bindings of the global environment, see envmap
+  typedef SymbolMap<EnvResult> Table;
+
+  // the built-ins, made on first use; never bound to again
+  static const std::shared_ptr<Table> & builtins();
+
+  // a global environment over table, for making the built-ins
+  explicit Environment(std::shared_ptr<Table> table);
+
+  // bind the built-in procedures and values
+  void add_builtins();
+
+  // bind sym in this environment (not a parent), replacing any binding
+  void bind(SymbolId id, const EnvResult & result);
+
+  // the environment map of the global environment, keyed by interned
+  // SymbolId and sized by its own bindings (see SymbolMap); shared with
+  // copies and the built-ins until bind copies it. Null in a call frame.
+  std::shared_ptr<Table> envmap;
+
+  // the enclosing environment of a call frame, nullptr when global
+  const Environment * parent;
+
+  // the global environment at the end of a call frame's chain
+  const Environment * global;
+
+  // one bit per symbol id (modulo 64) bound in this frame or any enclosing
+  // frame; a clear bit lets a lookup skip straight to the global environment
+  std::uint64_t bound;
+
+  // the bindings of a call frame, few enough that a linear scan is fastest
+  std::vector<std::pair<SymbolId, EnvResult> > frame;
+
+  // the remembered calls to pure lambdas, used in the global environment
+  mutable CallCache calls;
 };
 
 #endif
@@ -1,10 +1,14 @@
 #include "catch.hpp"
 
 #include "environment.hpp"
+#include "parse.hpp"
 #include "semantic_error.hpp"
+#include "symbol_map.hpp"
+#include "token.hpp"
 
 
 #include <cmath>
+#include <sstream>
 #include <string>
 
 TEST_CASE( "Test default constructor", "[environment]" ) {
@@ -318,3 +322,182 @@ TEST_CASE("Testing lists and list functions", "[environment]") {
   //REQUIRE(plist(args) == test_list);
 
 }
+
+TEST_CASE( "Test call frames", "[environment]" ) {
+
+  Environment env;
+  env.add_exp(Atom("global"), Expression(1.0));
+
+  Environment frame(&env);
+  frame.add_exp(Atom("x"), Expression(2.0), true);
+
+  // the frame sees its own bindings and everything in its parent
+  REQUIRE(frame.is_exp(Atom("x")));
+  REQUIRE(frame.get_exp(Atom("x")) == Expression(2.0));
+  REQUIRE(frame.is_exp(Atom("global")));
+  REQUIRE(frame.is_exp(Atom("pi")));
+  REQUIRE(frame.is_proc(Atom("+")));
+
+  // but the parent does not see the frame
+  REQUIRE(!env.is_known(Atom("x")));
+
+  // arguments may shadow, definitions may not overwrite
+  frame.add_exp(Atom("global"), Expression(3.0), true);
+  REQUIRE(frame.get_exp(Atom("global")) == Expression(3.0));
+  REQUIRE(env.get_exp(Atom("global")) == Expression(1.0));
+  REQUIRE_THROWS_AS(frame.add_exp(Atom("pi"), Expression(3.0)), SemanticError);
+
+  // nested frames resolve through the whole chain
+  Environment inner(&frame);
+  REQUIRE(inner.get_exp(Atom("x")) == Expression(2.0));
+  REQUIRE(inner.get_exp(Atom("global")) == Expression(3.0));
+
+  frame.reset();
+  REQUIRE(!frame.is_known(Atom("x")));
+  REQUIRE(frame.is_known(Atom("pi")));
+}
+
+static Expression parsed(const std::string & program){
+  std::istringstream iss(program);
+  return parse(tokenize(iss));
+}
+
+TEST_CASE( "Test purity classification", "[environment]" ) {
+
+  Environment env;
+
+  // built-ins are classified where they are added
+  REQUIRE(env.is_pure(Atom("+")));
+  REQUIRE(env.is_pure(Atom("range")));
+  REQUIRE(!env.is_pure(Atom("pi")));
+  REQUIRE(!env.is_pure(Atom("nothing")));
+
+  for(auto program : {"(define sq (lambda (x) (* x x)))",
+                      "(define y 2)",
+                      "(define f (lambda (x) (+ (sq x) y)))",
+                      "(define g (lambda (x) (begin (define z x) z)))",
+                      "(define h (lambda (x) (g x)))",
+                      "(define call (lambda (p x) (p x)))",
+                      "(define each (lambda (x) (map sq (range 0 x 1))))",
+                      "(define later (lambda (x) (undefined x)))",
+                      "(define make (lambda (x) (lambda (y) x)))",
+                      "(define self (lambda (x) (self x)))"}){
+    parsed(program).eval(env);
+  }
+
+  // lambdas are inferred from their bodies
+  REQUIRE(env.is_pure(Atom("sq")));
+  REQUIRE(env.is_pure(Atom("f")));
+  REQUIRE(env.is_pure(Atom("each")));
+  REQUIRE(env.is_pure(Atom("self")));
+  REQUIRE(!env.is_pure(Atom("g")));
+  REQUIRE(!env.is_pure(Atom("h")));
+  REQUIRE(!env.is_pure(Atom("call")));
+  REQUIRE(!env.is_pure(Atom("later")));
+  REQUIRE(!env.is_pure(Atom("make")));
+
+  // a frame binding a symbol f reads or calls changes its meaning
+  Environment frame(&env);
+  frame.add_exp(Atom("x"), Expression(1.0), true);
+  REQUIRE(frame.is_pure(Atom("f")));
+  frame.add_exp(Atom("y"), Expression(1.0), true);
+  REQUIRE(!frame.is_pure(Atom("f")));
+  REQUIRE(frame.is_pure(Atom("sq")));
+
+  // expressions are pure when they define nothing and call pure callees
+  REQUIRE(env.is_pure(parsed("(+ (f 1) (sq y) 2)")));
+  REQUIRE(env.is_pure(parsed("(map f (list 1 2))")));
+  REQUIRE(!env.is_pure(parsed("(+ (g 1) 2)")));
+  REQUIRE(!env.is_pure(parsed("(begin (define w 1) w)")));
+}
+
+TEST_CASE( "Test remembered calls", "[environment]" ) {
+
+  Environment env;
+  std::vector<Expression> args = {Expression(2.0)};
+
+  Expression result;
+  REQUIRE(!env.recall(Atom("sq"), args, result));
+
+  // frames share the global environment's table
+  Environment frame(&env);
+  frame.remember(Atom("sq"), args, Expression(4.0));
+  REQUIRE(env.recall(Atom("sq"), args, result));
+  REQUIRE(result == Expression(4.0));
+
+  env.reset();
+  REQUIRE(!env.recall(Atom("sq"), args, result));
+}
+
+TEST_CASE( "Test copies share bindings until they define", "[environment]" ) {
+
+  Environment env, other;
+  REQUIRE(env.shares_bindings(other));
+
+  Environment copy(env);
+  REQUIRE(copy.shares_bindings(env));
+  REQUIRE(copy.get_exp(Atom("pi")) == Expression(std::atan2(0, -1)));
+
+  // a definition in the copy is not seen by the original
+  copy.add_exp(Atom("x"), Expression(1.0));
+  REQUIRE(!copy.shares_bindings(env));
+  REQUIRE(copy.is_exp(Atom("x")));
+  REQUIRE(!env.is_exp(Atom("x")));
+  REQUIRE(env.shares_bindings(other));
+
+  // nor one in the original by the copy
+  env.add_exp(Atom("y"), Expression(2.0));
+  REQUIRE(!copy.is_exp(Atom("y")));
+
+  // reset shares the built-ins again
+  copy.reset();
+  REQUIRE(copy.shares_bindings(other));
+  REQUIRE(!copy.is_exp(Atom("x")));
+}
+
+TEST_CASE( "Test symbol maps hold sparse ids", "[environment]" ) {
+
+  SymbolMap<int> map;
+  REQUIRE(map.size() == 0);
+  REQUIRE(map.find(0) == nullptr);
+
+  // enough to grow the index several times, with ids far apart
+  for(SymbolId id = 0; id < 1000; ++id){
+    map[id * 7919 + 3] = static_cast<int>(id);
+  }
+  REQUIRE(map.size() == 1000);
+  for(SymbolId id = 0; id < 1000; ++id){
+    const int * value = map.find(id * 7919 + 3);
+    REQUIRE(value != nullptr);
+    REQUIRE(*value == static_cast<int>(id));
+  }
+  REQUIRE(map.find(4) == nullptr);
+
+  // assigning replaces
+  map[3] = -1;
+  REQUIRE(map.size() == 1000);
+  REQUIRE(*map.find(3) == -1);
+
+  // a copy is independent
+  SymbolMap<int> copy(map);
+  copy[5] = 5;
+  REQUIRE(copy.size() == 1001);
+  REQUIRE(map.find(5) == nullptr);
+}
+
+TEST_CASE( "Test binding a symbol interned after many others", "[environment]" ) {
+
+  Environment env;
+
+  // symbols interned but never bound
+  for(int i = 0; i < 5000; ++i){
+    Atom("unbound-symbol-" + std::to_string(i));
+  }
+  Atom late("late-symbol");
+  REQUIRE(late.symbolId() >= 5000);
+
+  env.add_exp(late, Expression(1.0));
+  REQUIRE(env.get_exp(late) == Expression(1.0));
+  REQUIRE(!env.is_known(Atom("\"unbound label 7\"")));
+  REQUIRE(!env.is_known(Atom("unbound-symbol-7")));
+}
@@ -0,0 +1,89 @@
+#include "eval_context.hpp"
+
+#include "profiler.hpp"
+#include "semantic_error.hpp"
+
+const std::size_t EvalContext::DefaultMaxDepth;
+const std::size_t EvalContext::MaxNativeDepth;
+const unsigned EvalContext::DeadlinePollInterval;
+
+EvalContext & EvalContext::current() noexcept{
+  static thread_local EvalContext context;
+  return context;
+}
+
+std::size_t EvalContext::maxDepth() const noexcept{
+  return max_depth;
+}
+
+void EvalContext::setMaxDepth(std::size_t limit) noexcept{
+  max_depth = limit;
+}
+
+std::size_t EvalContext::depth() const noexcept{
+  return frames;
+}
+
+std::size_t EvalContext::nativeDepth() const noexcept{
+  return native;
+}
+
+void EvalContext::enter(){
+  if(frames >= max_depth){
+    throw SemanticError("Error during evaluation: maximum evaluation depth exceeded");
+  }
+  ++frames;
+}
+
+void EvalContext::leave() noexcept{
+  --frames;
+}
+
+Profiler * EvalContext::profiler() const noexcept{
+  return active_profiler;
+}
+
+void EvalContext::setProfiler(Profiler * profiler) noexcept{
+  active_profiler = profiler;
+}
+
+CancelToken * EvalContext::cancelToken() const noexcept{
+  return active_token;
+}
+
+void EvalContext::setCancelToken(CancelToken * token) noexcept{
+  active_token = token;
+  polls = DeadlinePollInterval;
+}
+
+void EvalContext::poll_token(){
+  polls = DeadlinePollInterval;
+  active_token->check();
+}
+
+EvalContext::NativeScope::NativeScope()
+  : context(EvalContext::current()), saved_depth(context.frames),
+    saved_profile_depth(context.active_profiler ? context.active_profiler->depth() : 0) {
+
+  if(context.native >= MaxNativeDepth){
+    throw SemanticError("Error during evaluation: maximum evaluation depth exceeded");
+  }
+  context.enter();
+  ++context.native;
+}
+
+EvalContext::NativeScope::~NativeScope(){
+  --context.native;
+  context.frames = saved_depth;
+  if(context.active_profiler)
+    context.active_profiler->unwind(saved_profile_depth);
+}
+
+EvalContext::DepthLimitScope::DepthLimitScope(std::size_t limit) noexcept
+  : context(EvalContext::current()), saved(context.max_depth) {
+  context.max_depth = limit;
+}
+
+EvalContext::DepthLimitScope::~DepthLimitScope(){
+  context.max_depth = saved;
+}
@@ -0,0 +1,130 @@
+/*! \file eval_context.hpp
+Defines the EvalContext, the per-thread state shared by the evaluators.
+ */
+#ifndef EVAL_CONTEXT_HPP
+#define EVAL_CONTEXT_HPP
+
+#include <cstddef>
+
+#include "cancel_token.hpp"
+
+class Profiler;
+
+/*! \class EvalContext
+\brief Tracks how deep evaluation has gone on the current thread.
+
+The tree-walking Evaluator keeps its frames on an explicit stack, so its
+depth is limited only by maxDepth. Re-entering an evaluator from C++ (a
+plot form evaluating its data, a bytecode lambda call) does use the native
+stack; those re-entries are additionally limited to MaxNativeDepth. Either
+limit raises a SemanticError rather than overflowing.
+
+The context also holds the CancelToken the thread's evaluations poll.
+ */
+class EvalContext {
+public:
+
+  /// Default limit on the number of active evaluation frames
+  static const std::size_t DefaultMaxDepth = 100000;
+
+  /// Limit on nested native re-entries into an evaluator
+  static const std::size_t MaxNativeDepth = 2000;
+
+  /// Number of polls between readings of the clock for a deadline
+  static const unsigned DeadlinePollInterval = 256;
+
+  /// The context of the calling thread
+  static EvalContext & current() noexcept;
+
+  /// Get the limit on the number of active evaluation frames
+  std::size_t maxDepth() const noexcept;
+
+  /// Set the limit on the number of active evaluation frames
+  void setMaxDepth(std::size_t limit) noexcept;
+
+  /// Get the number of active evaluation frames
+  std::size_t depth() const noexcept;
+
+  /// Get the number of native re-entries into an evaluator (see NativeScope)
+  std::size_t nativeDepth() const noexcept;
+
+  /// Count a new evaluation frame, throws SemanticError past the limit
+  void enter();
+
+  /// Release an evaluation frame
+  void leave() noexcept;
+
+  /// The profiler timing evaluation on this thread, null when none is
+  Profiler * profiler() const noexcept;
+
+  /// Install a profiler on this thread (see Profiler::Scope), or null
+  void setProfiler(Profiler * profiler) noexcept;
+
+  /// The token this thread's evaluations poll, null when there is none
+  CancelToken * cancelToken() const noexcept;
+
+  /// Poll token on this thread (see CancelToken::Scope), or none
+  void setCancelToken(CancelToken * token) noexcept;
+
+  /*! Throw SemanticError if this thread's token is cancelled, or (checked
+    every DeadlinePollInterval polls) past its deadline
+   */
+  void poll(){
+    if(active_token && (active_token->cancelled() || --polls == 0))
+      poll_token();
+  }
+
+  /*! \class NativeScope
+  \brief Marks a native re-entry into an evaluator, counting one frame.
+
+  The destructor restores the depth, and the profiler's open calls, to
+  their values on construction, so frames abandoned by an exception are
+  released too.
+   */
+  class NativeScope {
+  public:
+    /// throws SemanticError when nesting is too deep
+    NativeScope();
+
+    ~NativeScope();
+
+    NativeScope(const NativeScope &) = delete;
+    NativeScope & operator=(const NativeScope &) = delete;
+
+  private:
+    EvalContext & context;
+    std::size_t saved_depth;
+    std::size_t saved_profile_depth;
+  };
+
+  /*! \class DepthLimitScope
+  \brief Sets the calling thread's limit on evaluation frames while in
+  scope, restoring the previous limit after.
+   */
+  class DepthLimitScope {
+  public:
+    explicit DepthLimitScope(std::size_t limit) noexcept;
+    ~DepthLimitScope();
+
+    DepthLimitScope(const DepthLimitScope &) = delete;
+    DepthLimitScope & operator=(const DepthLimitScope &) = delete;
+
+  private:
+    EvalContext & context;
+    std::size_t saved;
+  };
+
+private:
+
+  // poll's slow path: check the token and restart the countdown
+  void poll_token();
+
+  std::size_t frames = 0;
+  std::size_t native = 0;
+  std::size_t max_depth = DefaultMaxDepth;
+  Profiler * active_profiler = nullptr;
+  CancelToken * active_token = nullptr;
+  unsigned polls = DeadlinePollInterval;
+};
+
+#endif
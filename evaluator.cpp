@@ -0,0 +1,722 @@
+#include "evaluator.hpp"
+
+// system includes
+#include <functional>
+
+// module includes
+#include "alloc_stats.hpp"
+#include "eval_context.hpp"
+#include "optimize.hpp"
+#include "semantic_error.hpp"
+#include "thread_pool.hpp"
+
+/***********************************************************************
+Every advance_* method runs with a reference to the top frame. Pushing a
+frame may move the frame stack, so a method that calls descend or invoke
+records its next stage first and returns as soon as either reports that a
+frame was pushed; it is resumed with the operand's value later.
+**********************************************************************/
+
+Evaluator::Evaluator(Environment & env)
+  : root(env), context(EvalContext::current()), profiler(context.profiler()) {}
+
+Expression Evaluator::run(const Expression & exp){
+
+  EvalContext::NativeScope scope;
+  AllocScope allocs(EvalAllocs);
+
+  Expression value;
+  if(descend(exp, root, value)){
+    return value;
+  }
+
+  while(!frames.empty()){
+    advance(value);
+  }
+
+  return value;
+}
+
+Expression Evaluator::apply(const Atom & op, const std::vector<Expression> & args){
+
+  EvalContext::NativeScope scope;
+
+  Expression value;
+  if(invoke(op, args, root, value)){
+    return value;
+  }
+
+  while(!frames.empty()){
+    advance(value);
+  }
+
+  return value;
+}
+
+void Evaluator::push(Task task, const Expression & exp, Environment & env){
+  context.enter();
+  frames.emplace_back(task, &exp, &env);
+}
+
+void Evaluator::profile(const std::string & name){
+  if(profiler){
+    profiler->enter(name);
+    frames.back().profiled = true;
+  }
+}
+
+void Evaluator::complete(Expression && result, Expression & value){
+  Expression r(std::move(result));
+  if(frames.back().profiled)
+    profiler->leave();
+  frames.pop_back();
+  context.leave();
+  value = std::move(r);
+}
+
+bool Evaluator::descend(const Expression & exp, Environment & env, Expression & value){
+
+  context.poll();
+
+  if(exp.m_tail.empty()) {
+    value = exp.handle_lookup(exp.m_head, env);
+    return true;
+  }
+
+  // dispatch on the special-form kind of the head
+  switch(exp.form()){
+  case Expression::BeginForm:
+    push(BeginTask, exp, env);
+    profile(exp.head().asSymbol());
+    return false;
+  case Expression::DefineForm:
+    push(DefineTask, exp, env);
+    profile(exp.head().asSymbol());
+    return false;
+  case Expression::ApplyForm:
+    push(ApplyTask, exp, env);
+    profile(exp.head().asSymbol());
+    return false;
+  case Expression::MapForm:
+  case Expression::PMapForm:
+    push(MapTask, exp, env);
+    profile(exp.head().asSymbol());
+    return false;
+  case Expression::SetPropertyForm:
+    push(SetPropertyTask, exp, env);
+    profile(exp.head().asSymbol());
+    return false;
+  case Expression::GetPropertyForm:
+    push(GetPropertyTask, exp, env);
+    profile(exp.head().asSymbol());
+    return false;
+  case Expression::LambdaForm:
+    value = exp.handle_lambda(env);
+    return true;
+  case Expression::ConstantForm:
+    if(fold_holds(exp, env)){
+      value = exp.getTail()[0];
+      return true;
+    }
+    return descend(exp.getTail()[1], env, value);
+  case Expression::DiscretePlotForm:
+    {
+      Profiler::Call timed(profiler, exp.head().asSymbol());
+      value = exp.handle_discrete_plot(env);
+    }
+    return true;
+  case Expression::ContinuousPlotForm:
+    {
+      Profiler::Call timed(profiler, exp.head().asSymbol());
+      value = exp.handle_continuous_plot(env);
+    }
+    return true;
+  default:
+    push(CallTask, exp, env);
+    return false;
+  }
+}
+
+bool Evaluator::invoke(const Atom & op, const std::vector<Expression> & args,
+                       Environment & env, Expression & value){
+
+  if(!(op.isSymbol() || op.isString()) && !op.isLambda()) {
+    throw SemanticError("Error during evaluation: procedure name not symbol or lambda.");
+  }
+
+  // must map to a proc or exp
+  if(!env.is_proc(op) && !env.is_exp(op)){
+    throw SemanticError("Error during evaluation: symbol does not name a procedure or lambda.");
+  }
+
+  if(env.is_exp(op)) {
+
+    Expression lambda = env.get_exp(op);
+    const std::vector<Expression> & lambda_tail = lambda.getTail();
+
+    if(lambda_tail.size() != 2)
+      throw SemanticError("Error during evaluation: symbol does not name a procedure or lambda.");
+
+    const std::vector<Expression> & lambda_list = lambda_tail[0].getTail();
+
+    if(lambda_list.size() != args.size())
+      throw SemanticError("Error in call to lambda function: invalid number of arguments.");
+
+    // a pure call is remembered under its arguments, copied now since args
+    // may live in a frame that push moves
+    const bool pure = env.is_pure(op);
+    std::vector<Expression> memo_args;
+    if(pure){
+      if(env.recall(op, args, value)){
+        return true;
+      }
+      memo_args = args;
+    }
+
+    // bind the arguments in a new frame chained to the caller's environment
+    std::unique_ptr<Environment> scope(new Environment(&env));
+
+    for(std::size_t j = 0; j < lambda_list.size(); j++) {
+      scope->add_exp(lambda_list[j].head(), args[j], true);
+    }
+
+    push(BodyTask, lambda_tail[1], env);
+    profile(profiled_name(op));
+    frames.back().lambda = std::move(lambda);
+    frames.back().scope = std::move(scope);
+    if(pure){
+      frames.back().memo = op;
+      frames.back().values = std::move(memo_args);
+    }
+    return false;
+  }
+
+  // map from symbol to proc
+  Procedure proc = env.get_proc(op);
+  AllocScope allocs(ProcedureAllocs);
+  Profiler::Call timed(profiler, profiled_name(op));
+  value = proc(args);
+  return true;
+}
+
+void Evaluator::advance(Expression & value){
+
+  Frame & f = frames.back();
+
+  switch(f.task){
+  case CallTask:
+    advance_call(f, value);
+    break;
+  case BeginTask:
+    advance_begin(f, value);
+    break;
+  case DefineTask:
+    advance_define(f, value);
+    break;
+  case ApplyTask:
+    advance_apply(f, value);
+    break;
+  case MapTask:
+    advance_map(f, value);
+    break;
+  case SetPropertyTask:
+    advance_set_property(f, value);
+    break;
+  case GetPropertyTask:
+    advance_get_property(f, value);
+    break;
+  case BodyTask:
+    // the lambda's tail storage owns the body, the frame owns the lambda
+    if(f.stage == 0){
+      f.stage = 1;
+      if(!descend(*f.exp, *f.scope, value)) return;
+    }
+    // a tail call keeps the frame, whose value is still that of its first call
+    if(!f.memo.isNone()){
+      f.env->remember(f.memo, f.values, value);
+    }
+    complete(std::move(value), value);
+    break;
+  }
+}
+
+// run body(evaluator, i) for each i in [0, n) on the shared thread pool.
+// Each chunk gets its own Evaluator over its own frame chained to env, which
+// the workers only read.
+static void parallel_eval(std::size_t n, Environment & env,
+                          const std::function<void(Evaluator &, std::size_t)> & body){
+
+  std::size_t limit = EvalContext::current().maxDepth();
+  CancelToken * token = EvalContext::current().cancelToken();
+
+  ThreadPool::shared().parallel_for(n, [&](std::size_t first, std::size_t last){
+    EvalContext::DepthLimitScope limited(limit);
+    CancelToken::Scope cancellable(token);
+
+    Environment frame(&env);
+    Evaluator evaluator(frame);
+
+    for(std::size_t i = first; i < last; ++i){
+      body(evaluator, i);
+    }
+  });
+}
+
+// apply op to each of n elements on the shared thread pool, keeping their
+// order
+static Expression parallel_map(const Atom & op, std::size_t n,
+                               const std::function<Expression(std::size_t)> & element,
+                               Environment & env){
+
+  std::vector<Expression> results(n);
+
+  parallel_eval(n, env, [&](Evaluator & evaluator, std::size_t i){
+    std::vector<Expression> args(1, element(i));
+    results[i] = evaluator.apply(op, args);
+  });
+
+  return Expression::makeList(std::move(results));
+}
+
+// Inlining the lambdas an argument calls more than this many times, or
+// through more than this many nodes, makes it worth a task (see worth_a_task)
+static const std::size_t InlineLambdas = 8;
+static const std::size_t InlineNodes = 256;
+
+// true if evaluating exp may take long enough to pay for handing it to
+// another thread: it maps or applies over a list, calls a lambda that
+// recurses, or is large once the lambdas it calls are inlined. A few
+// arithmetic calls cost less than the hand-off.
+static bool worth_a_task(const Expression & exp, const Environment & env){
+
+  // asked of the arguments of every call, so nothing is allocated once
+  // the thread's stack has grown
+  static thread_local std::vector<const Expression *> pending;
+  pending.assign(1, &exp);
+
+  Expression inlined[InlineLambdas]; // lambdas whose bodies are pending
+  std::size_t lambdas = 0;
+  std::size_t nodes = 0;
+
+  while(!pending.empty()){
+    const Expression & e = *pending.back();
+    pending.pop_back();
+
+    if(++nodes > InlineNodes) return true;
+    if(e.tailSize() == 0) continue;
+
+    switch(e.form()){
+    case Expression::MapForm:
+    case Expression::PMapForm:
+    case Expression::ApplyForm:
+      return true;
+    case Expression::ConstantForm:
+      // only the original can cost anything; the folded value may be large
+      pending.push_back(&e.getTail()[1]);
+      continue;
+    default:
+      break;
+    }
+
+    if(env.is_exp(e.head())){
+      if(lambdas == InlineLambdas) return true;
+      Expression & lambda = inlined[lambdas++];
+      lambda = env.get_exp(e.head());
+      if(lambda.tailSize() == 2)
+        pending.push_back(&lambda.getTail()[1]);
+    }
+
+    for(auto & a : e.getTail()){
+      pending.push_back(&a);
+    }
+  }
+
+  return false;
+}
+
+// Arguments that are all pure can be evaluated in any order, so they are
+// evaluated in parallel when at least two of them are worth a task. An
+// error is that of the first failing argument, as when they are evaluated
+// in turn.
+bool Evaluator::parallel_arguments(Frame & f){
+
+  const std::vector<Expression> & tail = f.exp->getTail();
+  Environment & env = *f.env;
+
+  if((tail.size() < 2) || (ThreadPool::shared().workers() == 0)){
+    return false;
+  }
+
+  std::size_t tasks = 0;
+  for(auto & a : tail){
+    if(worth_a_task(a, env) && (++tasks == 2)) break;
+  }
+  if(tasks < 2){
+    return false;
+  }
+
+  for(auto & a : tail){
+    if(!env.is_pure(a)) return false;
+  }
+
+  f.values.resize(tail.size());
+  parallel_eval(tail.size(), env, [&](Evaluator & evaluator, std::size_t i){
+    f.values[i] = evaluator.run(tail[i]);
+  });
+
+  return true;
+}
+
+// ordinary call: evaluate the tail and apply the head
+void Evaluator::advance_call(Frame & f, Expression & value){
+
+  const std::vector<Expression> & tail = f.exp->getTail();
+
+  if(f.stage == 0){
+    if(parallel_arguments(f)){
+      f.next = tail.size();
+    }
+    else{
+      f.values.reserve(tail.size());
+    }
+  }
+  else if(f.stage == 1){
+    f.values.push_back(std::move(value));
+  }
+  else{
+    complete(std::move(value), value);
+    return;
+  }
+
+  f.stage = 1;
+  while(f.next < tail.size()){
+    if(!descend(tail[f.next++], *f.env, value)) return;
+    f.values.push_back(std::move(value));
+  }
+
+  f.stage = 2;
+  if(tail_call(f)) return;
+  if(!invoke(f.exp->head(), f.values, *f.env, value)) return;
+  complete(std::move(value), value);
+}
+
+// A call to a lambda in tail position of a lambda body (the body itself,
+// or the last argument of a begin that is) reuses the enclosing body frame:
+// the frames between are dropped and the callee's arguments are bound in
+// the caller's call frame. Under dynamic scoping the callee would see the
+// caller's bindings through the frame chain anyway, its own arguments
+// shadowing them; the caller has nothing left to evaluate, so sharing the
+// frame is not observable, and recursion in tail position runs in constant
+// space.
+bool Evaluator::tail_call(Frame & f){
+
+  // find the enclosing lambda body, through begins at their last argument
+  std::size_t body = frames.size() - 1;
+  while((body > 0) && (frames[body - 1].task == BeginTask) &&
+        (frames[body - 1].next == frames[body - 1].exp->getTail().size())){
+    --body;
+  }
+  if((body == 0) || (frames[body - 1].task != BodyTask)){
+    return false;
+  }
+  --body;
+
+  const Atom & op = f.exp->head();
+  Environment & env = *f.env;
+
+  if(!op.isSymbol() || !env.is_exp(op)){
+    return false;
+  }
+
+  // the same checks as invoke
+  Expression lambda = env.get_exp(op);
+  const std::vector<Expression> & lambda_tail = lambda.getTail();
+
+  if(lambda_tail.size() != 2)
+    throw SemanticError("Error during evaluation: symbol does not name a procedure or lambda.");
+
+  const std::vector<Expression> & lambda_list = lambda_tail[0].getTail();
+
+  if(lambda_list.size() != f.values.size())
+    throw SemanticError("Error in call to lambda function: invalid number of arguments.");
+
+  std::vector<Expression> args(std::move(f.values));
+
+  while(frames.size() > body + 1){
+    if(frames.back().profiled)
+      profiler->leave();
+    frames.pop_back();
+    context.leave();
+  }
+
+  Frame & callee = frames.back();
+  if(callee.profiled)
+    profiler->replace(op.asSymbol());
+  for(std::size_t j = 0; j < lambda_list.size(); j++) {
+    callee.scope->add_exp(lambda_list[j].head(), args[j], true);
+  }
+
+  callee.exp = &lambda_tail[1];
+  callee.lambda = std::move(lambda);
+  callee.stage = 0;
+
+  return true;
+}
+
+// evaluate each argument of the tail, the value is the last
+void Evaluator::advance_begin(Frame & f, Expression & value){
+
+  const std::vector<Expression> & tail = f.exp->getTail();
+
+  if(f.stage == 0){
+    if(tail.empty()){
+      throw SemanticError("Error during evaluation: zero arguments to begin");
+    }
+    f.stage = 1;
+  }
+
+  while(f.next < tail.size()){
+    if(!descend(tail[f.next++], *f.env, value)) return;
+  }
+
+  complete(std::move(value), value);
+}
+
+void Evaluator::advance_define(Frame & f, Expression & value){
+
+  const Expression & exp = *f.exp;
+  const std::vector<Expression> & tail = exp.getTail();
+  Environment & env = *f.env;
+
+  if(f.stage == 0){
+
+    // tail must have size 3 or error
+    if(tail.size() != 2)
+      throw SemanticError("Error during evaluation: invalid number of arguments to define");
+
+    // tail[0] must be symbol
+    if(!tail[0].isHeadSymbol())
+      throw SemanticError("Error during evaluation: first argument to define not symbol");
+
+    // but tail[0] must not be a special-form or procedure
+    const std::string & s = tail[0].head().asSymbol();
+    if((s == "define") || (s == "begin") || (s == "lambda"))
+      throw SemanticError("Error during evaluation: attempt to redefine a special-form");
+
+    if(env.is_proc(exp.head()))
+      throw SemanticError("Error during evaluation: attempt to redefine a built-in procedure");
+
+    // eval tail[1]
+    f.stage = 1;
+    if(!descend(tail[1], env, value)) return;
+  }
+
+  if(env.is_exp(exp.head()))
+    throw SemanticError("Error during evaluation: attempt to redefine a previously defined symbol");
+
+  env.add_exp(tail[0].head(), value);
+
+  complete(std::move(value), value);
+}
+
+void Evaluator::advance_apply(Frame & f, Expression & value){
+
+  const std::vector<Expression> & tail = f.exp->getTail();
+  Environment & env = *f.env;
+
+  enum { Start, ProcArgs, LambdaList, Result };
+
+  if(f.stage == Start){
+    if(tail.size() != 2)
+      throw SemanticError("Error in call to apply: invalid number of arguments");
+
+    if(!tail[1].isHeadList())
+      throw SemanticError("Error in call to apply: invalid list argument");
+
+    if(!tail[0].getTail().empty())
+      throw SemanticError("Error in call to apply: invalid symbol argument");
+
+    if(env.is_proc(tail[0].head())) {
+      f.values.reserve(tail[1].getTail().size());
+      f.stage = ProcArgs;
+    }
+    else if(env.is_exp(tail[0].head())) {
+      f.stage = LambdaList;
+      if(!descend(tail[1], env, value)) return;
+    }
+    else
+      throw SemanticError("Error in call to apply: invalid symbol argument");
+  }
+  else if(f.stage == ProcArgs){
+    f.values.push_back(std::move(value));
+  }
+
+  if(f.stage == ProcArgs){
+    // the procedure gets the list's arguments evaluated one by one
+    const std::vector<Expression> & list = tail[1].getTail();
+    while(f.next < list.size()){
+      if(!descend(list[f.next++], env, value)) return;
+      f.values.push_back(std::move(value));
+    }
+
+    f.stage = Result;
+    if(!invoke(tail[0].head(), f.values, env, value)) return;
+  }
+  else if(f.stage == LambdaList){
+    // the lambda gets the elements of the evaluated list
+    f.value = std::move(value);
+    f.stage = Result;
+    if(!invoke(tail[0].head(), f.value.getTail(), env, value)) return;
+  }
+
+  complete(std::move(value), value);
+}
+
+// similar to apply but run procedure/expression on each item in list; pmap
+// applies it to the items in parallel
+void Evaluator::advance_map(Frame & f, Expression & value){
+
+  const std::vector<Expression> & tail = f.exp->getTail();
+  Environment & env = *f.env;
+  const bool parallel = (f.exp->form() == Expression::PMapForm);
+
+  enum { Start, ProcArgs, LambdaList, LambdaResult };
+
+  if(f.stage == Start){
+    if(tail.size() != 2)
+      throw SemanticError("Error in call to map: invalid number of arguments");
+
+    if(!tail[1].isHeadList() && tail[1].head().asString() != "range")
+      throw SemanticError("Error in call to mapy: invalid list argument");
+
+    if(!tail[0].getTail().empty())
+      throw SemanticError("Error in call to map: invalid symbol argument");
+
+    if(env.is_proc(tail[0].head())) {
+      f.values.reserve(tail[1].getTail().size());
+      f.stage = ProcArgs;
+    }
+    else if(env.is_exp(tail[0].head())) {
+      f.stage = LambdaList;
+      if(!descend(tail[1], env, value)) return;
+    }
+    else
+      throw SemanticError("Error in call to apply: invalid symbol argument.");
+  }
+  else if(f.stage == ProcArgs){
+    f.values.push_back(std::move(value));
+  }
+  else if(f.stage == LambdaResult){
+    f.results.push_back(std::move(value));
+  }
+
+  if(f.stage == ProcArgs){
+    // evaluate the list's arguments, then apply the procedure to each
+    const std::vector<Expression> & list = tail[1].getTail();
+    while(f.next < list.size()){
+      if(!descend(list[f.next++], env, value)) return;
+      f.values.push_back(std::move(value));
+    }
+
+    if(parallel){
+      complete(parallel_map(tail[0].head(), f.values.size(),
+                            [&f](std::size_t i){ return f.values[i]; }, env), value);
+      return;
+    }
+
+    Procedure proc = env.get_proc(tail[0].head());
+    AllocScope allocs(ProcedureAllocs);
+    f.results.reserve(f.values.size());
+
+    std::vector<Expression> toPass(1);
+    for(auto & a: f.values) {
+      toPass[0] = std::move(a);
+      context.poll();
+      Profiler::Call timed(profiler, tail[0].head().asSymbol());
+      f.results.push_back(proc(toPass));
+    }
+
+    complete(f.results.build(), value);
+    return;
+  }
+
+  if(f.stage == LambdaList){
+    f.value = std::move(value);
+
+    if(parallel){
+      complete(parallel_map(tail[0].head(), f.value.tailSize(),
+                            [&f](std::size_t i){ return f.value.tailAt(i); }, env), value);
+      return;
+    }
+
+    f.results.reserve(f.value.tailSize());
+    f.stage = LambdaResult;
+  }
+
+  // apply the lambda to each element of the evaluated list in turn, a
+  // packed list (or a range) is read element by element rather than
+  // expanded, and numeric results are packed as they arrive
+  std::vector<Expression> toPass(1);
+  while(f.next < f.value.tailSize()){
+    toPass[0] = f.value.tailAt(f.next++);
+    if(!invoke(tail[0].head(), toPass, env, value)) return;
+    f.results.push_back(std::move(value));
+  }
+
+  complete(f.results.build(), value);
+}
+
+void Evaluator::advance_set_property(Frame & f, Expression & value){
+
+  const std::vector<Expression> & tail = f.exp->getTail();
+  Environment & env = *f.env;
+
+  enum { Start, Target, Value };
+
+  switch(f.stage){
+  case Start:
+    if(tail.size() != 3)
+      throw SemanticError("Error in call to set-property: invalid number of arguments.");
+
+    if((tail[0].head().asSymbol().front() != '\"'))
+      throw SemanticError("Error in call to set-property: invalid argument.");
+
+    f.stage = Target;
+    if(!descend(tail[2], env, value)) return;
+    // fall through
+  case Target:
+    f.value = std::move(value);
+    f.stage = Value;
+    if(!descend(tail[1], env, value)) return;
+    // fall through
+  case Value:
+    f.value.add_property(tail[0].head().asString(), value);
+    complete(std::move(f.value), value);
+    return;
+  }
+}
+
+void Evaluator::advance_get_property(Frame & f, Expression & value){
+
+  const std::vector<Expression> & tail = f.exp->getTail();
+
+  if(f.stage == 0){
+    if(tail.size() != 2)
+      throw SemanticError("Error in call to set-property: invalid number of arguments.");
+
+    if((tail[0].head().asSymbol().front() != '\"'))
+      throw SemanticError("Error in call to set-property: invalid argument.");
+
+    f.stage = 1;
+    if(!descend(tail[1], *f.env, value)) return;
+  }
+
+  auto found = value.property_list.find(tail[0].head().asString());
+
+  if(found == value.property_list.end()) {
+    complete(Expression(), value);
+  }
+  else {
+    complete(Expression(found->second), value);
+  }
+}
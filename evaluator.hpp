@@ -0,0 +1,114 @@
+/*! \file evaluator.hpp
+Defines the Evaluator, the explicit-stack engine behind Expression::eval.
+ */
+#ifndef EVALUATOR_HPP
+#define EVALUATOR_HPP
+
+// system includes
+#include <memory>
+#include <vector>
+
+// module includes
+#include "environment.hpp"
+#include "eval_context.hpp"
+#include "expression.hpp"
+#include "profiler.hpp"
+
+/*! \class Evaluator
+\brief Evaluates an Expression without recursing on the C++ stack.
+
+Each non-terminal node under evaluation owns a Frame on an explicit stack.
+A frame asks for an operand by pushing the operand's frame, and is resumed
+with the operand's value once that frame completes. A lambda call pushes a
+frame owning the call's Environment, so the depth of plotscript recursion
+is bounded by the evaluation depth limit (see EvalContext) rather than by
+the native stack. A lambda called in tail position of a lambda body reuses
+the body's frame, so tail recursion runs in constant space.
+ */
+class Evaluator {
+public:
+
+  /// Construct an evaluator over the given environment
+  explicit Evaluator(Environment & env);
+
+  /*! Evaluate an expression.
+    \param exp the expression to evaluate
+    \return the value of exp
+    \throws SemanticError when a semantic error is encountered
+   */
+  Expression run(const Expression & exp);
+
+  /*! Apply a procedure or lambda to already evaluated arguments.
+    \param op the symbol naming the procedure or lambda
+    \param args the arguments
+    \return the value of the call
+    \throws SemanticError when a semantic error is encountered
+   */
+  Expression apply(const Atom & op, const std::vector<Expression> & args);
+
+private:
+
+  // what a frame is evaluating
+  enum Task { CallTask, BeginTask, DefineTask, ApplyTask, MapTask,
+              SetPropertyTask, GetPropertyTask, BodyTask };
+
+  struct Frame {
+    Frame(Task t, const Expression * e, Environment * en)
+      : task(t), exp(e), env(en), stage(0), next(0), profiled(false) {}
+
+    Task task;
+    const Expression * exp; // the node being evaluated
+    Environment * env;      // the environment it is evaluated in
+    int stage;              // task specific progress, 0 when first run
+    std::size_t next;       // index of the next operand to evaluate
+    std::vector<Expression> values; // evaluated operands
+    Expression value;       // task specific intermediate value
+    Expression lambda;      // lambda being called, owns the body
+    Atom memo;              // pure lambda whose call (args in values) is remembered
+    Expression::ListBuilder results; // results of a map
+    std::unique_ptr<Environment> scope; // call frame of a lambda body
+    bool profiled;          // the profiler times the frame until it completes
+  };
+
+  // evaluate exp, returning true with its value in value when no frame was
+  // needed, false when a frame was pushed
+  bool descend(const Expression & exp, Environment & env, Expression & value);
+
+  // call op with args, returning true with the result in value, or false
+  // when a lambda body frame was pushed
+  bool invoke(const Atom & op, const std::vector<Expression> & args,
+              Environment & env, Expression & value);
+
+  // replace the enclosing lambda body by the call of the top frame, when
+  // it is in tail position; false when it is not
+  bool tail_call(Frame & f);
+
+  // resume the top frame with the value of its last operand (if any)
+  void advance(Expression & value);
+
+  // pop the top frame, leaving its result in value
+  void complete(Expression && result, Expression & value);
+
+  void push(Task task, const Expression & exp, Environment & env);
+
+  // time the top frame under name, when profiling
+  void profile(const std::string & name);
+
+  // evaluate the arguments of a call on the thread pool, true if it did
+  bool parallel_arguments(Frame & f);
+
+  void advance_call(Frame & f, Expression & value);
+  void advance_begin(Frame & f, Expression & value);
+  void advance_define(Frame & f, Expression & value);
+  void advance_apply(Frame & f, Expression & value);
+  void advance_map(Frame & f, Expression & value);
+  void advance_set_property(Frame & f, Expression & value);
+  void advance_get_property(Frame & f, Expression & value);
+
+  Environment & root;
+  std::vector<Frame> frames;
+  EvalContext & context; // of the constructing thread
+  Profiler * profiler; // of the constructing thread, usually null
+};
+
+#endif
@@ -1,65 +1,161 @@
+#include <algorithm>
 #include <sstream>
 #include <list>
 #include <iostream>
 #include <iomanip>
 #include <cmath>
+#include <iterator>
 
 #include "expression.hpp"
+#include "alloc_stats.hpp"
 #include "environment.hpp"
+#include "eval_context.hpp"
 #include "semantic_error.hpp"
+#include "evaluator.hpp"
+#include "optimize.hpp"
 
 #include <unistd.h>
 #include <csignal>
 #include <cstdlib>
 #include <atomic>
 
-bool isInterrupted;
+Expression::Expression() : isList(false), m_form(UnresolvedForm) {}
 
-Expression::Expression() : isList(false) {}
-
-Expression::Expression(const Atom & a) : isList(false) {
+Expression::Expression(const Atom & a) : isList(false), m_form(UnresolvedForm) {
 
   m_head = a;
 }
 
-// recursive copy
-Expression::Expression(const Expression & a) : isList(false) {
+Expression::Expression(Atom && a) noexcept
+  : m_head(std::move(a)), isList(false), m_form(UnresolvedForm) {}
+
+// shallow copy, the tail vector is shared until one side mutates it
+Expression::Expression(const Expression & a) : isList(a.isList), m_form(a.m_form) {
 
   m_head = a.m_head;
-  for(auto e : a.m_tail){
-    m_tail.push_back(e);
-  }
+  m_tail = a.m_tail;
   property_list = a.property_list;
-  //isInterrupted = false;
-  //install_handler();
-
 }
 
-Expression::Expression(const std::vector<Expression> & a) {
-  for(auto e : a) {
-    m_tail.push_back(e);
+Expression::Expression(Expression && a) noexcept
+  : property_list(std::move(a.property_list)), m_head(std::move(a.m_head)),
+    m_tail(std::move(a.m_tail)), isList(a.isList), m_form(a.m_form) {}
+
+// the default destructor would release a deep tree recursively, one native
+// frame per level; instead take the children of uniquely owned tails onto a
+// work list so each is destroyed with an empty tail
+Expression::~Expression() {
+
+  if(!m_tail.unique())
+    return;
+
+  bool deep = false;
+  for(auto & e : m_tail.get()){
+    if(e.m_tail.unique()){
+      deep = true;
+      break;
+    }
+  }
+  if(!deep)
+    return;
+
+  std::vector<Expression> pending;
+  pending.swap(m_tail.mutate());
+
+  while(!pending.empty()){
+    Expression e(std::move(pending.back()));
+    pending.pop_back();
+
+    if(e.m_tail.unique()){
+      std::vector<Expression> & children = e.m_tail.mutate();
+      std::move(children.begin(), children.end(), std::back_inserter(pending));
+      children.clear();
+    }
   }
 }
 
+Expression::Expression(const std::vector<Expression> & a) : isList(false), m_form(UnresolvedForm) {
+  m_tail.mutate() = a;
+}
+
+Expression::Expression(std::vector<Expression> && a) : isList(false), m_form(UnresolvedForm) {
+  m_tail.mutate() = std::move(a);
+}
+
 Expression & Expression::operator=(const Expression & a) {
 
   // prevent self-assignment
   if(this != &a){
     m_head = a.m_head;
-    m_tail.clear();
-    for(auto e : a.m_tail){
-      m_tail.push_back(e);
-    }
+    m_tail = a.m_tail;
     property_list = a.property_list;
+    isList = a.isList;
+    m_form = a.m_form;
+  }
+
+  return *this;
+}
+
+Expression & Expression::operator=(Expression && a) noexcept {
 
+  if(this != &a){
+    m_head = std::move(a.m_head);
+    m_tail = std::move(a.m_tail);
+    property_list = std::move(a.property_list);
+    isList = a.isList;
+    m_form = a.m_form;
   }
 
-  //install_handler();
   return *this;
 }
 
+const Expression::Tail::VectorType & Expression::Tail::get() const {
+
+  static const VectorType empty;
+
+  if(m_ptr)
+    return *m_ptr;
+
+  if(m_packed){
+    Packed & packed = *m_packed;
+    std::call_once(packed.expand_once, [&packed](){
+      packed.expanded.reserve(packed.numbers.size());
+      for(std::size_t i = 0; i < packed.numbers.size(); ++i){
+        packed.expanded.emplace_back(packed.numbers.at(i));
+      }
+    });
+    return packed.expanded;
+  }
+
+  return empty;
+}
+
+Expression::Tail::VectorType & Expression::Tail::mutate() {
+
+  if(m_packed){
+    // writing through a packed tail turns it into an ordinary one
+    m_ptr = std::make_shared<VectorType>(get());
+    m_packed.reset();
+  }
+  else if(!m_ptr){
+    m_ptr = std::make_shared<VectorType>();
+  }
+  else if(m_ptr.use_count() > 1){
+    // shared with another Expression, clone before writing
+    m_ptr = std::make_shared<VectorType>(*m_ptr);
+  }
+
+  return *m_ptr;
+}
+
+void Expression::Tail::pack(NumberArray && numbers) {
+  m_ptr.reset();
+  m_packed = std::make_shared<Packed>(std::move(numbers));
+}
 
 Atom & Expression::head(){
+  // the caller may change the head, so the cached form may go stale
+  m_form = UnresolvedForm;
   return m_head;
 }
 
@@ -89,19 +185,25 @@ bool Expression::isHeadSymbol() const noexcept{
 void Expression::setHeadList() {
   m_head.setList();
   isList = true;
+  m_form = UnresolvedForm;
 }
 
 void Expression::setHeadLambda() {
   m_head.setLambda();
+  m_form = UnresolvedForm;
 }
 
 
 void Expression::append(const Atom & a){
-  m_tail.emplace_back(a);
+  m_tail.mutate().emplace_back(a);
 }
 
 void Expression::append(const Expression& a) {
-  m_tail.push_back(a);
+  m_tail.mutate().push_back(a);
+}
+
+void Expression::append(Expression&& a) {
+  m_tail.mutate().push_back(std::move(a));
 }
 
 
@@ -109,67 +211,106 @@ Expression * Expression::tail(){
   Expression * ptr = nullptr;
 
   if(m_tail.size() > 0){
-    ptr = &m_tail.back();
+    ptr = &m_tail.mutate().back();
   }
 
   return ptr;
 }
 
-Expression::ConstIteratorType Expression::tailConstBegin() const noexcept{
-  return m_tail.cbegin();
+Expression::ConstIteratorType Expression::tailConstBegin() const{
+  return m_tail.begin();
 }
 
-Expression::ConstIteratorType Expression::tailConstEnd() const noexcept{
-  return m_tail.cend();
+Expression::ConstIteratorType Expression::tailConstEnd() const{
+  return m_tail.end();
 }
 
-std::vector<Expression> Expression::getTail() const {
-  return m_tail;
+const std::vector<Expression> & Expression::getTail() const {
+  return m_tail.get();
 }
 
-Expression Expression::apply(Atom & op, std::vector<Expression> & args, Environment & env) {
+std::size_t Expression::tailSize() const noexcept {
+  return m_tail.size();
+}
 
-  if(!(op.isSymbol() || op.isString()) && !op.isLambda()) {
-    //if(op.asString() != "list")
-    throw SemanticError("Error during evaluation: procedure name not symbol or lambda.");
-  }
+Expression Expression::tailAt(std::size_t i) const {
+  const NumberArray * packed = m_tail.numbers();
+  return packed ? Expression(packed->at(i)) : m_tail[i];
+}
 
-  // must map to a proc or exp
-  if(!env.is_proc(op) && !env.is_exp(op)){
-    throw SemanticError("Error during evaluation: symbol does not name a procedure or lambda.");
-  }
+const NumberArray * Expression::numbers() const noexcept {
+  return m_tail.numbers();
+}
 
-  // If atom is placeholder for lambda
-  if(env.is_exp(op)) {
+// a list element that can live in a NumberArray: a bare Number or Complex
+static bool is_packable(const Expression & e) {
+  return (e.isHeadNumber() || e.isHeadComplex()) && (e.tailSize() == 0)
+    && e.property_list.empty() && !e.isHeadList();
+}
 
-    Expression lambda = env.get_exp(op);
-    std::vector<Expression> lambda_tail = lambda.getTail();
-    std::vector<Expression> lambda_args = args;
-    Expression lambda_list = lambda_tail[0];
+Expression Expression::makeList(std::vector<Expression> && elements) {
 
-    //for(Expression::IteratorType it = lambda.m_tail[0].begin(); it != lambda.m_tail[0].end(); ++it, i++){
-    if(lambda_list.getTail().size() != lambda_args.size())
-      throw SemanticError("Error in call to lambda function: invalid number of arguments.");
+  NumberArray packed;
+  for(auto & e : elements){
+    if(!is_packable(e) || !packed.accepts(e.head()))
+      break;
+    packed.push_back(e.head());
+    if(packed.size() == 1)
+      packed.reserve(elements.size());
+  }
 
-    Environment copyEnv = env;
-    //copyEnv.setLambda();
+  Expression result;
+  if(!elements.empty() && (packed.size() == elements.size()))
+    result.m_tail.pack(std::move(packed));
+  else
+    result.m_tail.mutate() = std::move(elements);
 
-    for(int j = 0; j < lambda_list.getTail().size(); j++) {
-      copyEnv.add_exp(lambda_list.m_tail[j].head(), lambda_args[j], true);
-    }
+  result.setHeadList();
+  return result;
+}
 
-    return lambda_tail[1].eval(copyEnv);
+void Expression::ListBuilder::push_back(Expression && element) {
+
+  if(elements.empty() && is_packable(element) && packed.accepts(element.head())){
+    if(packed.empty())
+      packed.reserve(expected);
+    packed.push_back(element.head());
+    return;
   }
-  else {
-    // map from symbol to proc
-    Procedure proc = env.get_proc(op);
 
-    // call proc with args
-    return proc(args);
+  // the list cannot stay packed, unpack what there is
+  if(elements.empty()){
+    elements.reserve(std::max(expected, packed.size() + 1));
+    for(std::size_t i = 0; i < packed.size(); ++i)
+      elements.emplace_back(packed.at(i));
+    packed = NumberArray();
   }
+  elements.push_back(std::move(element));
+}
+
+Expression Expression::ListBuilder::build() {
+
+  Expression result = elements.empty() ? makeList(std::move(packed)) : makeList(std::move(elements));
+  packed = NumberArray();
+  elements.clear();
+  return result;
+}
+
+Expression Expression::makeList(NumberArray && numbers) {
+
+  Expression result;
+  if(!numbers.empty())
+    result.m_tail.pack(std::move(numbers));
+
+  result.setHeadList();
+  return result;
+}
+
+Expression Expression::apply(const Atom & op, const std::vector<Expression> & args, Environment & env) const {
+  return Evaluator(env).apply(op, args);
 }
 
-Expression Expression::handle_lookup(const Atom & head, const Environment & env){
+Expression Expression::handle_lookup(const Atom & head, const Environment & env) const {
     if(head.asString().front() == '\"') {
       return Expression(head);
     }
@@ -205,163 +346,36 @@ Expression Expression::handle_lookup(const Atom & head, const Environment & env)
     }
 }
 
-Expression Expression::handle_begin(Environment & env){
-
-  if(m_tail.size() == 0){
-    throw SemanticError("Error during evaluation: zero arguments to begin");
-  }
-
-  // evaluate each arg from tail, return the last
-  Expression result;
-  for(Expression::IteratorType it = m_tail.begin(); it != m_tail.end(); ++it){
-    result = it->eval(env);
-  }
-
-  return result;
-}
-
-
-Expression Expression::handle_define(Environment & env){
-  //defined = true;
+// Special form method to handle a lambda function created by the user
+Expression Expression::handle_lambda(Environment & env) const {
 
-  // tail must have size 3 or error
   if(m_tail.size() != 2)
     throw SemanticError("Error during evaluation: invalid number of arguments to define");
 
-  // tail[0] must be symbol
-  if(!m_tail[0].isHeadSymbol())
-    throw SemanticError("Error during evaluation: first argument to define not symbol");
-
-  // but tail[0] must not be a special-form or procedure
-  std::string s = m_tail[0].head().asSymbol();
-  if((s == "define") || (s == "begin") || (s == "lambda"))
-    throw SemanticError("Error during evaluation: attempt to redefine a special-form");
-
-  if(env.is_proc(m_head))
-    throw SemanticError("Error during evaluation: attempt to redefine a built-in procedure");
-
-  // eval tail[1]
-  Expression result = m_tail[1].eval(env);
-
-  if(env.is_exp(m_head))
-    throw SemanticError("Error during evaluation: attempt to redefine a previously defined symbol");
-
-  //if(m_tail[1].head().asSymbol() == "lambda")
-    //envmap.emplace(m_tail[0].head(), EnvResult(ProcedureType, lambda));
-  //else {
-    //and add to env
-  env.add_exp(m_tail[0].head(), result);
-  //}
-
-  return result;
+  return makeLambda(m_tail[0], m_tail[1]);
 }
 
-// Special form method to handle a lambda function created by the user
-Expression Expression::handle_lambda(Environment & env) {
-
-  if(m_tail.size() != 2)
-    throw SemanticError("Error during evaluation: invalid number of arguments to define");
+Expression Expression::makeLambda(const Expression & params, const Expression & body) {
 
-  // create the list of arguments to be created
-  Expression result;// = m_tail[1];
-  m_tail[0].m_tail.insert(m_tail[0].m_tail.begin(), Expression(m_tail[0].head())); // push input argument in head into tail as part of list
-  m_tail[0].setHeadList(); // Set as list
+  // create the list of arguments: the head of params followed by its tail.
+  // built fresh so evaluating the same lambda twice leaves the AST intact
+  Expression arguments;
+  std::vector<Expression> & names = arguments.m_tail.mutate();
+  names.reserve(params.m_tail.size() + 1);
+  names.emplace_back(params.head());
+  names.insert(names.end(), params.m_tail.begin(), params.m_tail.end());
+  arguments.setHeadList(); // Set as list
 
-  // Create returnable lambda expression
-  result.m_tail.push_back(m_tail[0]);
-  result.m_tail.push_back(m_tail[1]);
+  // Create returnable lambda expression, the body is shared not copied
+  Expression result;
+  result.append(std::move(arguments));
+  result.append(body);
 
   result.setHeadLambda();
 
   return result;
 }
 
-Expression Expression::handle_apply(Environment & env) {
-  if(m_tail.size() != 2)
-    throw SemanticError("Error in call to apply: invalid number of arguments");
-
-  if(!m_tail[1].isHeadList())
-    throw SemanticError("Error in call to apply: invalid list argument");
-
-  if(m_tail[0].m_tail != std::vector<Expression>())
-    throw SemanticError("Error in call to apply: invalid symbol argument");
-
-  if(env.is_proc(m_tail[0].head())) {
-
-    Procedure proc = env.get_proc(m_tail[0].head());
-
-    Expression exp_tail = m_tail[1];
-    std::vector<Expression> pass_exp;
-
-    for(Expression::IteratorType it = exp_tail.m_tail.begin(); it != exp_tail.m_tail.end(); ++it) {
-      pass_exp.push_back((*it).eval(env));
-    }
-
-    Expression result = proc(pass_exp);
-
-    return result;
-  }
-  else if(env.is_exp(m_tail[0].head())) {
-
-    Expression args_eval = m_tail[1].eval(env);
-
-    return apply(m_tail[0].head(), args_eval.m_tail, env);
-  }
-  else
-    throw SemanticError("Error in call to apply: invalid symbol argument");
-}
-
-// Similar to apply but run procedure/expression on each item in list
-Expression Expression::handle_map(Environment & env) {
-  if(m_tail.size() != 2)
-    throw SemanticError("Error in call to map: invalid number of arguments");
-
-  //std::cout << m_tail[1] << '\n';
-
-  if(!m_tail[1].isHeadList() && m_tail[1].head().asString() != "range")
-    throw SemanticError("Error in call to mapy: invalid list argument");
-
-  if(m_tail[0].m_tail != std::vector<Expression>())
-    throw SemanticError("Error in call to map: invalid symbol argument");
-
-  if(env.is_proc(m_tail[0].head())) {
-
-    Procedure proc = env.get_proc(m_tail[0].head());
-
-    Expression exp_tail = m_tail[1];
-    std::vector<Expression> pass_exp;
-
-    for(Expression::IteratorType it = exp_tail.m_tail.begin(); it != exp_tail.m_tail.end(); ++it) {
-      pass_exp.push_back((*it).eval(env));
-    }
-
-    Expression return_exp;
-    return_exp.setHeadList();
-
-    for(auto & a: pass_exp)
-      return_exp.append(proc(std::vector<Expression>(1,a)));
-
-    return return_exp;
-  }
-  else if(env.is_exp(m_tail[0].head())) {
-
-    Expression args_eval = m_tail[1].eval(env);
-
-    Expression return_exp;
-    return_exp.setHeadList();
-
-    for(int i = 0; i < args_eval.m_tail.size(); i++) {
-      std::vector<Expression> toPass(1,args_eval.m_tail[i]);
-      return_exp.append(apply(m_tail[0].head(), toPass, env));
-    }
-
-    return return_exp;
-  }
-  else
-    throw SemanticError("Error in call to apply: invalid symbol argument.");
-}
-
-
 ///*
 // Methods for setting and getting properties
 //*/
@@ -370,57 +384,20 @@ void Expression::add_property(const std::string & key, Expression & value) {
   //stored_values.push_back(value);
   //std::cout << "size: " << stored_values.size() << '\n';
   //property_list[key] = &stored_values.back();
+  AllocScope allocs(PlotAllocs);
   property_list[key] = value;
 }
 
 Expression Expression::get_property(const std::string & key) {
+  AllocScope allocs(PlotAllocs);
   return property_list[key];
 }
 
-Expression Expression::handle_set_prop(Environment & env) {
-  if(m_tail.size() != 3)
-    throw SemanticError("Error in call to set-property: invalid number of arguments.");
-
-  if((m_tail[0].head().asSymbol().front() != '\"'))
-    throw SemanticError("Error in call to set-property: invalid argument.");
-
-  //std::cout << "Key: " << m_tail[0].head().asString() << '\n';
-  //std::cout << "Value: " << m_tail[1].head() << '\n';
-
-  Expression returnExp = m_tail[2].eval(env);
-  Expression value = m_tail[1].eval(env);
-
-  //std::cout << m_tail[1] << ' ' << m_tail[2] << '\n';
-  //Expression temp = value.eval(env);
-  returnExp.add_property(m_tail[0].head().asString(), value);
-
-
-  return returnExp;
-}
-
-Expression Expression::handle_get_prop(Environment & env) {
-  if(m_tail.size() != 2)
-    throw SemanticError("Error in call to set-property: invalid number of arguments.");
-
-  if((m_tail[0].head().asSymbol().front() != '\"'))
-    throw SemanticError("Error in call to set-property: invalid argument.");
+Expression Expression::handle_discrete_plot(Environment & env) const {
 
-  Expression temp;
-  //if(env.is_exp(m_tail[1].head()))
-  //temp = env.get_exp(m_tail[1].head());
-  temp = m_tail[1].eval(env);
-
-  std::map<std::string,Expression>::const_iterator isFound = temp.property_list.find(m_tail[0].head().asString());
-
-  if(isFound == temp.property_list.end()) {
-    return Expression();
-  }
-  else
-    return temp.get_property(m_tail[0].head().asString());
-}
-
-
-Expression Expression::handle_discrete_plot(Environment & env) {
+  // evaluating the data counts as eval again (see Evaluator::run)
+  AllocScope allocs(PlotAllocs);
+  EvalContext & context = EvalContext::current();
 
   //double scaleVal = 1;
   //bool isScaled = false;
@@ -460,6 +437,7 @@ Expression Expression::handle_discrete_plot(Environment & env) {
 
     // FInd the max and min of the points
     for(auto & list: evaluatedData.getTail()) {
+      context.poll();
       if(!list.isHeadList())
         throw SemanticError("Error in call to discrete-plot: argument not a list.");
 
@@ -570,6 +548,7 @@ Expression Expression::handle_discrete_plot(Environment & env) {
     //std::cout << "Y from " << minY*yScale << " to " << maxY*yScale << '\n';
     // Run through the list again to plot the points/lines at the scaled values
     for(auto & list: evaluatedData.getTail()) {
+      context.poll();
 
       //std::cout << "New item: " << list << '\n';
       x = list.getTail().at(0).head().asNumber();
@@ -705,7 +684,9 @@ Expression Expression::handle_discrete_plot(Environment & env) {
 }
 
 
-Expression Expression::handle_continuous_plot(Environment & env) {
+Expression Expression::handle_continuous_plot(Environment & env) const {
+
+  AllocScope allocs(PlotAllocs);
 
   if(!isHeadList())
     throw SemanticError("Error in call to set-property: invalid number of arguments.");
@@ -716,106 +697,144 @@ Expression Expression::handle_continuous_plot(Environment & env) {
 
 void Expression::setHead(const Atom & a) {
   m_head = a;
+  m_form = UnresolvedForm;
+}
+
+// Map from interned symbol id to special-form kind. Built once, the ids of
+// the special-form names are small so the table stays short.
+static std::vector<Expression::FormKind> build_form_table(){
+
+  const std::pair<const char *, Expression::FormKind> forms[] = {
+    {"begin", Expression::BeginForm},
+    {"define", Expression::DefineForm},
+    {"lambda", Expression::LambdaForm},
+    {"apply", Expression::ApplyForm},
+    {"map", Expression::MapForm},
+    {"pmap", Expression::PMapForm},
+    {"set-property", Expression::SetPropertyForm},
+    {"get-property", Expression::GetPropertyForm},
+    {"discrete-plot", Expression::DiscretePlotForm},
+    {"continuous-plot", Expression::ContinuousPlotForm},
+    {FoldedHead, Expression::ConstantForm}
+  };
+
+  std::vector<Expression::FormKind> table;
+  for(auto & f : forms){
+    SymbolId id = intern_symbol(f.first);
+    if(id >= table.size())
+      table.resize(id + 1, Expression::ProcedureForm);
+    table[id] = f.second;
+  }
+
+  return table;
 }
 
-// this is a simple recursive version. the iterative version is more
-// difficult with the ast data structure used (no parent pointer).
-// this limits the practical depth of our AST
-Expression Expression::eval(Environment & env) {
+static Expression::FormKind form_of(const Atom & head) noexcept {
 
-  //std::cout << "Flag status: " << env.get_exp(Atom("interrupt_flag")) << '\n';
-  if(isInterrupted) {
-    //std::cout << "Caught Interrupt.\n";
-    isInterrupted = false; // reset interrupt flag
-    throw SemanticError("Error: interpreter kernel interrupted");
-  }
+  static const std::vector<Expression::FormKind> table = build_form_table();
 
-  if(m_tail.empty()) {
+  SymbolId id = head.symbolId();
+  return (id < table.size()) ? table[id] : Expression::ProcedureForm;
+}
 
+void Expression::resolveForm() noexcept {
+  m_form = form_of(m_head);
+}
 
-    return handle_lookup(m_head, env);
-  }
-  else if(m_head.isSymbol() && m_head.asSymbol() == "begin") { // handle begin special-form
-    return handle_begin(env);
-  }
-  else if(m_head.isSymbol() && m_head.asSymbol() == "define") { // handle define special-form
-    return handle_define(env);
-  }
-  else if(m_head.isSymbol() && m_head.asSymbol() == "lambda") { // handle lambda special-form
-    return handle_lambda(env);
-  }
-  else if(m_head.isSymbol() && m_head.asSymbol() == "apply") { // handle apply special-form
-    return handle_apply(env);
-  }
-  else if(m_head.isSymbol() && m_head.asSymbol() == "map") { // handle map special-form
-    return handle_map(env);
-  }
-  else if(m_head.isSymbol() && m_head.asSymbol() == "set-property") {
-    return handle_set_prop(env);
-  }
-  else if(m_head.isSymbol() && m_head.asSymbol() == "get-property") {
-    return handle_get_prop(env);
-  }
-  else if(m_head.isSymbol() && m_head.asSymbol() == "discrete-plot") {
-    return handle_discrete_plot(env);
-  }
-  else if(m_head.isSymbol() && m_head.asSymbol() == "continuous-plot") {
-    return handle_continuous_plot(env);
-  }
-  else { // else attempt to treat as procedure
-    std::vector<Expression> results;
-    for(Expression::IteratorType it = m_tail.begin(); it != m_tail.end(); ++it){
-      results.push_back(it->eval(env));
-    }
-    return apply(m_head, results, env);
-  }
+Expression::FormKind Expression::form() const noexcept {
+  return (m_form == UnresolvedForm) ? form_of(m_head) : m_form;
 }
 
+Expression Expression::eval(Environment & env) const {
+  return Evaluator(env).run(*this);
+}
 
-std::ostream & operator<<(std::ostream & out, const Expression & exp) {
+// the printed form of an Expression with no head and no tail
+static bool is_none(const Expression & exp) {
+  static const Atom none;
+  return (exp.head() == none) && exp.getTail().empty() && !exp.isHeadList();
+}
 
-  //std::cout << exp.head().isNone() << '\n';
-  if(exp == Expression() && !exp.isHeadList()) {
-    out << "NONE";
-    return out;
-  }
+// a folded constant prints as the expression it was folded from
+static const Expression & printed(const Expression & exp) {
+  return (exp.form() == Expression::ConstantForm) ? exp.getTail()[1] : exp;
+}
 
+// print the opening of a non-empty expression: its head and a separator
+static void print_open(std::ostream & out, const Expression & exp) {
   out << "(";
   out << exp.head();
-  bool begin = true; // To know when to add spaces to output
-  if(exp.head().isSymbol() && (exp.getTail() != std::vector<Expression>()))
+  if(exp.head().isSymbol() && !exp.getTail().empty())
     out << " ";
+}
 
-  for(auto e = exp.tailConstBegin(); e != exp.tailConstEnd(); ++e){
-    if(begin == false) // Kind of wonky but oh well
-      out << " ";
+// printing keeps an explicit stack of the expressions still open, with the
+// index of the next element of each to print
+std::ostream & operator<<(std::ostream & out, const Expression & root) {
 
-    out << *e;
-    begin = false;
+  const Expression & exp = printed(root);
+  if(is_none(exp)) {
+    out << "NONE";
+    return out;
   }
 
-  out << ")";
+  std::vector<std::pair<const Expression *, std::size_t> > open;
+  open.emplace_back(&exp, 0);
+  print_open(out, exp);
 
+  while(!open.empty()){
+    const Expression & parent = *open.back().first;
+    std::size_t & next = open.back().second;
 
+    if(next == parent.tailSize()){
+      out << ")";
+      open.pop_back();
+      continue;
+    }
+
+    if(next != 0) // Kind of wonky but oh well
+      out << " ";
+
+    // packed elements are printed without expanding the list
+    if(parent.numbers() != nullptr){
+      out << "(" << parent.numbers()->at(next++) << ")";
+      continue;
+    }
+
+    const Expression & e = printed(parent.getTail()[next++]);
+    if(is_none(e)){
+      out << "NONE";
+    }
+    else{
+      print_open(out, e);
+      open.emplace_back(&e, 0);
+    }
+  }
 
   return out;
 }
 
 bool Expression::operator==(const Expression & exp) const noexcept{
 
-  bool result = (m_head == exp.m_head);
+  // compare pairs of nodes from an explicit stack, stopping at the first
+  // difference
+  std::vector<std::pair<const Expression *, const Expression *> > pending;
+  pending.emplace_back(this, &exp);
 
-  result = result && (m_tail.size() == exp.m_tail.size());
+  while(!pending.empty()){
+    const Expression & left = *pending.back().first;
+    const Expression & right = *pending.back().second;
+    pending.pop_back();
 
-  if(result){
-    for(auto lefte = m_tail.begin(), righte = exp.m_tail.begin();
-  (lefte != m_tail.end()) && (righte != exp.m_tail.end());
-  ++lefte, ++righte){
-      result = result && (*lefte == *righte);
+    if(!(left.m_head == right.m_head) || (left.m_tail.size() != right.m_tail.size()))
+      return false;
+
+    for(std::size_t i = left.m_tail.size(); i > 0; --i){
+      pending.emplace_back(&left.m_tail[i - 1], &right.m_tail[i - 1]);
     }
   }
 
-  return result;
+  return true;
 }
 
 bool operator!=(const Expression & left, const Expression & right) noexcept{
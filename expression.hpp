@@ -9,9 +9,11 @@ Defines the Expression type and assiciated functions.
 #include <memory>
 #include <map>
 #include <atomic>
+#include <mutex>
 
 #include "token.hpp"
 #include "atom.hpp"
+#include "number_array.hpp"
 
 //std::atomic_bool interrupt_flag = ATOMIC_FLAG_INIT;
 
@@ -29,6 +31,22 @@ public:
 
   typedef std::vector<Expression>::const_iterator ConstIteratorType;
 
+  /*! \enum FormKind
+    \brief How eval dispatches a non-terminal expression, determined by its head.
+
+    The kind is resolved once per node by resolveForm (the parser does this
+    for every node it builds) and selects the evaluator's task for the node.
+   */
+  enum FormKind { UnresolvedForm, //< not yet resolved, computed on demand
+                  ProcedureForm,  //< ordinary procedure or lambda call
+                  BeginForm, DefineForm, LambdaForm, ApplyForm, MapForm,
+                  PMapForm,       //< map, with the calls spread over a thread pool
+                  SetPropertyForm, GetPropertyForm,
+                  DiscretePlotForm, ContinuousPlotForm,
+                  ConstantForm,   //< a call folded into its value (see optimize.hpp)
+                  NumFormKinds
+  };
+
   /// Default construct and Expression, whose type in NoneType
   Expression();
 
@@ -37,18 +55,67 @@ public:
   */
   Expression(const Atom & a);
 
+  /// Construct an Expression with given Atom as head an empty tail, moving it
+  Expression(Atom && a) noexcept;
+
   //Expression(const std::vector<Atom> & a);
 
-  /// deep-copy construct an expression (recursive)
+  /// copy construct an expression, sharing the tail with a (constant time)
   Expression(const Expression & a);
 
+  /// move construct an expression, leaving a empty
+  Expression(Expression && a) noexcept;
+
+  /// destroy the expression, releasing deep trees without recursion
+  ~Expression();
+
   // Constructor for list
   Expression(const std::vector<Expression> & a);
 
-  /// deep-copy assign an expression  (recursive)
+  // Constructor for list, taking ownership of the elements
+  Expression(std::vector<Expression> && a);
+
+  /*! Build a list from its elements. When every element is a plain Number,
+    or every element a plain Complex, the list is packed into a NumberArray.
+    \param elements the elements of the list
+  */
+  static Expression makeList(std::vector<Expression> && elements);
+
+  /// Build a packed list holding numbers
+  static Expression makeList(NumberArray && numbers);
+
+  /*! \class ListBuilder
+    \brief Collects the elements of a list one at a time.
+
+    Elements are packed as they arrive while they are all Numbers (or all
+    Complex numbers), so building a long numeric list (the result of a map)
+    never holds an Expression per element.
+  */
+  class ListBuilder {
+  public:
+
+    /// the number of elements expected, a hint
+    void reserve(std::size_t n) { expected = n; }
+
+    /// add an element to the end of the list
+    void push_back(Expression && element);
+
+    /// the list of the elements so far, leaving the builder empty
+    Expression build();
+
+  private:
+    std::size_t expected = 0;
+    NumberArray packed;
+    std::vector<Expression> elements; // all of them, once one is not packable
+  };
+
+  /// copy assign an expression, sharing the tail with a (constant time)
   Expression & operator=(const Expression & a);
 
-  /// return a reference to the head Atom
+  /// move assign an expression, leaving a empty
+  Expression & operator=(Expression && a) noexcept;
+
+  /// return a reference to the head Atom (clears the resolved form)
   Atom & head();
 
   /// return a const-reference to the head Atom
@@ -69,17 +136,31 @@ public:
   /// append Expression to tail of the expression
   void append(const Expression& a);
 
+  /// append Expression to tail of the expression, moving it
+  void append(Expression&& a);
+
   /// return a pointer to the last expression in the tail, or nullptr
+  /// (unshares the tail first)
   Expression * tail();
 
   /// return a const-iterator to the beginning of tail
-  ConstIteratorType tailConstBegin() const noexcept;
+  ConstIteratorType tailConstBegin() const;
 
   /// return a const-iterator to the tail end
-  ConstIteratorType tailConstEnd() const noexcept;
+  ConstIteratorType tailConstEnd() const;
+
+  /// return a const-reference to the tail of the expression, no copy is made
+  /// (a packed tail is expanded into Expressions once, on first request)
+  const std::vector<Expression> & getTail() const;
+
+  /// number of expressions in the tail, without expanding a packed tail
+  std::size_t tailSize() const noexcept;
+
+  /// expression i of the tail, without expanding a packed tail
+  Expression tailAt(std::size_t i) const;
 
-  // Returns the tail of the expression
-  std::vector<Expression> getTail() const;
+  /// the packed numbers of the tail, or nullptr if the tail is not packed
+  const NumberArray * numbers() const noexcept;
 
   // Clear the tail, used in discrete-plot
   void clearTail() {
@@ -101,8 +182,25 @@ public:
   /// convienience member to determine if head atom is a lambda
   bool isHeadLambda() const noexcept {return m_head.isLambda();};
 
-  /// Evaluate expression using a post-order traversal (recursive)
-  Expression eval(Environment & env);
+  /*! Evaluate expression using a post-order traversal. The traversal keeps
+    its state on an explicit stack (see Evaluator), so the depth of the AST
+    and of lambda recursion is bounded by the evaluation depth limit, not
+    by the native stack.
+    \throws SemanticError when a semantic error is encountered, including
+    exceeding the evaluation depth limit
+  */
+  Expression eval(Environment & env) const;
+
+  /*! Build the lambda value for (lambda params body): a Lambda-headed
+    expression whose tail is the argument list and the (shared) body.
+  */
+  static Expression makeLambda(const Expression & params, const Expression & body);
+
+  /// cache the special-form kind of the head so eval need not compare names
+  void resolveForm() noexcept;
+
+  /// return the special-form kind of the head (resolving if needed)
+  FormKind form() const noexcept;
 
   // Helper function to add property to list
   void add_property(const std::string & key, Expression & value);
@@ -112,51 +210,90 @@ public:
   /// Method for creating a copy of the environment for lambda functions
   //Expression shadow_copy(Atom & op, std::vector<Expression> & args, Environment & env);
 
-  Expression apply(Atom & op, std::vector<Expression> & args, Environment & env);
+  /// apply the procedure or lambda named by op to evaluated arguments
+  Expression apply(const Atom & op, const std::vector<Expression> & args, Environment & env) const;
 
-  /// equality comparison for two expressions (recursive)
+  /// equality comparison for two expressions (iterative)
   bool operator==(const Expression & exp) const noexcept;
 
   std::map<std::string, Expression> property_list;
 
 private:
 
+  friend class Evaluator;
+
   // the head of the expression
   Atom m_head;
 
+  /* Copy-on-write handle to the tail vector. Copies of an Expression share
+     one immutable vector, so copying a large list is constant time; the
+     first mutation through a shared handle clones the (shallow) vector.
+
+     A tail of numbers may instead be packed, held as a shared NumberArray.
+     get() expands a packed tail into Expressions once, under a once_flag in
+     the shared block, so every copy sees the same expansion; mutate()
+     replaces the packed tail by an ordinary vector. */
+  class Tail {
+  public:
+    typedef std::vector<Expression> VectorType;
+
+    const VectorType & get() const;
+    VectorType & mutate();
+
+    std::size_t size() const noexcept {
+      return m_ptr ? m_ptr->size() : (m_packed ? m_packed->numbers.size() : 0);
+    }
+    bool empty() const noexcept { return size() == 0; }
+    const Expression & operator[](std::size_t i) const { return get()[i]; }
+    bool unique() const noexcept { return m_ptr && (m_ptr.use_count() == 1); }
+    VectorType::const_iterator begin() const { return get().begin(); }
+    VectorType::const_iterator end() const { return get().end(); }
+    void clear() noexcept { m_ptr.reset(); m_packed.reset(); }
+
+    const NumberArray * numbers() const noexcept {
+      return m_packed ? &m_packed->numbers : nullptr;
+    }
+    void pack(NumberArray && numbers);
+
+  private:
+    struct Packed {
+      explicit Packed(NumberArray && n): numbers(std::move(n)) {}
+
+      NumberArray numbers;
+      std::once_flag expand_once;
+      VectorType expanded;
+    };
+
+    std::shared_ptr<VectorType> m_ptr;
+    std::shared_ptr<Packed> m_packed;
+  };
+
   // the tail list is expressed as a vector for access efficiency
   // and cache coherence, at the cost of wasted memory.
-  std::vector<Expression> m_tail;
-
-  // convenience typedef
-  typedef std::vector<Expression>::iterator IteratorType;
+  Tail m_tail;
 
   bool isList;
 
-  // internal helper methods
-  Expression handle_lookup(const Atom & head, const Environment & env);
-  Expression handle_define(Environment & env);
-  Expression handle_begin(Environment & env);
+  // resolved special-form kind of m_head, see resolveForm
+  FormKind m_form;
 
-  // Implementation special form for handling lambda functions
-  Expression handle_lambda(Environment & env);
-  Expression handle_apply(Environment & env);
-  Expression handle_map(Environment & env);
+  // internal helper methods, for the evaluator
+  Expression handle_lookup(const Atom & head, const Environment & env) const;
 
-  // Implementation of special forms for setting/getting properties for an expression
-  Expression handle_set_prop(Environment & env);
-  Expression handle_get_prop(Environment & env);
+  // Implementation special form for handling lambda functions
+  Expression handle_lambda(Environment & env) const;
 
   // Implemented for plots in the GUI
-  Expression handle_discrete_plot(Environment & env);
-  Expression handle_continuous_plot(Environment & env);
+  Expression handle_discrete_plot(Environment & env) const;
+  Expression handle_continuous_plot(Environment & env) const;
 
 };
 
+
 /// Render expression to output stream
 std::ostream & operator<<(std::ostream & out, const Expression & exp);
 
-/// inequality comparison for two expressions (recursive)
+/// inequality comparison for two expressions (iterative)
 bool operator!=(const Expression & left, const Expression & right) noexcept;
 
 #endif
@@ -1,5 +1,7 @@
 #include "catch.hpp"
 
+#include <sstream>
+
 #include "expression.hpp"
 
 TEST_CASE( "Test default expression", "[expression]" ) {
@@ -28,3 +30,193 @@ TEST_CASE( "Test symbol expression", "[expression]" ) {
   REQUIRE(!exp.isHeadNumber());
   REQUIRE(exp.isHeadSymbol());
 }
+
+TEST_CASE( "Test special-form resolution", "[expression]" ) {
+
+  Expression begin(Atom("begin"));
+  REQUIRE(begin.form() == Expression::BeginForm);
+
+  Expression call(Atom("+"));
+  REQUIRE(call.form() == Expression::ProcedureForm);
+
+  Expression number(1.0);
+  REQUIRE(number.form() == Expression::ProcedureForm);
+
+  Expression plot(Atom("discrete-plot"));
+  plot.resolveForm();
+  REQUIRE(plot.form() == Expression::DiscretePlotForm);
+
+  plot.setHead(Atom("map"));
+  REQUIRE(plot.form() == Expression::MapForm);
+}
+
+TEST_CASE( "Test copy-on-write tails", "[expression]" ) {
+
+  Expression list;
+  list.setHeadList();
+  list.append(Atom(1.0));
+  list.append(Atom(2.0));
+
+  Expression copy(list);
+  REQUIRE(copy.isHeadList());
+  REQUIRE(&copy.getTail() == &list.getTail());
+
+  // mutating the copy must not be visible through the original
+  copy.append(Atom(3.0));
+  REQUIRE(copy.getTail().size() == 3);
+  REQUIRE(list.getTail().size() == 2);
+  REQUIRE(&copy.getTail() != &list.getTail());
+}
+
+TEST_CASE( "Test move construction and assignment", "[expression]" ) {
+
+  Expression list;
+  list.setHeadList();
+  list.append(Atom("a"));
+  list.append(Atom(2.0));
+  const std::vector<Expression> * storage = &list.getTail();
+
+  Expression moved(std::move(list));
+  REQUIRE(moved.isHeadList());
+  REQUIRE(moved.getTail().size() == 2);
+  REQUIRE(&moved.getTail() == storage);
+  REQUIRE(list.getTail().empty());
+
+  Expression assigned;
+  assigned = std::move(moved);
+  REQUIRE(assigned.getTail().size() == 2);
+  REQUIRE(assigned.getTail()[0] == Expression(Atom("a")));
+}
+
+TEST_CASE( "Test deep expressions compare and release iteratively", "[expression]" ) {
+
+  const std::size_t depth = 200000;
+
+  Expression left(Atom("a")), right(Atom("a"));
+  Expression * l = &left;
+  Expression * r = &right;
+  for(std::size_t i = 0; i < depth; ++i){
+    l->append(Atom("a"));
+    l = l->tail();
+    r->append(Atom("a"));
+    r = r->tail();
+  }
+
+  REQUIRE(left == right);
+
+  r->append(Atom("b"));
+  REQUIRE(left != right);
+
+  // both trees are destroyed here without recursing per level
+}
+
+TEST_CASE( "Test packed numeric lists", "[expression]" ) {
+
+  std::vector<Expression> numbers = {Expression(1.), Expression(2.), Expression(3.)};
+  Expression generic(numbers);
+  generic.setHeadList();
+
+  Expression packed = Expression::makeList(std::vector<Expression>(numbers));
+  REQUIRE(packed.isHeadList());
+  REQUIRE(packed.numbers() != nullptr);
+  REQUIRE(packed.tailSize() == 3);
+  REQUIRE(packed.tailAt(1) == Expression(2.));
+
+  {
+    INFO("packing is invisible to printing");
+    std::ostringstream left, right;
+    left << packed;
+    right << generic;
+    REQUIRE(left.str() == right.str());
+  }
+
+  {
+    INFO("expansion is shared by copies and mutation unpacks");
+    Expression copy(packed);
+    REQUIRE(&copy.getTail() == &packed.getTail());
+    REQUIRE(packed.getTail()[2] == Expression(3.));
+
+    copy.append(Atom("a"));
+    REQUIRE(copy.numbers() == nullptr);
+    REQUIRE(copy.tailSize() == 4);
+    REQUIRE(packed.tailSize() == 3);
+  }
+
+  {
+    INFO("heterogeneous elements are not packed");
+    std::vector<Expression> mixed = {Expression(1.), Expression(std::complex<double>(0, 1))};
+    REQUIRE(Expression::makeList(std::move(mixed)).numbers() == nullptr);
+
+    std::vector<Expression> symbols = {Expression(1.), Expression(Atom("a"))};
+    REQUIRE(Expression::makeList(std::move(symbols)).numbers() == nullptr);
+
+    std::vector<Expression> complexes = {Expression(std::complex<double>(0, 1))};
+    Expression c = Expression::makeList(std::move(complexes));
+    REQUIRE(c.numbers() != nullptr);
+    REQUIRE(c.numbers()->isComplex());
+  }
+}
+
+TEST_CASE( "Test sequence arrays", "[expression]" ) {
+
+  NumberArray sequence = NumberArray::sequence(1., 0.5, 4);
+  REQUIRE(sequence.isSequence());
+  REQUIRE(sequence.size() == 4);
+  REQUIRE(sequence.at(3) == Atom(2.5));
+
+  {
+    INFO("a slice reads the same elements as the sequence");
+    NumberArray rest = sequence.slice(1);
+    REQUIRE(rest.isSequence());
+    REQUIRE(rest.size() == 3);
+    REQUIRE(rest.at(0) == sequence.at(1));
+    REQUIRE(sequence.slice(4).empty());
+  }
+
+  {
+    INFO("reading real() stores the elements, modifying a copy leaves the original");
+    REQUIRE(sequence.real() == std::vector<double>({1., 1.5, 2., 2.5}));
+
+    NumberArray copy = sequence;
+    copy.push_back(Atom(3.));
+    REQUIRE(!copy.isSequence());
+    REQUIRE(copy.size() == 5);
+    REQUIRE(sequence.isSequence());
+    REQUIRE(sequence.size() == 4);
+  }
+}
+
+TEST_CASE( "Test building lists", "[expression]" ) {
+
+  {
+    INFO("numbers are packed as they arrive");
+    Expression::ListBuilder builder;
+    builder.push_back(Expression(1.));
+    builder.push_back(Expression(2.));
+    Expression list = builder.build();
+    REQUIRE(list.isHeadList());
+    REQUIRE(list.numbers() != nullptr);
+    REQUIRE(list.tailSize() == 2);
+  }
+
+  {
+    INFO("a different kind unpacks the elements so far");
+    Expression::ListBuilder builder;
+    builder.push_back(Expression(1.));
+    builder.push_back(Expression(Atom("a")));
+    builder.push_back(Expression(3.));
+    Expression list = builder.build();
+    REQUIRE(list.numbers() == nullptr);
+    REQUIRE(list.tailSize() == 3);
+    REQUIRE(list.getTail()[0] == Expression(1.));
+    REQUIRE(list.getTail()[1] == Expression(Atom("a")));
+  }
+
+  {
+    INFO("an empty builder gives the empty list");
+    Expression::ListBuilder builder;
+    Expression list = builder.build();
+    REQUIRE(list.isHeadList());
+    REQUIRE(list.tailSize() == 0);
+  }
+}
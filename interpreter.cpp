@@ -2,26 +2,135 @@
 
 // system includes
 #include <stdexcept>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 
 // module includes
+#include "alloc_stats.hpp"
 #include "token.hpp"
 #include "parse.hpp"
 #include "expression.hpp"
 #include "environment.hpp"
 #include "semantic_error.hpp"
+#include "bytecode.hpp"
+#include "startup_config.hpp"
+
+Interpreter::Interpreter(const Environment & base): env(base) {}
+
+const Environment & Interpreter::startupEnvironment(){
+
+  // evaluated once, by the first caller; a file that cannot be read or
+  // evaluated leaves the built-ins and whatever it defined before failing
+  static const Environment startup = [](){
+    Interpreter interp;
+    std::ifstream file(STARTUP_FILE);
+    if(interp.parseStream(file)){
+      try{
+        interp.evaluate();
+      }
+      catch(const SemanticError &){}
+    }
+    return interp.env;
+  }();
+
+  return startup;
+}
+
+const Environment & Interpreter::environment() const noexcept{
+  return env;
+}
 
 bool Interpreter::parseStream(std::istream & expression) noexcept{
 
-  TokenSequenceType tokens = tokenize(expression);
+  // lex from one contiguous buffer rather than character by character
+  std::string buffer;
+  if(expression.rdbuf() != nullptr){
+    std::ostringstream contents;
+    contents << expression.rdbuf();
+    buffer = contents.str();
+  }
+
+  return parseBuffer(buffer.data(), buffer.size());
+};
 
-  ast = parse(tokens);
+bool Interpreter::parseBuffer(const char * data, std::size_t size) noexcept{
+
+  ast = parse(data, size);
 
   return (ast != Expression());
-};
+}
+
+
+void Interpreter::setEvalMode(EvalMode m) noexcept{
+  mode = m;
+}
+
+Interpreter::EvalMode Interpreter::evalMode() const noexcept{
+  return mode;
+}
 
+void Interpreter::setMaxDepth(std::size_t limit) noexcept{
+  max_depth = limit;
+}
+
+std::size_t Interpreter::maxDepth() const noexcept{
+  return max_depth;
+}
+
+void Interpreter::setFolding(bool enabled) noexcept{
+  fold = enabled;
+}
+
+bool Interpreter::folding() const noexcept{
+  return fold;
+}
+
+const FoldStats & Interpreter::foldStats() const noexcept{
+  return fold_stats;
+}
+
+void Interpreter::setProfiler(Profiler * profiler) noexcept{
+  profiling = profiler;
+}
+
+Profiler * Interpreter::profiler() const noexcept{
+  return profiling;
+}
+
+CancelToken & Interpreter::cancelToken() const noexcept{
+  return *cancel_token;
+}
+
+void Interpreter::setTimeBudget(std::chrono::milliseconds budget) noexcept{
+  time_budget = budget;
+}
+
+std::chrono::milliseconds Interpreter::timeBudget() const noexcept{
+  return time_budget;
+}
 
 Expression Interpreter::evaluate(){
   //std::cout << ast.head().isSymbol() << '\n';
-  return ast.eval(env);
+  EvalContext::DepthLimitScope limited(max_depth);
+  AllocScope allocs(EvalAllocs);
+
+  cancel_token->reset();
+  if(time_budget.count() > 0)
+    cancel_token->setDeadline(CancelToken::Clock::now() + time_budget);
+  else
+    cancel_token->clearDeadline();
+  CancelToken::Scope cancellable(cancel_token.get());
+
+  // folded against the environment as it is now, the AST itself is kept
+  // as parsed
+  Expression program = fold ? fold_constants(ast, env, fold_stats) : ast;
+
+  Profiler::Scope profile(profiling);
+
+  if(mode == Bytecode){
+    return vm.run(compile(program), env);
+  }
+
+  return program.eval(env);
 }
@@ -8,12 +8,19 @@ It maintains an environment during evaluation.
 #define INTERPRETER_HPP
 
 // system includes
+#include <chrono>
 #include <istream>
+#include <memory>
 #include <string>
 
 // module includes
+#include "cancel_token.hpp"
 #include "environment.hpp"
 #include "expression.hpp"
+#include "eval_context.hpp"
+#include "optimize.hpp"
+#include "profiler.hpp"
+#include "vm.hpp"
 
 
 /*! \class Interpreter
@@ -26,23 +33,101 @@ The eval method updates Environment and returns last result.
 class Interpreter {
 public:
 
+  /// Construct an interpreter with the default environment
+  Interpreter() = default;
+
+  /*! Construct an interpreter whose environment starts as a copy of base,
+    sharing its bindings until either defines a symbol, so in constant time
+    \param base the environment to start from
+   */
+  explicit Interpreter(const Environment & base);
+
+  /*! The environment left by evaluating the startup file, made the first
+    time it is asked for; start interpreters from it instead of evaluating
+    the file again
+   */
+  static const Environment & startupEnvironment();
+
+  /// The environment evaluate defines in
+  const Environment & environment() const noexcept;
+
+  /// How evaluate executes the AST
+  enum EvalMode {
+    TreeWalk, //< walk the AST with Expression::eval (the default)
+    Bytecode  //< compile to bytecode and run it on the VirtualMachine
+  };
+
+  /*! Select how evaluate executes the AST
+    \param mode the evaluation mode
+   */
+  void setEvalMode(EvalMode mode) noexcept;
+
+  /// Get the current evaluation mode
+  EvalMode evalMode() const noexcept;
+
+  /*! Limit how deep evaluation may go before raising a SemanticError
+    \param limit the maximum number of active evaluation frames
+   */
+  void setMaxDepth(std::size_t limit) noexcept;
+
+  /// Get the evaluation depth limit
+  std::size_t maxDepth() const noexcept;
+
+  /*! Select whether evaluate folds constant calls first (see
+    fold_constants), on by default
+    \param enabled true to fold
+   */
+  void setFolding(bool enabled) noexcept;
+
+  /// Get whether evaluate folds constant calls first
+  bool folding() const noexcept;
+
+  /// What folding has done over all evaluations so far
+  const FoldStats & foldStats() const noexcept;
+
+  /*! Time evaluate with a profiler, or stop when profiler is null. The
+    profiler must outlive the evaluations it times.
+    \param profiler the profiler, accumulating over evaluations
+   */
+  void setProfiler(Profiler * profiler) noexcept;
+
+  /// Get the profiler timing evaluate, null when there is none
+  Profiler * profiler() const noexcept;
+
+  /*! The token that interrupts this interpreter's evaluations. Copies of
+    the interpreter share it, so a copy evaluating on another thread (the
+    kernel thread) is interrupted through the original. A request made
+    while no evaluation runs is discarded by the next evaluate.
+   */
+  CancelToken & cancelToken() const noexcept;
+
+  /*! Limit how long each evaluate may run before raising a SemanticError
+    \param budget the time limit, zero for none (the default)
+   */
+  void setTimeBudget(std::chrono::milliseconds budget) noexcept;
+
+  /// Get the time limit on each evaluate, zero when there is none
+  std::chrono::milliseconds timeBudget() const noexcept;
+
   /*! Parse into an internal Expression from a stream
     \param expression the raw text stream repreenting the candidate expression
     \return true on successful parsing
    */
   bool parseStream(std::istream &expression) noexcept;
 
-  /*! Evaluate the Expression by walking the tree, returning the result.
+  /*! Parse into an internal Expression from a contiguous buffer
+    \param data the first character of the program text
+    \param size the number of characters of program text
+    \return true on successful parsing
+   */
+  bool parseBuffer(const char * data, std::size_t size) noexcept;
+
+  /*! Evaluate the Expression, returning the result.
     \return the Expression resulting from the evaluation in the current environment
     \throws SemanticError when a semantic error is encountered
    */
   Expression evaluate();
 
-  // Set flag for an interrupt
-  /*void setFlag() {
-    env.setFlag();
-  };*/
-
 private:
 
   // the environment
@@ -50,6 +135,26 @@ private:
 
   // the AST
   Expression ast;
+
+  // the evaluation mode
+  EvalMode mode = TreeWalk;
+
+  // the evaluation depth limit
+  std::size_t max_depth = EvalContext::DefaultMaxDepth;
+
+  // constant folding before evaluation, and its running totals
+  bool fold = true;
+  FoldStats fold_stats;
+
+  // the profiler timing evaluations, if any
+  Profiler * profiling = nullptr;
+
+  // interrupts evaluations, shared with copies; and their time limit
+  std::shared_ptr<CancelToken> cancel_token = std::make_shared<CancelToken>();
+  std::chrono::milliseconds time_budget{0};
+
+  // the bytecode machine, kept across evaluations for its lambda cache
+  VirtualMachine vm;
 };
 
 #endif
@@ -8,6 +8,8 @@
 #include "semantic_error.hpp"
 #include "interpreter.hpp"
 #include "expression.hpp"
+#include "eval_context.hpp"
+#include "thread_pool.hpp"
 
 Expression run(const std::string & program){
 
@@ -686,3 +688,270 @@ TEST_CASE("Testing error handling for join", "[interpreter]") {
   REQUIRE(interp.parseStream(iss3));
   REQUIRE_NOTHROW(result = interp.evaluate());
 }
+
+TEST_CASE("Testing deeply nested programs", "[interpreter]") {
+
+  // deeper than the native stack would allow a recursive evaluator
+  const std::size_t depth = 50000;
+
+  std::string program;
+  for(std::size_t i = 0; i < depth; ++i) program += "(- 1 ";
+  program += "0";
+  program += std::string(depth, ')');
+
+  Expression result = run(program);
+  REQUIRE(result == Expression(0.));
+
+  std::string nested;
+  for(std::size_t i = 0; i < depth; ++i) nested += "(list ";
+  nested += "0";
+  nested += std::string(depth, ')');
+
+  Expression list = run(nested);
+  REQUIRE(list.isHeadList());
+  REQUIRE(list.getTail().size() == 1);
+
+  std::ostringstream out;
+  out << list;
+  REQUIRE(out.str() == std::string(depth, '(') + "(0)" + std::string(depth, ')'));
+}
+
+TEST_CASE("Testing the evaluation depth limit", "[interpreter]") {
+
+  // the recursive call is not in tail position
+  std::string program = "(begin (define f (lambda (x) (+ 1 (f x)))) (f 1))";
+  std::istringstream iss(program);
+
+  Interpreter interp;
+  REQUIRE(interp.maxDepth() == EvalContext::DefaultMaxDepth);
+  interp.setMaxDepth(1000);
+
+  REQUIRE(interp.parseStream(iss));
+  REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+
+  // the depth is released after the error
+  std::istringstream iss2("(+ 1 (+ 2 3))");
+  REQUIRE(interp.parseStream(iss2));
+  REQUIRE(interp.evaluate() == Expression(6.));
+  REQUIRE(EvalContext::current().depth() == 0);
+
+  std::string deep;
+  for(std::size_t i = 0; i < 2000; ++i) deep += "(+ 1 ";
+  deep += "0";
+  deep += std::string(2000, ')');
+
+  std::istringstream iss3(deep);
+  REQUIRE(interp.parseStream(iss3));
+  REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+
+  // the limit holds while evaluating, on every thread evaluating, and the
+  // threads' own limits come back after
+  std::istringstream iss4("(pmap f (list 1 2 3 4))");
+  REQUIRE(interp.parseStream(iss4));
+  REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+  REQUIRE(EvalContext::current().maxDepth() == EvalContext::DefaultMaxDepth);
+
+  std::vector<std::size_t> limits(64);
+  ThreadPool::shared().parallel_for(limits.size(), [&](std::size_t first, std::size_t last){
+    for(std::size_t i = first; i < last; ++i) limits[i] = EvalContext::current().maxDepth();
+  });
+  for(auto limit : limits) REQUIRE(limit == EvalContext::DefaultMaxDepth);
+}
+
+TEST_CASE("Testing tail calls run in constant depth", "[interpreter]") {
+
+  // there is no conditional, so the recursion ends when rest fails on the
+  // empty list, far deeper than the depth limit allows without tail calls
+  std::vector<std::string> programs = {
+    "(begin (define f (lambda (l) (f (rest l)))) (f (range 0 1000 1)))",
+    "(begin (define f (lambda (l) (g (rest l)))) "
+    "(define g (lambda (m) (begin (length m) (f m)))) (f (range 0 1000 1)))"
+  };
+
+  for(auto & program : programs){
+    for(auto mode : {Interpreter::TreeWalk, Interpreter::Bytecode}){
+      std::istringstream iss(program);
+
+      Interpreter interp;
+      interp.setEvalMode(mode);
+      interp.setMaxDepth(300);
+
+      REQUIRE(interp.parseStream(iss));
+      try{
+        interp.evaluate();
+        FAIL("recursion did not end");
+      }
+      catch(const SemanticError & ex){
+        INFO(program);
+        REQUIRE(std::string(ex.what()) == "Error in call to rest: empty list.");
+      }
+    }
+  }
+}
+
+TEST_CASE("Testing list procedures on packed lists", "[interpreter]") {
+
+  // lists never compare equal, so compare them as printed
+  auto printed = [](const std::string & program){
+    std::ostringstream out;
+    out << run(program);
+    return out.str();
+  };
+
+  {
+    INFO("range, list and map produce packed lists");
+    REQUIRE(run("(range 0 3 1)").numbers() != nullptr);
+    REQUIRE(run("(list 1 2 3)").numbers() != nullptr);
+    REQUIRE(run("(begin (define f (lambda (x) (* 2 x))) (map f (range 0 3 1)))").numbers() != nullptr);
+    REQUIRE(run("(list 1 (list 2))").numbers() == nullptr);
+  }
+
+  {
+    INFO("list procedures give the same values packed or not");
+    REQUIRE(run("(first (range 5 9 1))") == Expression(5.));
+    REQUIRE(run("(length (range 0 9 1))") == Expression(10.));
+    REQUIRE(printed("(rest (range 0 3 1))") == printed("(list 1 2 3)"));
+    REQUIRE(printed("(rest (list 1))") == printed("(list)"));
+    REQUIRE(printed("(append (range 0 2 1) 3)") == printed("(list 0 1 2 3)"));
+    REQUIRE(printed("(append (list) 3)") == printed("(list 3)"));
+    REQUIRE(printed("(join (range 0 1 1) (list 2 3))") == printed("(list 0 1 2 3)"));
+    REQUIRE(run("(join (list) (range 0 1 1))").numbers() != nullptr);
+  }
+
+  {
+    INFO("range sums fractional steps, keeping their rounding");
+    REQUIRE(run("(length (range 0 1 0.1))") == Expression(11.));
+    REQUIRE(run("(length (range 0 1 0.01))") == Expression(100.));
+    REQUIRE(run("(length (range 0 100 0.01))") == Expression(10000.));
+    REQUIRE(run("(range 0 1 0.1)").numbers()->at(3).asNumber() == 0.1 + 0.1 + 0.1);
+    REQUIRE(run("(range 5 10 1)").numbers()->isSequence());
+    REQUIRE(run("(length (range 0 0.3 0.1))") == Expression(3.));
+    REQUIRE(run("(length (range 0 1000000000000 1))") == Expression(1e12 + 1));
+    REQUIRE(printed("(rest (range 0 1 0.5))") == printed("(list 0.5 1)"));
+    REQUIRE(printed("(append (range 0 1 1) 2)") == printed("(list 0 1 2)"));
+
+    Interpreter interp;
+    std::istringstream program("(range 0 1e20 1)");
+    REQUIRE(interp.parseStream(program));
+    try{
+      interp.evaluate();
+      FAIL("range did not throw");
+    }
+    catch(const SemanticError & ex){
+      REQUIRE(std::string(ex.what()) == "Error in call to range: too many elements.");
+    }
+  }
+
+  {
+    INFO("mixing kinds falls back to a generic list");
+    Expression mixed = run("(append (range 0 1 1) I)");
+    REQUIRE(mixed.numbers() == nullptr);
+    REQUIRE(mixed.tailSize() == 3);
+    REQUIRE(mixed.getTail()[2].isHeadComplex());
+
+    Expression joined = run("(join (list 1) (list I))");
+    REQUIRE(joined.numbers() == nullptr);
+    REQUIRE(joined.getTail()[0].isHeadNumber());
+  }
+}
+
+TEST_CASE("Testing arithmetic broadcast over lists", "[interpreter]") {
+
+  auto printed = [](const std::string & program){
+    std::ostringstream out;
+    out << run(program);
+    return out.str();
+  };
+
+  {
+    INFO("numbers and packed lists combine element-wise");
+    REQUIRE(printed("(+ (list 1 2) 3)") == "((4) (5))");
+    REQUIRE(printed("(* 2 (range 0 2 1) (list 1 2 3))") == "((0) (4) (12))");
+    REQUIRE(printed("(- (list 1 2))") == "((-1) (-2))");
+    REQUIRE(printed("(- 10 (list 1 2))") == "((9) (8))");
+    REQUIRE(printed("(/ (list 1 2))") == "((1) (0.5))");
+    REQUIRE(printed("(/ (list 1 2) 2)") == "((0.5) (1))");
+    REQUIRE(printed("(^ (list 2 3) 2)") == "((4) (9))");
+    REQUIRE(printed("(sqrt (list 4 9))") == "((2) (3))");
+    REQUIRE(printed("(ln (list 1))") == "((0))");
+    REQUIRE(printed("(sin (list 0))") == "((0))");
+    REQUIRE(printed("(cos (list 0))") == "((1))");
+    REQUIRE(printed("(tan (list 0))") == "((0))");
+    REQUIRE(run("(+ (range 0 99 1) 1)").numbers() != nullptr);
+  }
+
+  {
+    INFO("other elements fall back to the scalar procedure");
+    REQUIRE(printed("(sqrt (list 4 -4))") == "((2) (0,2))");
+    REQUIRE(printed("(+ (list I 2) 1)") == "((1,1) (3))");
+    REQUIRE(printed("(* (list (list 1 2) 3) 2)") == "(((2) (4)) (6))");
+  }
+
+  {
+    INFO("errors are those of the scalar procedures");
+    Interpreter interp;
+    for(auto program : {"(+ (list 1 2) (list 1))", "(ln (list 1 0))", "(+ (list 1 a) 1)",
+                        "(- (list 1) 1 2)"}){
+      std::istringstream iss(program);
+      REQUIRE(interp.parseStream(iss));
+      REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+    }
+  }
+}
+
+TEST_CASE("Testing pmap matches map", "[interpreter]") {
+
+  auto outcome = [](Interpreter & interp, const std::string & program){
+    std::istringstream iss(program);
+    REQUIRE(interp.parseStream(iss));
+
+    std::ostringstream out;
+    try{
+      out << interp.evaluate();
+    }
+    catch(const SemanticError & ex){
+      out << "error: " << ex.what();
+    }
+    return out.str();
+  };
+
+  Interpreter interp;
+  outcome(interp, "(define y 2)");
+  outcome(interp, "(define f (lambda (x) (+ (* x x) y)))");
+  outcome(interp, "(define g (lambda (x) (if-bad x)))");
+  outcome(interp, "(define h (lambda (x) (pmap f (range 0 x 1))))");
+
+  for(auto body : {"f (range 0 999 1)", "f (list)", "f (list 1 I)", "sqrt (list 4 9 -1)",
+                   "+ (list 1 (list 2))", "g (range 0 999 1)", "h (list 1 5 9)",
+                   "nothing (list 1)", "f 1", "(lambda (x) (- x)) (list 1 2)"}){
+    INFO(body);
+    REQUIRE(outcome(interp, std::string("(pmap ") + body + ")") ==
+            outcome(interp, std::string("(map ") + body + ")"));
+  }
+
+  // definitions inside the mapped lambda stay in its own frame
+  outcome(interp, "(define k (lambda (x) (begin (define z x) z)))");
+  REQUIRE(outcome(interp, "(pmap k (list 1 2))") == "((1) (2))");
+  REQUIRE(outcome(interp, "(z)").find("error") == 0);
+}
+
+TEST_CASE("Testing interpreters started from the startup environment", "[interpreter]") {
+
+  const Environment & startup = Interpreter::startupEnvironment();
+  REQUIRE(&startup == &Interpreter::startupEnvironment());
+
+  Interpreter a(startup), b(startup);
+  REQUIRE(a.environment().shares_bindings(startup));
+
+  std::istringstream point("(define p (make-point 1 2))");
+  REQUIRE(a.parseStream(point));
+  REQUIRE_NOTHROW(a.evaluate());
+  REQUIRE(!a.environment().shares_bindings(startup));
+
+  // b, and later interpreters, do not see a's definition
+  std::istringstream lookup("(p)");
+  REQUIRE(b.parseStream(lookup));
+  REQUIRE_THROWS_AS(b.evaluate(), SemanticError);
+  REQUIRE(b.environment().shares_bindings(startup));
+  REQUIRE(!startup.is_exp(Atom("p")));
+}
@@ -4,9 +4,12 @@
 
 #include <string>
 #include <iostream>
+#include <sstream>
+#include <utility>
 
 #include "interpreter.hpp"
 #include "thread_safe_queue.hpp"
+#include "spsc_queue.hpp"
 #include "semantic_error.hpp"
 
 extern bool interpRestart;
@@ -16,8 +19,8 @@ class InterpreterThread {
 private:
   Interpreter interp;
 
-  ThreadSafeQueue<std::string>* inputQueuePtr;
-  ThreadSafeQueue<output_type>* outputQueuePtr;
+  SpscQueue<std::string>* inputQueuePtr;
+  SpscQueue<output_type>* outputQueuePtr;
 
 public:
 
@@ -27,60 +30,49 @@ public:
     interp = newInterp;
   }
 
-  InterpreterThread(ThreadSafeQueue<std::string>* input_queue_ptr, ThreadSafeQueue<output_type>* output_queue_ptr, Interpreter& interpreter) {
+  InterpreterThread(SpscQueue<std::string>* input_queue_ptr, SpscQueue<output_type>* output_queue_ptr, Interpreter& interpreter) {
     inputQueuePtr = input_queue_ptr;
     outputQueuePtr = output_queue_ptr;
     interp = interpreter;
     //interpRestart = false;
   };
 
-  // Event loop for interpreter thread
+  // Event loop for interpreter thread, asleep until a command is queued
   void operator()() {
     //install_handler();
+    std::string m;
     while(1) {
-      std::string m;
 
-      output_type toSend; // Object to send to output_queue
+      inputQueuePtr->wait_and_pop(m);
 
-      if(inputQueuePtr->try_pop(m)) {
+      if(m=="%stop" || m=="%reset" || m=="%exit")
+        break;
 
-        if(m=="%stop" || m=="%reset" || m=="%exit")
-          break;
+      output_type toSend; // Object to send to output_queue
 
-        /*if(m == "%interrupt") {
-          interp = Interpreter();
-          toSend.isError = true;
-          toSend.err_result = SemanticError(std::string("Error: interpreter kernel interrupted"));
-          outputQueuePtr->push(toSend);
-          continue;
-        }*/
+      /*if(m == "%interrupt") {
+        interp = Interpreter();
+        outputQueuePtr->push(output_type::failure("Error: interpreter kernel interrupted"));
+        continue;
+      }*/
 
-        //std::cout << "Flag status: " << interrupt_flag << '\n';
+      //std::cout << "Flag status: " << interrupt_flag << '\n';
 
-        std::istringstream expression(m);
+      std::istringstream expression(m);
 
-        if(!interp.parseStream(expression)) {
-          toSend.isError = true;
-          toSend.err_result = SemanticError(std::string("Error: Invalid Expression. Could not parse."));
-          outputQueuePtr->push(toSend);
-          // transport in the output queue that you sent an expression or an error
+      if(!interp.parseStream(expression)) {
+        toSend = output_type::failure("Error: Invalid Expression. Could not parse.");
+        // transport in the output queue that you sent an expression or an error
+      }
+      else{
+        try{
+          toSend = output_type::result(interp.evaluate());
         }
-        else{
-          try{
-            Expression exp = interp.evaluate();
-            toSend.isError = false;
-            toSend.exp_result = exp;
-            outputQueuePtr->push(toSend);
-
-          }
-          catch(const SemanticError & ex) {
-            toSend.isError = true;
-            toSend.err_result = SemanticError(ex.what());
-            outputQueuePtr->push(toSend);
-          }
+        catch(const SemanticError & ex) {
+          toSend = output_type::failure(ex.what());
         }
-
       }
+      outputQueuePtr->push(std::move(toSend));
     }
 
   };
@@ -0,0 +1,63 @@
+#include "mapped_file.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile() noexcept
+  : open(false), mapping(nullptr), length(0) {}
+
+MappedFile::MappedFile(const std::string & filename): MappedFile(){
+
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if(fd < 0) return;
+
+  struct stat info;
+  if((::fstat(fd, &info) == 0) && S_ISREG(info.st_mode) && (info.st_size > 0)){
+
+    void * addr = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(addr != MAP_FAILED){
+      // the whole file is read front to back exactly once
+      ::madvise(addr, info.st_size, MADV_SEQUENTIAL);
+      mapping = static_cast<const char *>(addr);
+      length = info.st_size;
+      open = true;
+    }
+  }
+
+  if(!open){
+    // fall back to reading what the descriptor yields
+    char chunk[65536];
+    ssize_t count;
+    while((count = ::read(fd, chunk, sizeof(chunk))) > 0){
+      buffer.append(chunk, count);
+    }
+    open = (count == 0);
+  }
+
+  ::close(fd);
+}
+
+MappedFile::~MappedFile(){
+  release();
+}
+
+bool MappedFile::isOpen() const noexcept{
+  return open;
+}
+
+const char * MappedFile::data() const noexcept{
+  return (mapping != nullptr) ? mapping : buffer.data();
+}
+
+std::size_t MappedFile::size() const noexcept{
+  return (mapping != nullptr) ? length : buffer.size();
+}
+
+void MappedFile::release() noexcept{
+  if(mapping != nullptr){
+    ::munmap(const_cast<char *>(mapping), length);
+    mapping = nullptr;
+  }
+}
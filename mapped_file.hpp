@@ -0,0 +1,53 @@
+/*! \file mapped_file.hpp
+Defines the MappedFile, a read-only view of a whole file's contents.
+ */
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+// system includes
+#include <cstddef>
+#include <string>
+
+/*! \class MappedFile
+\brief Maps a file into memory for reading.
+
+Regular files are mapped with mmap, so a script is lexed and parsed straight
+from the page cache without being copied. Files that cannot be mapped (empty
+files, pipes, character devices) are read into an owned buffer instead, so
+data() is always valid while the MappedFile lives.
+ */
+class MappedFile {
+public:
+
+  /// Construct an unopened file
+  MappedFile() noexcept;
+
+  /// Open and map the named file, check isOpen() for success
+  explicit MappedFile(const std::string & filename);
+
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile & operator=(const MappedFile &) = delete;
+
+  /// true if the file was opened and its contents are available
+  bool isOpen() const noexcept;
+
+  /// The first character of the file's contents
+  const char * data() const noexcept;
+
+  /// The number of characters in the file
+  std::size_t size() const noexcept;
+
+private:
+
+  // unmap the mapping, if any
+  void release() noexcept;
+
+  bool open;
+  const char * mapping;
+  std::size_t length;
+  std::string buffer; // contents of a file that could not be mapped
+};
+
+#endif
@@ -0,0 +1,63 @@
+#include "catch.hpp"
+
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include <unistd.h>
+
+#include "mapped_file.hpp"
+#include "interpreter.hpp"
+
+// write contents to a fresh temporary file, returning its name
+static std::string temporary_file(const std::string & contents){
+
+  char name[] = "/tmp/plotscript_mapped_XXXXXX";
+  int fd = mkstemp(name);
+  REQUIRE(fd >= 0);
+  close(fd);
+
+  std::ofstream ofs(name);
+  ofs << contents;
+
+  return name;
+}
+
+TEST_CASE( "Test mapping a script file", "[mapped_file]" ) {
+
+  std::string program = "(begin (define a 1) (+ a 2))";
+  std::string filename = temporary_file(program);
+
+  {
+    MappedFile file(filename);
+
+    REQUIRE(file.isOpen());
+    REQUIRE(std::string(file.data(), file.size()) == program);
+
+    Interpreter interp;
+    REQUIRE(interp.parseBuffer(file.data(), file.size()));
+    REQUIRE(interp.evaluate() == Expression(3.));
+  }
+
+  unlink(filename.c_str());
+}
+
+TEST_CASE( "Test mapping an empty or missing file", "[mapped_file]" ) {
+
+  std::string filename = temporary_file("");
+
+  {
+    MappedFile file(filename);
+
+    REQUIRE(file.isOpen());
+    REQUIRE(file.size() == 0);
+
+    Interpreter interp;
+    REQUIRE_FALSE(interp.parseBuffer(file.data(), file.size()));
+  }
+
+  unlink(filename.c_str());
+
+  MappedFile missing(filename);
+  REQUIRE_FALSE(missing.isOpen());
+}
@@ -14,16 +14,11 @@
 #include <iostream>
 
 #include "notebook_app.hpp"
-#include "startup_config.hpp"
 #include "expression.hpp"
 
-extern bool isInterrupted;
 
+NotebookApp::NotebookApp(QWidget* parent) : QWidget(parent), isDefined(false), isError(false) {
 
-
-NotebookApp::NotebookApp(QWidget* parent) : QWidget(parent), isDefined(false), isError(false), caughtInterrupt(false) {
-
-  isInterrupted = false;
   // PushButtons for GUI kernel commands
   startButton = new QPushButton("Start Kernel");
   startButton->setObjectName("start");
@@ -74,11 +69,8 @@ NotebookApp::NotebookApp(QWidget* parent) : QWidget(parent), isDefined(false), i
 
   setLayout(layout);
 
-  std::ifstream ifs(STARTUP_FILE);
-  if(interp.parseStream(ifs))
-    Expression startup_exp = interp.evaluate();
-  else
-    emit sendError("Error: Invalid Expression. Could not parse.");
+  // start from the startup file's definitions, evaluated once per process
+  interp = Interpreter(Interpreter::startupEnvironment());
 
   interpThread = InterpreterThread(&input_queue, &output_queue, interp);
   int_th = std::thread(interpThread);
@@ -114,25 +106,14 @@ void NotebookApp::interrupt_timer_loop() {
       event_timer->stop();
       //input->setEnabled(true);
       //std::cout << "Popped\n";
-      if(result.isError) {
-        emit sendError(result.err_result.what());
+      if(result.isError()) {
+        emit sendError(result.message());
         return;
       }
       else
-        exp = Expression(result.exp_result);
+        exp = result.takeExpression();
       //std::cout << "After popped\n";
       try {
-        if(caughtInterrupt) {
-          input_queue.push("%reset");
-          int_th.join();
-
-          interp = Interpreter();
-
-          interpThread = InterpreterThread(&input_queue, &output_queue, interp);
-          int_th = std::thread(interpThread);
-          caughtInterrupt = false;
-        }
-
         if(isError) {
           isError = false;
           return;
@@ -225,11 +206,7 @@ void NotebookApp::handle_reset() {
     input_queue.push("%reset");
     int_th.join();
   }
-  interp = Interpreter();
-
-  std::ifstream ifs(STARTUP_FILE);
-  if(interp.parseStream(ifs))
-    Expression startup_exp = interp.evaluate();
+  interp = Interpreter(Interpreter::startupEnvironment());
 
   interpThread = InterpreterThread(&input_queue, &output_queue, interp);
   int_th = std::thread(interpThread);
@@ -237,12 +214,9 @@ void NotebookApp::handle_reset() {
   interpRunning = true;
 }
 
+// the kernel's interpreter is a copy of interp, sharing its token; the
+// interrupted evaluation's error is its result, the environment is kept
 void NotebookApp::handle_interrupt() {
-  if(interpRunning) {
-    isInterrupted = true;
-    //std::cout << "Caught interrupt in slot.\n";
-    caughtInterrupt = true;
-  }
-  else
-    isInterrupted = false;
+  if(interpRunning)
+    interp.cancelToken().cancel();
 }
@@ -16,6 +16,7 @@
 #include "output_widget.hpp"
 
 #include "thread_safe_queue.hpp"
+#include "spsc_queue.hpp"
 #include "interpreter_thread.hpp"
 #include "output_thread.hpp"
 
@@ -48,8 +49,8 @@ private:
   QPushButton* interruptButton;
 
   // Input/Output queues and interpreter/output threads
-  ThreadSafeQueue<std::string> input_queue;
-  ThreadSafeQueue<output_type> output_queue;
+  SpscQueue<std::string> input_queue;
+  SpscQueue<output_type> output_queue;
   InterpreterThread interpThread; //(&input_queue, &output_queue, interp);
   std::thread int_th;
 
@@ -59,7 +60,6 @@ private:
   bool isDefined;
   bool interpRunning;
   bool isError;
-  bool caughtInterrupt;
 
   output_type result;
   Expression exp;
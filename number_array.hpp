@@ -0,0 +1,180 @@
+/*! \file number_array.hpp
+Defines the NumberArray, the dense storage behind packed numeric lists.
+ */
+#ifndef NUMBER_ARRAY_HPP
+#define NUMBER_ARRAY_HPP
+
+// system includes
+#include <complex>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// module includes
+#include "atom.hpp"
+
+/*! \class NumberArray
+\brief A contiguous array of Numbers, or of Complex numbers.
+
+A list whose elements are all Numbers (or all Complex numbers) keeps them
+here rather than as one Expression each (see Expression::makeList). The
+array is homogeneous: a Number is never widened to a Complex, so packing a
+list never changes how its elements compare or print.
+
+An array may also be an arithmetic sequence (see sequence), whose elements
+are computed as they are read. It is stored only when real() needs the
+elements contiguous or the array is modified, so a range that is only
+counted, printed or mapped over is never stored.
+ */
+class NumberArray {
+public:
+
+  /// Construct an empty array of Numbers
+  NumberArray(): m_complex(false) {}
+
+  /// Construct an array of Numbers, taking ownership of values
+  explicit NumberArray(std::vector<double> && values)
+    : m_complex(false), m_real(std::move(values)) {}
+
+  /// Construct an array of Complex numbers, taking ownership of values
+  explicit NumberArray(std::vector<std::complex<double> > && values)
+    : m_complex(true), m_values(std::move(values)) {}
+
+  /// Construct the n Numbers start + i * step, for i from 0 to n - 1
+  static NumberArray sequence(double start, double step, std::size_t n) {
+    NumberArray array;
+    if(n > 0)
+      array.m_sequence = std::make_shared<Sequence>(start, step, 0, n);
+    return array;
+  }
+
+  /// true if the elements are computed as they are read
+  bool isSequence() const noexcept { return static_cast<bool>(m_sequence); }
+
+  /// true if the elements are Complex numbers
+  bool isComplex() const noexcept { return m_complex; }
+
+  /// number of elements
+  std::size_t size() const noexcept {
+    if(m_sequence)
+      return m_sequence->size;
+    return m_complex ? m_values.size() : m_real.size();
+  }
+
+  /// true if there are no elements
+  bool empty() const noexcept { return size() == 0; }
+
+  /// element i as an Atom
+  Atom at(std::size_t i) const {
+    if(m_sequence)
+      return Atom(m_sequence->at(i));
+    return m_complex ? Atom(m_values[i]) : Atom(m_real[i]);
+  }
+
+  /// the elements, valid when !isComplex(); a sequence is stored on first use
+  const std::vector<double> & real() const {
+    if(m_sequence){
+      Sequence & s = *m_sequence;
+      std::call_once(s.store_once, [&s](){
+        s.stored.reserve(s.size);
+        for(std::size_t i = 0; i < s.size; ++i)
+          s.stored.push_back(s.at(i));
+      });
+      return s.stored;
+    }
+    return m_real;
+  }
+
+  /// the elements, valid when isComplex()
+  const std::vector<std::complex<double> > & complex() const noexcept { return m_values; }
+
+  /// true if a can be stored alongside the current elements
+  bool accepts(const Atom & a) const noexcept {
+    if(empty())
+      return a.isNumber() || a.isComplex();
+    return m_complex ? a.isComplex() : a.isNumber();
+  }
+
+  /// append a, which must satisfy accepts(a)
+  void push_back(const Atom & a) {
+    store();
+    if(empty())
+      m_complex = a.isComplex();
+
+    if(m_complex)
+      m_values.push_back(a.asComplex());
+    else
+      m_real.push_back(a.asNumber());
+  }
+
+  /// append the elements of other, whose kind must match unless either is empty
+  void append(const NumberArray & other) {
+    store();
+    if(empty())
+      m_complex = other.m_complex;
+
+    if(m_complex)
+      m_values.insert(m_values.end(), other.m_values.begin(), other.m_values.end());
+    else
+      m_real.insert(m_real.end(), other.real().begin(), other.real().end());
+  }
+
+  /// the elements from index first on
+  NumberArray slice(std::size_t first) const {
+    if(m_sequence){
+      const Sequence & s = *m_sequence;
+      NumberArray array;
+      if(first < s.size)
+        array.m_sequence = std::make_shared<Sequence>(s.start, s.step, s.offset + first, s.size - first);
+      return array;
+    }
+    if(m_complex)
+      return NumberArray(std::vector<std::complex<double> >(m_values.begin() + first, m_values.end()));
+    return NumberArray(std::vector<double>(m_real.begin() + first, m_real.end()));
+  }
+
+  /// reserve storage for n elements of the current kind
+  void reserve(std::size_t n) {
+    store();
+    if(m_complex)
+      m_values.reserve(n);
+    else
+      m_real.reserve(n);
+  }
+
+private:
+
+  // the elements start + (offset + i) * step; offset keeps the elements of
+  // a slice identical to those of the sequence it was sliced from
+  struct Sequence {
+    Sequence(double start, double step, std::size_t offset, std::size_t size)
+      : start(start), step(step), offset(offset), size(size) {}
+
+    double at(std::size_t i) const noexcept {
+      return start + static_cast<double>(offset + i) * step;
+    }
+
+    double start, step;
+    std::size_t offset, size;
+
+    // the elements, stored once for real()
+    std::once_flag store_once;
+    std::vector<double> stored;
+  };
+
+  // turn a sequence into stored elements, before modifying them
+  void store() {
+    if(m_sequence){
+      m_real = real();
+      m_sequence.reset();
+    }
+  }
+
+  bool m_complex;
+  std::vector<double> m_real;
+  std::vector<std::complex<double> > m_values;
+  std::shared_ptr<Sequence> m_sequence; // shared by copies, never modified
+};
+
+#endif
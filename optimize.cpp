@@ -0,0 +1,271 @@
+#include "optimize.hpp"
+
+// system includes
+#include <algorithm>
+#include <vector>
+
+// module includes
+#include "alloc_stats.hpp"
+#include "semantic_error.hpp"
+
+const char * const FoldedHead = "(folded)";
+
+namespace {
+
+// the folder recurses on the native stack; deeper expressions are left as
+// they are rather than risk overflowing it
+const std::size_t MaxNesting = 1000;
+
+// a folded value stays in the AST whether or not it is ever used, so a range
+// is only folded up to this many elements
+const double MaxFoldedRange = 65536;
+
+// true if folding the call would build an unreasonably large value
+bool too_large(const Atom & op, const std::vector<Expression> & args){
+
+  if((op.asSymbol() != "range") || (args.size() != 3))
+    return false;
+
+  for(auto & a : args){
+    if(!a.isHeadNumber()) return false;
+  }
+
+  double n = (args[1].head().asNumber() - args[0].head().asNumber()) / args[2].head().asNumber();
+  return !(n <= MaxFoldedRange);
+}
+
+class Folder {
+public:
+
+  Folder(const Environment & env, FoldStats & stats)
+    : env(env), stats(stats), nesting(0) {}
+
+  Expression fold(const Expression & exp);
+
+private:
+
+  // true if a folded expression has a known value, with the symbols the
+  // value depends on added to guards
+  bool constant(const Expression & exp, Expression & value, std::vector<Atom> & guards);
+
+  // a copy of exp with its tail replaced
+  static Expression rebuild(const Expression & exp, std::vector<Expression> && tail);
+
+  // a copy of exp with tail[first] on folded
+  Expression fold_tail(const Expression & exp, std::size_t first);
+
+  // a procedure call, folded into its value when possible
+  Expression fold_call(const Expression & exp);
+
+  // true if sym is an argument of an enclosing lambda
+  bool is_param(const Atom & sym) const;
+
+  const Environment & env;
+  FoldStats & stats;
+  std::size_t nesting;
+
+  // argument names of the enclosing lambdas
+  std::vector<SymbolId> params;
+};
+
+Expression Folder::rebuild(const Expression & exp, std::vector<Expression> && tail){
+  Expression node(std::move(tail));
+  node.head() = exp.head();
+  node.resolveForm();
+  return node;
+}
+
+Expression Folder::fold_tail(const Expression & exp, std::size_t first){
+
+  const std::vector<Expression> & tail = exp.getTail();
+
+  std::vector<Expression> folded;
+  folded.reserve(tail.size());
+  for(std::size_t i = 0; i < tail.size(); ++i){
+    folded.push_back((i < first) ? tail[i] : fold(tail[i]));
+  }
+
+  return rebuild(exp, std::move(folded));
+}
+
+bool Folder::is_param(const Atom & sym) const{
+  return std::find(params.begin(), params.end(), sym.symbolId()) != params.end();
+}
+
+Expression Folder::fold(const Expression & exp){
+
+  ++stats.nodes;
+
+  const std::vector<Expression> & tail = exp.getTail();
+  if(tail.empty() || (nesting == MaxNesting)){
+    return exp;
+  }
+
+  struct Nest {
+    std::size_t & n;
+    Nest(std::size_t & n): n(n) { ++n; }
+    ~Nest() { --n; }
+  } nest(nesting);
+
+  switch(exp.form()){
+  case Expression::ConstantForm:
+  case Expression::DiscretePlotForm:
+  case Expression::ContinuousPlotForm:
+    return exp;
+  case Expression::LambdaForm:
+    {
+      if(tail.size() != 2)
+        return exp;
+
+      // the argument names are the head and tail of tail[0], as in
+      // Expression::makeLambda
+      std::size_t outer = params.size();
+      params.push_back(tail[0].head().symbolId());
+      for(auto & p : tail[0].getTail()){
+        params.push_back(p.head().symbolId());
+      }
+      Expression body = fold(tail[1]);
+      params.resize(outer);
+
+      return rebuild(exp, {tail[0], body});
+    }
+  case Expression::DefineForm:
+    return fold_tail(exp, 1);
+  case Expression::ApplyForm:
+  case Expression::MapForm:
+  case Expression::PMapForm:
+    // the list argument is read syntactically, only its elements fold
+    if((tail.size() != 2) || tail[1].getTail().empty())
+      return exp;
+    return rebuild(exp, {tail[0], fold_tail(tail[1], 0)});
+  case Expression::BeginForm:
+  case Expression::SetPropertyForm:
+  case Expression::GetPropertyForm:
+    return fold_tail(exp, 0);
+  default:
+    return fold_call(exp);
+  }
+}
+
+bool Folder::constant(const Expression & exp, Expression & value, std::vector<Atom> & guards){
+
+  if(exp.form() == Expression::ConstantForm){
+    const std::vector<Expression> & tail = exp.getTail();
+    value = tail[0];
+    for(std::size_t i = 2; i < tail.size(); ++i){
+      guards.push_back(tail[i].head());
+    }
+    return true;
+  }
+
+  if(!exp.getTail().empty() || !exp.property_list.empty()){
+    return false;
+  }
+
+  // the values Expression::handle_lookup gives terminals
+  const Atom & head = exp.head();
+  if(head.isNumber() || head.isComplex() || head.isString()){
+    value = exp;
+    return true;
+  }
+
+  if(!head.isSymbol() || is_param(head)){
+    return false;
+  }
+
+  if(head.asSymbol() == "list"){
+    value = Expression();
+    value.setHeadList();
+    return true;
+  }
+
+  // a top level value, but not a lambda, whose calls are not folded
+  if(!env.is_exp(head)){
+    return false;
+  }
+  value = env.get_exp(head);
+  if(value.isHeadLambda()){
+    return false;
+  }
+
+  ++stats.symbols;
+  guards.push_back(head);
+  return true;
+}
+
+Expression Folder::fold_call(const Expression & exp){
+
+  Expression node = fold_tail(exp, 0);
+
+  const Atom & op = exp.head();
+  if(!op.isSymbol() || is_param(op) || !env.is_proc(op) || !env.is_pure(op)){
+    return node;
+  }
+
+  const std::vector<Expression> & tail = node.getTail();
+  std::vector<Expression> args(tail.size());
+  std::vector<Atom> guards(1, op);
+  std::size_t symbols = stats.symbols;
+
+  for(std::size_t i = 0; i < tail.size(); ++i){
+    if(!constant(tail[i], args[i], guards)){
+      stats.symbols = symbols;
+      return node;
+    }
+  }
+
+  if(too_large(op, args)){
+    stats.symbols = symbols;
+    return node;
+  }
+
+  // an error is raised when the call is evaluated, in order
+  Expression value;
+  try{
+    AllocScope allocs(ProcedureAllocs);
+    value = env.get_proc(op)(args);
+  }
+  catch(const SemanticError &){
+    stats.symbols = symbols;
+    return node;
+  }
+  ++stats.calls;
+
+  // the folded node: value, original, then each guard symbol once
+  std::vector<Expression> folded = {value, exp};
+  for(auto & g : guards){
+    bool seen = false;
+    for(std::size_t i = 2; i < folded.size(); ++i){
+      seen = seen || (folded[i].head().symbolId() == g.symbolId());
+    }
+    if(!seen){
+      folded.emplace_back(g);
+    }
+  }
+
+  Expression result(std::move(folded));
+  result.head() = Atom(FoldedHead);
+  result.resolveForm();
+  return result;
+}
+
+}
+
+std::ostream & operator<<(std::ostream & out, const FoldStats & stats){
+  out << "folded " << stats.calls << " calls and " << stats.symbols
+      << " constant symbols in " << stats.nodes << " expressions";
+  return out;
+}
+
+Expression fold_constants(const Expression & program, const Environment & env, FoldStats & stats){
+  return Folder(env, stats).fold(program);
+}
+
+bool fold_holds(const Expression & folded, const Environment & env){
+
+  const std::vector<Expression> & tail = folded.getTail();
+  for(std::size_t i = 2; i < tail.size(); ++i){
+    if(!env.is_global(tail[i].head())) return false;
+  }
+  return true;
+}
@@ -0,0 +1,62 @@
+/*! \file optimize.hpp
+Defines the constant folding pass, run over a parsed AST before it is
+evaluated.
+ */
+#ifndef OPTIMIZE_HPP
+#define OPTIMIZE_HPP
+
+// system includes
+#include <cstddef>
+#include <ostream>
+
+// module includes
+#include "environment.hpp"
+#include "expression.hpp"
+
+/*! \struct FoldStats
+\brief Counts what fold_constants did, accumulated over calls.
+ */
+struct FoldStats {
+  std::size_t nodes = 0;   //< expressions visited
+  std::size_t calls = 0;   //< calls evaluated while folding
+  std::size_t symbols = 0; //< references to constant symbols folded into calls
+};
+
+/// Print the statistics on one line
+std::ostream & operator<<(std::ostream & out, const FoldStats & stats);
+
+/// The name of the head of a folded constant, which no token can spell
+extern const char * const FoldedHead;
+
+/*! \fn fold_constants
+\brief Replace calls of pure built-in procedures on constant arguments by
+their values.
+
+Constant arguments are literals, symbols bound at top level to values (such
+as pi, e and I) and calls already folded; folding works from the leaves up,
+so the constant parts of a larger expression are folded even when the whole
+is not (partial evaluation). Lambda bodies are folded too, so their constant
+parts are computed once rather than on every call. A call that raises an
+error is left for evaluation to raise it in order.
+
+A folded call becomes a ConstantForm node: its tail holds the value, the
+original expression and the symbols the fold read at top level. Scoping is
+dynamic, so wherever an enclosing call frame binds one of those symbols the
+original is evaluated instead (see fold_holds). Syntactic positions (the
+names bound by define and lambda, the callee and list of apply and map, and
+the arguments of the plot forms) are never folded.
+
+\param program the parsed AST
+\param env the top level environment program will be evaluated in
+\param stats incremented with what was folded
+\return the folded AST
+ */
+Expression fold_constants(const Expression & program, const Environment & env, FoldStats & stats);
+
+/*! \fn fold_holds
+\brief true if the top level bindings a folded constant was computed from
+are the bindings visible in env, so its value can be used.
+ */
+bool fold_holds(const Expression & folded, const Environment & env);
+
+#endif
@@ -0,0 +1,147 @@
+#include "catch.hpp"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "environment.hpp"
+#include "interpreter.hpp"
+#include "optimize.hpp"
+#include "parse.hpp"
+#include "semantic_error.hpp"
+#include "token.hpp"
+
+static Expression folded(const std::string & program, const Environment & env, FoldStats & stats){
+  std::istringstream iss(program);
+  return fold_constants(parse(tokenize(iss)), env, stats);
+}
+
+static std::string printed(const Expression & exp){
+  std::ostringstream out;
+  out << exp;
+  return out.str();
+}
+
+TEST_CASE( "Test folding constant calls", "[optimize]" ) {
+
+  Environment env;
+  FoldStats stats;
+
+  Expression exp = folded("(* 2 pi)", env, stats);
+  REQUIRE(exp.form() == Expression::ConstantForm);
+  REQUIRE(exp.getTail()[0] == Expression(2 * std::atan2(0, -1)));
+  REQUIRE(stats.calls == 1);
+  REQUIRE(stats.symbols == 1);
+
+  // folded constants print as the expression they were folded from
+  REQUIRE(printed(exp) == "(* (2) (pi))");
+
+  // nested calls fold from the leaves up
+  exp = folded("(+ (sqrt 4) (* I I) 1)", env, stats);
+  REQUIRE(exp.form() == Expression::ConstantForm);
+  REQUIRE(printed(exp.getTail()[0]) == "(2,0)");
+  REQUIRE(stats.calls == 4);
+
+  // lists fold into their value
+  exp = folded("(length (range 0 10 0.1))", env, stats);
+  REQUIRE(exp.getTail()[0] == Expression(101.));
+}
+
+TEST_CASE( "Test partial folding", "[optimize]" ) {
+
+  Environment env;
+  FoldStats stats;
+
+  // the constant argument folds inside a call that cannot
+  Expression exp = folded("(lambda (x) (+ x (* 2 pi)))", env, stats);
+  REQUIRE(stats.calls == 1);
+  const Expression & body = exp.getTail()[1];
+  REQUIRE(body.form() == Expression::ProcedureForm);
+  REQUIRE(body.getTail()[1].form() == Expression::ConstantForm);
+  REQUIRE(printed(exp) == "(lambda (x) (+ (x) (* (2) (pi))))");
+
+  // arguments of the enclosing lambdas are not constants
+  stats = FoldStats();
+  folded("(lambda (pi x) (lambda (y) (* 2 pi)))", env, stats);
+  REQUIRE(stats.calls == 0);
+
+  // nor are errors, lambdas, impure calls or syntactic positions
+  for(auto program : {"(+ 1 \"a\")", "(sqrt (list 1 (lambda (x) x)))",
+                      "(define pi2 (f 2))", "(map + (list 1 2))",
+                      "(discrete-plot (list (list 1 2)) (list))",
+                      "(range 0 1000000 1)"}){
+    stats = FoldStats();
+    folded(program, env, stats);
+    INFO(program);
+    REQUIRE(stats.calls == 0);
+  }
+}
+
+TEST_CASE( "Test folded constants hold only at top level bindings", "[optimize]" ) {
+
+  Environment env;
+  FoldStats stats;
+
+  Expression exp = folded("(* 2 pi)", env, stats);
+  REQUIRE(fold_holds(exp, env));
+
+  Environment frame(&env);
+  frame.add_exp(Atom("x"), Expression(1.0), true);
+  REQUIRE(fold_holds(exp, frame));
+
+  // a frame binding pi, or the procedure, means the original is evaluated
+  Environment shadow(&frame);
+  shadow.add_exp(Atom("pi"), Expression(3.0), true);
+  REQUIRE(!fold_holds(exp, shadow));
+  REQUIRE(exp.eval(shadow) == Expression(6.0));
+  REQUIRE(exp.eval(frame) == exp.getTail()[0]);
+}
+
+TEST_CASE( "Test folding does not change results", "[optimize]" ) {
+
+  const std::vector<std::string> programs = {
+    "(define tau (* 2 pi))",
+    "(define f (lambda (x) (+ x tau (sqrt 2) (^ e 2))))",
+    "(f 1)",
+    "(define g (lambda (z) (* 2 pi)))",
+    "(define h (lambda (pi) (g 0)))",
+    "(h 1)",
+    "(define k (lambda (+) (+ 1 2)))",
+    "(k 3)",
+    "(map f (range 0 3 1))",
+    "(apply + (list (* 2 pi) 1))",
+    "(f)",
+    "(ln (- 1 1))",
+    "(get-property \"n\" (set-property \"n\" (+ 1 2) (list)))",
+    "(lambda (x) (sqrt 4))"
+  };
+
+  for(auto mode : {Interpreter::TreeWalk, Interpreter::Bytecode}){
+    Interpreter folding, plain;
+    folding.setEvalMode(mode);
+    plain.setEvalMode(mode);
+    plain.setFolding(false);
+    REQUIRE(folding.folding());
+    REQUIRE(!plain.folding());
+
+    for(auto & program : programs){
+      std::string results[2];
+      Interpreter * interps[2] = {&folding, &plain};
+      for(int i = 0; i < 2; ++i){
+        std::istringstream iss(program);
+        REQUIRE(interps[i]->parseStream(iss));
+        try{
+          results[i] = printed(interps[i]->evaluate());
+        }
+        catch(const SemanticError & ex){
+          results[i] = ex.what();
+        }
+      }
+      INFO(program);
+      REQUIRE(results[0] == results[1]);
+    }
+
+    REQUIRE(folding.foldStats().calls > 0);
+    REQUIRE(plain.foldStats().calls == 0);
+  }
+}
@@ -6,7 +6,9 @@
 #include "expression.hpp"
 #include "semantic_error.hpp"
 #include "thread_safe_queue.hpp"
+#include "spsc_queue.hpp"
 
+#include <chrono>
 #include <iostream>
 
 
@@ -18,12 +20,13 @@ public:
     endLoop = true;
   }
 
-  OutputThread(ThreadSafeQueue<output_type>* output_queue_ptr) {
+  OutputThread(SpscQueue<output_type>* output_queue_ptr) {
     outputQueuePtr = output_queue_ptr;
     endLoop = false;
   };
 
-  // Event loop for output thread
+  // Event loop for output thread, asleep until a result is queued; it
+  // wakes to check endLoop every 50 ms
   void operator()() const {
     output_type result;
     while(1) {
@@ -33,14 +36,14 @@ public:
         break;
       }
 
-      if(outputQueuePtr->try_pop(result)) {
+      if(outputQueuePtr->wait_for_pop(result, std::chrono::milliseconds(50))) {
         //std::cout << "Message received\n";
-        if(result.isError) {
-          std::cout << result.err_result.what() << '\n';
+        if(result.isError()) {
+          std::cout << result.message() << '\n';
           std::cout << "\nplotscript> ";
         }
         else {
-          std::cout << result.exp_result << '\n';
+          std::cout << result.expression() << '\n';
           std::cout << "\nplotscript> ";
         }
 
@@ -53,7 +56,7 @@ public:
 
 private:
 
-  ThreadSafeQueue<output_type>* outputQueuePtr;
+  SpscQueue<output_type>* outputQueuePtr;
 
   bool endLoop;
 
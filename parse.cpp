@@ -1,103 +1,135 @@
 #include "parse.hpp"
-#include <iostream>
 
-#include <stack>
+#include "alloc_stats.hpp"
 
-bool setHead(Expression &exp, const Token &token) {
+#include <iterator>
+#include <vector>
 
-  Atom a(token);
+namespace {
 
-  if(a.asString().front() == '\"')
-    exp.head() = a.asString();
-  else
-    exp.head() = a;
+// the atom a token contributes to the tree; string literals are stored
+// through the string constructor, as the reader always has
+Atom node_atom(Atom && a) {
 
-  return !a.isNone();
-}
-
-bool append(Expression *exp, const Token &token) {
+  if(a.isString())
+    return Atom(a.asString());
 
-  Atom a(token);
+  return std::move(a);
+}
 
-  if(a.asString().front() == '\"')
-    exp->append(a.asString());
-  else
-    exp->append(a);
+// the type of a token from a stream
+Token::TokenType type_of(const Token & t) {
+  return t.type();
+}
 
-  return !a.isNone();
+// the type of a token span into a buffer
+Token::TokenType type_of(const TokenSpan & t) {
+  return t.type;
 }
 
-Expression parse(const TokenSequenceType &tokens) noexcept {
+// a node whose closing paren has not been seen yet
+struct OpenNode {
+  Atom head;
+  std::size_t first; // index in the node stack of its first child
+};
 
-  Expression ast;
+/* Parse a sequence of Tokens or TokenSpans, atom_of gives a token's Atom.
+
+   The tree is built bottom up. Completed children wait on a single node
+   stack, which grows to the widest path through the tree and is reused for
+   the whole parse; when a node closes its children are moved off the stack
+   into a tail allocated at its exact size. No vector is grown child by
+   child, and no pointer into a tail is held while the tail can change. */
+template <typename Sequence, typename AtomOf>
+Expression parse_sequence(const Sequence &tokens, AtomOf atom_of) noexcept {
 
   // cannot parse empty
   if (tokens.empty())
     return Expression();
 
+  Expression ast;
+
   bool athead = false;
+  bool closed = false;
 
-  // stack tracks the last node created
-  std::stack<Expression *> stack;
+  std::vector<OpenNode> open;
+  std::vector<Expression> nodes;
 
   std::size_t num_tokens_seen = 0;
 
   for (auto &t : tokens) {
-    //std::cout << t.asString() << '\n';
 
-    if (t.type() == Token::OPEN) {
+    if (type_of(t) == Token::OPEN) {
       athead = true;
     }
-    else if (t.type() == Token::CLOSE) {
-      if (stack.empty()) {
+    else if (type_of(t) == Token::CLOSE) {
+      if (open.empty()) {
         return Expression();
       }
-      stack.pop();
 
-      if (stack.empty()) {
+      OpenNode & top = open.back();
+      auto first = nodes.begin() + top.first;
+
+      Expression node;
+      if (first != nodes.end()) {
+        node = Expression(std::vector<Expression>(std::make_move_iterator(first),
+                                                  std::make_move_iterator(nodes.end())));
+        nodes.erase(first, nodes.end());
+      }
+      node.head() = std::move(top.head);
+      node.resolveForm();
+      open.pop_back();
+
+      if (open.empty()) {
+        ast = std::move(node);
+        closed = true;
         num_tokens_seen += 1;
         break;
       }
+      nodes.push_back(std::move(node));
     }
     else {
+      Atom a = atom_of(t);
+      if (a.isNone()) {
+        return Expression();
+      }
+
       if (athead) {
-        if (stack.empty()) {
-          //std::cout << t.asString() << '\n';
-          if (!setHead(ast, t)) {
-            return Expression();
-          }
-          stack.push(&ast);
-        }
-        else {
-          if(stack.empty())
-            return Expression();
-
-          if(!append(stack.top(), t))
-            return Expression();
-
-          stack.push(stack.top()->tail());
-        }
+        open.push_back(OpenNode{node_atom(std::move(a)), nodes.size()});
         athead = false;
       }
       else {
-        //std::cout << "Looking at string\n";
-        if (stack.empty())
+        if (open.empty())
           return Expression();
 
-        //std::cout << t.asString() << '\n';
-        if (!append(stack.top(), t)) {
-          return Expression();
-        }
+        nodes.emplace_back(node_atom(std::move(a)));
+        nodes.back().resolveForm();
       }
     }
     num_tokens_seen += 1;
   }
 
-  //std::cout << ast << '\n';
-
-  if (stack.empty() && (num_tokens_seen == tokens.size())) {
+  if (closed && (num_tokens_seen == tokens.size())) {
     return ast;
   }
 
   return Expression();
-};
+}
+
+}
+
+Expression parse(const TokenSequenceType &tokens) noexcept {
+
+  AllocScope allocs(ParseAllocs);
+  return parse_sequence(tokens, [](const Token &t) { return Atom(t); });
+}
+
+Expression parse(const char *data, std::size_t size) noexcept {
+
+  AllocScope allocs(ParseAllocs);
+  TokenSpanSequenceType tokens = lex(data, size);
+
+  return parse_sequence(tokens, [data](const TokenSpan &t) {
+    return Atom(data + t.offset, t.length);
+  });
+}
@@ -15,4 +15,16 @@ Defines the parse function.
  */
 Expression parse(const TokenSequenceType & tokens) noexcept;
 
+/*! \fn parse
+\brief lex and parse a contiguous buffer into an expression (abstract syntax tree)
+
+Tokens are located in the buffer as spans and converted straight to Atoms,
+so no token text is copied unless it becomes a symbol.
+
+\param data the first character of the buffer
+\param size the number of characters in the buffer
+\returns the expression resulting from parsing or the None Expression on failure
+ */
+Expression parse(const char * data, std::size_t size) noexcept;
+
 #endif
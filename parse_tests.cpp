@@ -57,3 +57,42 @@ TEST_CASE( "Test empty parens", "[parse]" ) {
   REQUIRE(parse(tokens) == Expression());
 }
 
+
+TEST_CASE( "Test parsing from a buffer", "[parse]" ) {
+
+  std::string program = "(begin (define r 10) (* pi (* r r)))";
+
+  std::istringstream iss(program);
+
+  TokenSequenceType tokens = tokenize(iss);
+
+  Expression exp = parse(program.data(), program.size());
+
+  REQUIRE(exp != Expression());
+  REQUIRE(exp == parse(tokens));
+
+  std::string bad = "(1abc)";
+  REQUIRE(parse(bad.data(), bad.size()) == Expression());
+}
+
+TEST_CASE( "Test parse builds the expected tree", "[parse]" ) {
+
+  std::string program = "(f (g 1 (h)) 2 \"s\")";
+
+  Expression h(Atom("h"));
+  Expression g(Atom("g"));
+  g.append(Atom(1.));
+  g.append(h);
+  Expression f(Atom("f"));
+  f.append(g);
+  f.append(Atom(2.));
+  f.append(Atom(std::string("\"s\"")));
+
+  Expression exp = parse(program.data(), program.size());
+
+  REQUIRE(exp == f);
+  REQUIRE(exp.getTail().size() == 3);
+  REQUIRE(exp.getTail().capacity() == 3);
+  REQUIRE(exp.getTail()[0].getTail().size() == 2);
+  REQUIRE(exp.getTail()[0].getTail()[1].getTail().empty());
+}
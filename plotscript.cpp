@@ -3,11 +3,17 @@
 #include <iostream>
 #include <fstream>
 #include <thread>
+#include <chrono>
+#include <algorithm>
 
+#include "alloc_stats.hpp"
 #include "interpreter.hpp"
+#include "mapped_file.hpp"
 #include "semantic_error.hpp"
-#include "startup_config.hpp"
+#include "session_pool.hpp"
+#include "session_server.hpp"
 #include "thread_safe_queue.hpp"
+#include "spsc_queue.hpp"
 #include "interpreter_thread.hpp"
 #include "output_thread.hpp"
 
@@ -20,37 +26,30 @@
 // *****************************************************************************
 // Interrupt Handling Implemented here
 // *****************************************************************************
-std::atomic_bool interrupt_flag = ATOMIC_FLAG_INIT;
-extern bool isInterrupted;
+// the token of the interpreter the REPL's kernel runs, which Ctrl-C
+// cancels; storing to it is safe in a signal handler
+std::atomic<CancelToken *> interrupt_target(nullptr);
 
 // this function is called when a signal is sent to the process
 inline void interrupt_handler(int signal_num) {
 
   if(signal_num == SIGINT){ // handle Cnrtl-C
-    //std::cout << "Event occurred\n";
-    // if not reset since last call, exit
-    signal(SIGINT, interrupt_handler);
-    if (interrupt_flag) {
-      exit(EXIT_FAILURE);
-    }
-    isInterrupted = true;
-    interrupt_flag.exchange(false);
+    CancelToken * token = interrupt_target.load();
+    if(token)
+      token->cancel();
   }
 }
 
-// install the signal handler
-inline void install_handler() {
-
-  struct sigaction sigIntHandler;
+// install the signal handler, interrupting the evaluations of interp
+inline void install_handler(Interpreter & interp) {
 
-  interrupt_flag.exchange(false);
-  isInterrupted = false; // Reset bool
+  interrupt_target.store(&interp.cancelToken());
 
-  //sigIntHandler.sa_handler = interrupt_handler;
-  //sigemptyset(&sigIntHandler.sa_mask);
-  //sigIntHandler.sa_flags = 0;
-  signal(SIGINT, interrupt_handler);
-  //sigaction(SIGINT, &sigIntHandler, NULL);
+  struct sigaction sigIntHandler;
+  sigIntHandler.sa_handler = interrupt_handler;
+  sigemptyset(&sigIntHandler.sa_mask);
+  sigIntHandler.sa_flags = SA_RESTART;
+  sigaction(SIGINT, &sigIntHandler, NULL);
 }
 
 // *****************************************************************************
@@ -75,27 +74,95 @@ void info(const std::string & err_str){
   std::cout << "Info: " << err_str << std::endl;
 }
 
-int eval_from_stream(std::istream & stream, bool isFromFile=false){
+// evaluation mode selected on the command line
+Interpreter::EvalMode eval_mode = Interpreter::TreeWalk;
 
-  Interpreter interp;
+// report constant folding statistics after evaluating, --fold-stats
+bool fold_stats = false;
+
+// report allocations by subsystem after evaluating, --alloc-stats; the
+// counts start with the process, so they include parsing and startup
+bool report_allocs = false;
+AllocStats allocs_mark = AllocStats();
+
+// profile the evaluation, --profile; --profile=FILE also writes the folded
+// call stacks to FILE
+bool profile = false;
+std::string profile_folded;
+
+// limit each evaluation to this long, --time-budget=MS; zero for no limit
+std::chrono::milliseconds time_budget(0);
+
+// worker threads of --server, --workers=N; zero for one per hardware thread
+std::size_t server_workers = 0;
+
+// sessions --server keeps open at once, --max-sessions=N, and how long one
+// may sit idle before it is closed, --idle-timeout=MS
+std::size_t server_max_sessions = SessionPool::DefaultMaxSessions;
+std::chrono::milliseconds server_idle_timeout = SessionPool::DefaultIdleTimeout;
+
+void report_fold_stats(const Interpreter & interp){
+  if(fold_stats){
+    std::ostringstream stats;
+    stats << interp.foldStats();
+    info(stats.str());
+  }
+}
+
+// print the allocations made since mark, by subsystem, and move mark on
+void report_alloc_stats(AllocStats & mark){
+
+  if(!alloc_stats_enabled()){
+    info("allocations are not counted in this build, configure with -DALLOC_STATS=ON");
+    return;
+  }
+
+  AllocStats now = alloc_stats();
+  info("allocations by subsystem");
+  std::cout << (now - mark);
+  mark = now;
+}
+
+// print the profile to standard error, and the folded stacks to their file
+void report_profile(const Profiler & profiler){
 
-  if(isFromFile) {
-    std::ifstream start_stream(STARTUP_FILE);
-    if(interp.parseStream(start_stream))
-      Expression startup_eval = interp.evaluate();
+  std::cerr << "Profile:\n";
+  profiler.report(std::cerr);
+
+  if(!profile_folded.empty()){
+    std::ofstream folded(profile_folded);
+    if(folded)
+      profiler.writeFolded(folded);
+    else
+      error("Could not open " + profile_folded + " for writing.");
   }
+}
+
+// what was asked for on the command line, after evaluating
+void report(const Interpreter & interp){
+  report_fold_stats(interp);
+  if(report_allocs) report_alloc_stats(allocs_mark);
+  if(interp.profiler()) report_profile(*interp.profiler());
+}
 
-  if(!interp.parseStream(stream)){
+int eval_parsed(Interpreter & interp, bool parsed){
+
+  if(!parsed){
     error("Invalid Program. Could not parse.");
     return EXIT_FAILURE;
   }
   else{
+    Profiler profiler;
+    if(profile) interp.setProfiler(&profiler);
+
     try{
       Expression exp = interp.evaluate();
       std::cout << exp << std::endl;
+      report(interp);
     }
     catch(const SemanticError & ex){
       std::cerr << ex.what() << std::endl;
+      report(interp);
       return EXIT_FAILURE;
     }
   }
@@ -103,16 +170,30 @@ int eval_from_stream(std::istream & stream, bool isFromFile=false){
   return EXIT_SUCCESS;
 }
 
+int eval_from_stream(std::istream & stream){
+
+  Interpreter interp;
+  interp.setEvalMode(eval_mode);
+  interp.setTimeBudget(time_budget);
+
+  return eval_parsed(interp, interp.parseStream(stream));
+}
+
 int eval_from_file(std::string filename){
 
-  std::ifstream ifs(filename);
+  // parse straight from the mapped file, without copying it
+  MappedFile file(filename);
 
-  if(!ifs){
+  if(!file.isOpen()){
     error("Could not open file for reading.");
     return EXIT_FAILURE;
   }
 
-  return eval_from_stream(ifs, true);
+  Interpreter interp(Interpreter::startupEnvironment());
+  interp.setEvalMode(eval_mode);
+  interp.setTimeBudget(time_budget);
+
+  return eval_parsed(interp, interp.parseBuffer(file.data(), file.size()));
 }
 
 int eval_from_command(std::string argexp){
@@ -125,24 +206,22 @@ int eval_from_command(std::string argexp){
 
 // A REPL is a repeated read-eval-print loop
 void repl(){
-  Interpreter interp;
-  install_handler();
-  isInterrupted = false;
-
-  // Startup file for points, lines, and text in GUI
-  std::ifstream ifs(STARTUP_FILE);
-
-
-  if(interp.parseStream(ifs))
-    Expression startup_exp = interp.evaluate();
+  // Startup definitions for points, lines, and text in GUI
+  Interpreter interp(Interpreter::startupEnvironment());
+  interp.setEvalMode(eval_mode);
+  interp.setTimeBudget(time_budget);
+  install_handler(interp);
 
   // Make thread queues and interpreter thread
-  ThreadSafeQueue<std::string> input_queue;
-  ThreadSafeQueue<output_type> output_queue;
+  SpscQueue<std::string> input_queue;
+  SpscQueue<output_type> output_queue;
   InterpreterThread interpThread(&input_queue, &output_queue, interp);
 
   bool InterpRunning = true;
 
+  // %stats reports the allocations made since the previous %stats
+  AllocStats stats_mark = alloc_stats();
+
   std::thread int_th(interpThread);
 
   while(!std::cin.eof()){
@@ -172,12 +251,16 @@ void repl(){
       int_th = std::thread(interpThread);
       InterpRunning = true;
     }
+    else if(line == "%stats") {
+      report_alloc_stats(stats_mark);
+    }
     else if(line == "%exit") {
       if(InterpRunning) {
         input_queue.push(line);
         int_th.join();
         InterpRunning = false;
       }
+      interrupt_target.store(nullptr);
       return;
     }
     else {
@@ -187,56 +270,110 @@ void repl(){
       else {
         input_queue.push(line);
 
-        output_type brokenResult;
-        // Event loop for output_queue
-        while(1) {
-          // Check if Ctrl+C flag was raised/we need to interrupt Interpreter kernel
-          if(isInterrupted && InterpRunning) {
-            input_queue.push("()");
-
-            while(1) {
-              if(output_queue.try_pop(brokenResult)) {
-                if(brokenResult.isError) {
-                  std::cout << brokenResult.err_result.what() << '\n';
-                }
-                else {
-                  std::cout << brokenResult.exp_result << '\n';
-                }
-                break;
-              }
-            }
-
-            input_queue.push("%reset"); // Reset environment
-            int_th.join();
-            int_th = std::thread(interpThread);
-            break;
-          }
-
-          output_type result;
-          if(output_queue.try_pop(result)) {
-            if(result.isError) {
-              std::cout << result.err_result.what() << '\n';
-            }
-            else {
-              std::cout << result.exp_result << '\n';
-            }
-
-            break;
-          }
-        } // End of event loop
-
+        // Wait for the result; Ctrl+C stops the evaluation, keeping the
+        // environment, and its error is the result
+        output_type result;
+        output_queue.wait_and_pop(result);
+        if(result.isError()) {
+          std::cout << result.message() << '\n';
+        }
+        else {
+          std::cout << result.expression() << '\n';
+        }
       }
     } // End of case for reading from output_queue
 
   }
 
-  if(InterpRunning)
+  // end of input, stop the kernel before waiting for it
+  if(InterpRunning) {
+    input_queue.push("%exit");
     int_th.join();
+  }
+  interrupt_target.store(nullptr);
+
+}
+
+// the server that SIGINT and SIGTERM stop
+std::atomic<SessionServer *> server_target(nullptr);
 
+void stop_server(int){
+  SessionServer * server = server_target.load();
+  if(server)
+    server->stop();
+}
+
+// serve sessions on a Unix-domain socket until interrupted
+int serve(const std::string & path){
+
+  std::size_t workers = server_workers;
+  if(workers == 0)
+    workers = std::max(1u, std::thread::hardware_concurrency());
+
+  SessionPool pool(workers, [](Interpreter & interp){
+    interp.setEvalMode(eval_mode);
+    interp.setTimeBudget(time_budget);
+  }, Interpreter::startupEnvironment());
+  pool.setMaxSessions(server_max_sessions);
+  pool.setIdleTimeout(server_idle_timeout);
+
+  try{
+    SessionServer server(pool, path);
+
+    server_target.store(&server);
+    signal(SIGINT, stop_server);
+    signal(SIGTERM, stop_server);
+
+    info("serving " + std::to_string(workers) + " workers on " + path);
+    server.run();
+
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    server_target.store(nullptr);
+  }
+  catch(const std::runtime_error & ex){
+    std::cerr << ex.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
 }
 
 int main(int argc, char *argv[])
 {
+  // leading options: --vm selects the bytecode machine, --fold-stats
+  // reports what constant folding did, --alloc-stats what was allocated,
+  // --profile[=FILE] where the time went, --time-budget=MS how long each
+  // evaluation may run, --workers=N how many threads --server uses,
+  // --max-sessions=N and --idle-timeout=MS how many sessions it keeps
+  while(argc > 1){
+    std::string option(argv[1]);
+    if(option == "--vm")
+      eval_mode = Interpreter::Bytecode;
+    else if(option == "--fold-stats")
+      fold_stats = true;
+    else if(option == "--alloc-stats")
+      report_allocs = true;
+    else if(option == "--profile")
+      profile = true;
+    else if(option.compare(0, 10, "--profile=") == 0){
+      profile = true;
+      profile_folded = option.substr(10);
+    }
+    else if(option.compare(0, 14, "--time-budget=") == 0)
+      time_budget = std::chrono::milliseconds(std::atol(option.c_str() + 14));
+    else if(option.compare(0, 10, "--workers=") == 0)
+      server_workers = std::strtoul(option.c_str() + 10, nullptr, 10);
+    else if(option.compare(0, 15, "--max-sessions=") == 0)
+      server_max_sessions = std::strtoul(option.c_str() + 15, nullptr, 10);
+    else if(option.compare(0, 15, "--idle-timeout=") == 0)
+      server_idle_timeout = std::chrono::milliseconds(std::atol(option.c_str() + 15));
+    else
+      break;
+    --argc;
+    ++argv;
+  }
+
   if(argc == 2){
     return eval_from_file(argv[1]);
   }
@@ -244,6 +381,9 @@ int main(int argc, char *argv[])
     if(std::string(argv[1]) == "-e"){
       return eval_from_command(argv[2]);
     }
+    else if(std::string(argv[1]) == "--server"){
+      return serve(argv[2]);
+    }
     else{
       error("Incorrect number of command line arguments.");
     }
@@ -0,0 +1,505 @@
+/*! \file plotscript_bench.cpp
+Micro and macro benchmarks of the interpreter core: lexing and parsing,
+evaluation in both modes, map over large lists, discrete-plot and symbol
+lookup. Each benchmark reports the time, heap allocations and bytes per
+operation and the peak resident set size while it ran, as a table or as
+JSON (--json) for comparison between builds.
+
+  plotscript_bench [--json FILE] [--filter TEXT] [--min-time SECONDS]
+                   [--samples N] [--large] [--list]
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "alloc_stats.hpp"
+#include "environment.hpp"
+#include "interpreter.hpp"
+#include "parse.hpp"
+#include "semantic_error.hpp"
+#include "token.hpp"
+#include "vector_kernels.hpp"
+
+// *****************************************************************************
+// Allocation counting, by replacing the global allocation functions unless
+// the interpreter library already does (ALLOC_STATS)
+// *****************************************************************************
+
+#ifndef PLOTSCRIPT_ALLOC_STATS
+
+namespace {
+std::atomic<std::size_t> allocations(0);
+std::atomic<std::size_t> allocated_bytes(0);
+
+std::size_t allocation_count(){ return allocations; }
+std::size_t allocated_byte_count(){ return allocated_bytes; }
+}
+
+void * operator new(std::size_t size){
+  ++allocations;
+  allocated_bytes += size;
+  if(void * p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void * operator new[](std::size_t size){
+  return operator new(size);
+}
+
+void operator delete(void * p) noexcept{
+  std::free(p);
+}
+
+void operator delete[](void * p) noexcept{
+  std::free(p);
+}
+
+void operator delete(void * p, std::size_t) noexcept{
+  std::free(p);
+}
+
+void operator delete[](void * p, std::size_t) noexcept{
+  std::free(p);
+}
+
+#else
+
+namespace {
+std::size_t allocation_count(){ return alloc_stats().total().allocations; }
+std::size_t allocated_byte_count(){ return alloc_stats().total().bytes; }
+}
+
+#endif
+
+namespace {
+
+// *****************************************************************************
+// Measurement
+// *****************************************************************************
+
+// keeps benchmark results observable so they are not optimized away
+volatile std::size_t sink = 0;
+
+// peak resident set size in KiB; on Linux the peak is reset between
+// benchmarks (from what is still resident), elsewhere it is the peak of
+// the whole run so far
+void reset_peak_rss(){
+#ifdef __GLIBC__
+  // hand freed heap back first, or the peak starts where the last ended
+  malloc_trim(0);
+#endif
+#ifdef __linux__
+  std::ofstream clear("/proc/self/clear_refs");
+  clear << "5";
+#endif
+}
+
+long peak_rss_kb(){
+#ifdef __linux__
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while(std::getline(status, line)){
+    if(line.compare(0, 6, "VmHWM:") == 0)
+      return std::strtol(line.c_str() + 6, nullptr, 10);
+  }
+#endif
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+}
+
+// discards what discrete-plot and friends print while they are timed
+class Quiet {
+public:
+  Quiet(): saved(std::cout.rdbuf(nullptr)) {}
+  ~Quiet() { std::cout.rdbuf(saved); }
+private:
+  std::streambuf * saved;
+};
+
+/* A benchmark prepares its state once and returns the operation to time.
+   bytes is the input consumed by one operation, for a throughput figure. */
+struct Benchmark {
+  std::string name;
+  std::size_t bytes;
+  std::function<std::function<void()>()> prepare;
+};
+
+struct Result {
+  std::string name;
+  std::size_t iterations;
+  double ns_per_op;     // median over the samples
+  double min_ns_per_op;
+  double allocs_per_op;
+  double bytes_allocated_per_op;
+  double mb_per_s;      // 0 when the benchmark consumes no input
+  long peak_rss_kb;
+};
+
+struct Options {
+  std::string json;
+  std::string filter;
+  double min_time = 0.2;
+  std::size_t samples = 5;
+  bool large = false;
+  bool list = false;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+double seconds(Clock::duration d){
+  return std::chrono::duration<double>(d).count();
+}
+
+Result measure(const Benchmark & bench, const Options & options){
+
+  Quiet quiet;
+  reset_peak_rss();
+
+  std::function<void()> op = bench.prepare();
+
+  // one untimed run, then size a batch to take at least min_time
+  Clock::time_point start = Clock::now();
+  op();
+  double once = std::max(seconds(Clock::now() - start), 1e-9);
+  std::size_t batch = std::max<std::size_t>(1, static_cast<std::size_t>(options.min_time / once));
+
+  std::vector<double> samples;
+  std::size_t allocs_before = allocation_count(), bytes_before = allocated_byte_count();
+
+  for(std::size_t s = 0; s < options.samples; ++s){
+    start = Clock::now();
+    for(std::size_t i = 0; i < batch; ++i)
+      op();
+    samples.push_back(seconds(Clock::now() - start) * 1e9 / batch);
+  }
+
+  Result result;
+  result.name = bench.name;
+  result.iterations = batch * options.samples;
+  result.allocs_per_op = double(allocation_count() - allocs_before) / result.iterations;
+  result.bytes_allocated_per_op = double(allocated_byte_count() - bytes_before) / result.iterations;
+
+  std::sort(samples.begin(), samples.end());
+  result.ns_per_op = samples[samples.size() / 2];
+  result.min_ns_per_op = samples.front();
+  result.mb_per_s = bench.bytes ? (bench.bytes / 1e6) / (result.ns_per_op / 1e9) : 0;
+  result.peak_rss_kb = peak_rss_kb();
+
+  return result;
+}
+
+// *****************************************************************************
+// Benchmarks
+// *****************************************************************************
+
+// a program of about the given size, mixing definitions, lambdas, numbers,
+// strings and comments
+std::string generated_program(std::size_t size){
+
+  std::ostringstream out;
+  out << "(begin\n";
+  for(std::size_t i = 0; out.tellp() < static_cast<std::streamoff>(size); ++i){
+    out << "  ; definition " << i << "\n"
+        << "  (define f" << i << " (lambda (x y) (+ (* x " << i << ".25) (- y 1e-3) (/ x 2))))\n"
+        << "  (define s" << i << " \"label " << i << "\")\n"
+        << "  (define l" << i << " (list " << i << " (f" << i << " 1 2) I -" << i << "))\n";
+  }
+  out << ")\n";
+  return out.str();
+}
+
+// an interpreter that has run setup, and the parsed program to time
+std::function<void()> evaluation(const std::string & setup, const std::string & program,
+                                 Interpreter::EvalMode mode){
+
+  std::shared_ptr<Interpreter> interp = std::make_shared<Interpreter>();
+  interp->setEvalMode(mode);
+
+  std::istringstream setup_stream(setup);
+  if(!setup.empty()){
+    if(!interp->parseStream(setup_stream))
+      throw SemanticError("benchmark setup does not parse: " + setup);
+    interp->evaluate();
+  }
+
+  std::istringstream program_stream(program);
+  if(!interp->parseStream(program_stream))
+    throw SemanticError("benchmark program does not parse: " + program);
+
+  return [interp](){
+    sink = sink + interp->evaluate().tailSize();
+  };
+}
+
+// add the benchmark once for each evaluation mode
+void both_modes(std::vector<Benchmark> & benches, const std::string & name,
+                const std::string & setup, const std::string & program){
+
+  benches.push_back({name + "/tree", 0, [setup, program](){
+    return evaluation(setup, program, Interpreter::TreeWalk);
+  }});
+  benches.push_back({name + "/vm", 0, [setup, program](){
+    return evaluation(setup, program, Interpreter::Bytecode);
+  }});
+}
+
+std::vector<Benchmark> benchmarks(const Options & options){
+
+  std::vector<Benchmark> benches;
+
+  // evaluation
+  both_modes(benches, "eval/arithmetic",
+             "(define g (lambda (x) (+ (* x x) (- x 1) (/ x 2) (* 3 (+ x 4)) (- (* 2 x) (/ 1 (+ x 1))))))",
+             "(length (map g (range 0 9999 1)))");
+
+  // the language has no conditional, so a recursion could not end; a
+  // chain of calls eight deep stands in for it
+  both_modes(benches, "eval/lambda-calls",
+             "(begin (define c0 (lambda (x) (+ x 1)))"
+             " (define c1 (lambda (x) (c0 (+ x 1)))) (define c2 (lambda (x) (c1 (+ x 1))))"
+             " (define c3 (lambda (x) (c2 (+ x 1)))) (define c4 (lambda (x) (c3 (+ x 1))))"
+             " (define c5 (lambda (x) (c4 (+ x 1)))) (define c6 (lambda (x) (c5 (+ x 1))))"
+             " (define c7 (lambda (x) (c6 (+ x 1)))))",
+             "(length (map c7 (range 0 9999 1)))");
+
+  // arguments that are calls to small lambdas, evaluated in turn, and
+  // arguments that each map a list, evaluated on the thread pool
+  both_modes(benches, "eval/small-call-args",
+             "(begin (define sq (lambda (x) (* x x)))"
+             " (define h (lambda (x) (+ (sq x) (sq (+ x 1))))))",
+             "(length (map h (range 0 9999 1)))");
+  both_modes(benches, "eval/map-args",
+             "(define sq (lambda (x) (* x x)))",
+             "(+ (length (map sq (range 0 9999 1))) (length (map sq (range 0 9999 1)))"
+             " (length (map sq (range 0 9999 1))) (length (map sq (range 0 9999 1))))");
+
+  // map over large lists, and discrete-plot of the mapped points
+  const char * double_it = "(define h (lambda (x) (* 2 x)))";
+  const char * point = "(define pt (lambda (x) (list x (* x x))))";
+
+  for(const char * n : {"10000", "100000", "1000000"}){
+    std::string size = std::to_string(std::atoi(n) / 1000) + "k";
+    both_modes(benches, std::string("map/") + size, double_it,
+               std::string("(length (map h (range 1 ") + n + " 1)))");
+  }
+
+  std::vector<const char *> plot_sizes = {"10000", "100000"};
+  if(options.large)
+    plot_sizes.push_back("1000000");
+  for(const char * n : plot_sizes){
+    std::string size = std::to_string(std::atoi(n) / 1000) + "k";
+    both_modes(benches, std::string("discrete-plot/") + size, point,
+               std::string("(discrete-plot (map pt (range 1 ") + n + " 1)) (list))");
+  }
+
+  // symbol lookup from a call frame eight deep, of a global among a
+  // thousand definitions and of a built-in procedure; an operation is one
+  // round over a fixed set of symbols (28 globals, 10 procedures)
+  benches.push_back({"env/lookup-global", 0, [](){
+    std::shared_ptr<std::vector<std::unique_ptr<Environment> > > frames =
+      std::make_shared<std::vector<std::unique_ptr<Environment> > >();
+    frames->emplace_back(new Environment);
+    for(int i = 0; i < 1000; ++i)
+      frames->front()->add_exp(Atom("g" + std::to_string(i)), Expression(double(i)));
+    for(int d = 0; d < 8; ++d){
+      frames->emplace_back(new Environment(frames->back().get()));
+      frames->back()->add_exp(Atom("p" + std::to_string(d)), Expression(double(d)), true);
+    }
+
+    std::shared_ptr<std::vector<Atom> > symbols = std::make_shared<std::vector<Atom> >();
+    for(int i = 0; i < 1000; i += 37)
+      symbols->push_back(Atom("g" + std::to_string(i)));
+
+    return std::function<void()>([frames, symbols](){
+      const Environment & inner = *frames->back();
+      for(const Atom & sym : *symbols)
+        sink = sink + inner.get_exp(sym).isHeadNumber();
+    });
+  }});
+
+  benches.push_back({"env/lookup-proc", 0, [](){
+    std::shared_ptr<Environment> global = std::make_shared<Environment>();
+    std::shared_ptr<Environment> frame = std::make_shared<Environment>(global.get());
+    frame->add_exp(Atom("x"), Expression(1.), true);
+
+    std::shared_ptr<std::vector<Atom> > symbols = std::make_shared<std::vector<Atom> >();
+    for(const char * name : {"+", "-", "*", "/", "sqrt", "first", "rest", "list", "length", "range"})
+      symbols->push_back(Atom(name));
+
+    return std::function<void()>([global, frame, symbols](){
+      for(const Atom & sym : *symbols)
+        sink = sink + (frame->get_proc(sym) != nullptr);
+    });
+  }});
+
+  // front end, over a program of about 1MB; run last, as the symbols it
+  // interns stay resident and would count toward later peaks
+  std::shared_ptr<std::string> source = std::make_shared<std::string>(generated_program(1 << 20));
+
+  benches.push_back({"tokenize/1MB", source->size(), [source](){
+    return std::function<void()>([source](){
+      sink = sink + lex(source->data(), source->size()).size();
+    });
+  }});
+  benches.push_back({"parse/1MB", source->size(), [source](){
+    return std::function<void()>([source](){
+      sink = sink + parse(source->data(), source->size()).tailSize();
+    });
+  }});
+
+  return benches;
+}
+
+// *****************************************************************************
+// Reporting
+// *****************************************************************************
+
+void print_header(){
+  std::cout << std::left << std::setw(28) << "benchmark"
+            << std::right << std::setw(14) << "ns/op"
+            << std::setw(14) << "allocs/op"
+            << std::setw(14) << "bytes/op"
+            << std::setw(10) << "MB/s"
+            << std::setw(12) << "peak KiB" << std::endl;
+}
+
+void print_row(const Result & r){
+  std::cout << std::left << std::setw(28) << r.name << std::right << std::fixed
+            << std::setprecision(1) << std::setw(14) << r.ns_per_op
+            << std::setw(14) << r.allocs_per_op
+            << std::setprecision(0) << std::setw(14) << r.bytes_allocated_per_op
+            << std::setprecision(1) << std::setw(10) << r.mb_per_s
+            << std::setw(12) << r.peak_rss_kb << std::endl;
+}
+
+void write_json(std::ostream & out, const std::vector<Result> & results, const Options & options){
+
+  out << "{\n"
+      << "  \"vector_isa\": \"" << vector_isa() << "\",\n"
+      << "  \"samples\": " << options.samples << ",\n"
+      << "  \"min_time_s\": " << options.min_time << ",\n"
+      << "  \"benchmarks\": [";
+
+  out << std::setprecision(6);
+  for(std::size_t i = 0; i < results.size(); ++i){
+    const Result & r = results[i];
+    out << (i ? ",\n" : "\n")
+        << "    {\"name\": \"" << r.name << "\""
+        << ", \"iterations\": " << r.iterations
+        << ", \"ns_per_op\": " << r.ns_per_op
+        << ", \"min_ns_per_op\": " << r.min_ns_per_op
+        << ", \"allocs_per_op\": " << r.allocs_per_op
+        << ", \"bytes_allocated_per_op\": " << r.bytes_allocated_per_op
+        << ", \"mb_per_s\": " << r.mb_per_s
+        << ", \"peak_rss_kb\": " << r.peak_rss_kb << "}";
+  }
+  out << "\n  ]\n}\n";
+}
+
+void usage(){
+  std::cerr << "Usage: plotscript_bench [--json FILE] [--filter TEXT] [--min-time SECONDS]\n"
+            << "                        [--samples N] [--large] [--list]\n"
+            << "  --json FILE      also write the results as JSON (- for standard output)\n"
+            << "  --filter TEXT    run only benchmarks whose name contains TEXT\n"
+            << "  --min-time S     time batches of at least S seconds (default 0.2)\n"
+            << "  --samples N      batches per benchmark, the median is reported (default 5)\n"
+            << "  --large          include the largest plots\n"
+            << "  --list           list the benchmarks without running them\n";
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+  Options options;
+
+  for(int i = 1; i < argc; ++i){
+    std::string option(argv[i]);
+    bool has_value = (i + 1 < argc);
+
+    if(option == "--json" && has_value)
+      options.json = argv[++i];
+    else if(option == "--filter" && has_value)
+      options.filter = argv[++i];
+    else if(option == "--min-time" && has_value)
+      options.min_time = std::atof(argv[++i]);
+    else if(option == "--samples" && has_value)
+      options.samples = std::max(1, std::atoi(argv[++i]));
+    else if(option == "--large")
+      options.large = true;
+    else if(option == "--list")
+      options.list = true;
+    else{
+      usage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  // the table is printed as results arrive, unless the JSON goes to
+  // standard output instead
+  bool json_to_stdout = (options.json == "-");
+  if(!options.list && !json_to_stdout)
+    print_header();
+
+  std::vector<Result> results;
+
+  for(const Benchmark & bench : benchmarks(options)){
+    if(bench.name.find(options.filter) == std::string::npos)
+      continue;
+
+    if(options.list){
+      std::cout << bench.name << "\n";
+      continue;
+    }
+
+    try{
+      results.push_back(measure(bench, options));
+    }
+    catch(const SemanticError & ex){
+      std::cerr << bench.name << ": " << ex.what() << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    if(!json_to_stdout)
+      print_row(results.back());
+  }
+
+  if(options.list)
+    return EXIT_SUCCESS;
+
+  if(json_to_stdout){
+    write_json(std::cout, results, options);
+  }
+  else if(!options.json.empty()){
+    std::ofstream out(options.json);
+    if(!out){
+      std::cerr << "Error: could not open " << options.json << " for writing." << std::endl;
+      return EXIT_FAILURE;
+    }
+    write_json(out, results, options);
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,145 @@
+#include "profiler.hpp"
+
+// system includes
+#include <algorithm>
+#include <iomanip>
+
+// module includes
+#include "eval_context.hpp"
+
+Profiler::Profiler(){
+  nodes.push_back(Node{0, 0, {}, Clock::duration::zero()});
+}
+
+std::size_t Profiler::name_index(const std::string & name){
+
+  auto found = indices.find(&name);
+  if(found != indices.end())
+    return found->second;
+
+  std::size_t index = names.size();
+  names.push_back(Name{&name, 0, 0, Clock::duration::zero(), Clock::duration::zero()});
+  indices.emplace(&name, index);
+  return index;
+}
+
+std::size_t Profiler::child(std::size_t parent, std::size_t name){
+
+  for(auto & c : nodes[parent].children){
+    if(c.first == name) return c.second;
+  }
+
+  std::size_t node = nodes.size();
+  nodes.push_back(Node{name, parent, {}, Clock::duration::zero()});
+  nodes[parent].children.emplace_back(name, node);
+  return node;
+}
+
+void Profiler::enter(const std::string & name){
+
+  std::size_t index = name_index(name);
+  std::size_t parent = open.empty() ? 0 : open.back().node;
+
+  ++names[index].calls;
+  ++names[index].active;
+
+  open.push_back(Open{child(parent, index), Clock::now(), Clock::duration::zero()});
+}
+
+void Profiler::leave() noexcept{
+
+  Open call = open.back();
+  open.pop_back();
+
+  Clock::duration elapsed = Clock::now() - call.start;
+  Clock::duration exclusive = elapsed - call.children;
+
+  Node & node = nodes[call.node];
+  Name & name = names[node.name];
+
+  node.exclusive += exclusive;
+  name.exclusive += exclusive;
+  if(--name.active == 0)
+    name.inclusive += elapsed;
+
+  if(!open.empty())
+    open.back().children += elapsed;
+}
+
+void Profiler::replace(const std::string & name){
+  leave();
+  enter(name);
+}
+
+std::size_t Profiler::depth() const noexcept{
+  return open.size();
+}
+
+void Profiler::unwind(std::size_t depth) noexcept{
+  while(open.size() > depth)
+    leave();
+}
+
+std::vector<Profiler::Entry> Profiler::entries() const{
+
+  std::vector<Entry> result;
+  for(const Name & n : names){
+    result.push_back(Entry{*n.text, n.calls,
+                           std::chrono::duration<double>(n.inclusive).count(),
+                           std::chrono::duration<double>(n.exclusive).count()});
+  }
+
+  std::stable_sort(result.begin(), result.end(), [](const Entry & a, const Entry & b){
+    return a.exclusive > b.exclusive;
+  });
+  return result;
+}
+
+void Profiler::report(std::ostream & out) const{
+
+  out << std::right << std::setw(12) << "calls"
+      << std::setw(16) << "inclusive ms"
+      << std::setw(16) << "exclusive ms" << "  name\n";
+
+  for(const Entry & e : entries()){
+    out << std::setw(12) << e.calls << std::fixed << std::setprecision(3)
+        << std::setw(16) << e.inclusive * 1e3
+        << std::setw(16) << e.exclusive * 1e3 << "  " << e.name << "\n";
+  }
+}
+
+void Profiler::writeFolded(std::ostream & out) const{
+
+  for(std::size_t i = 1; i < nodes.size(); ++i){
+    long long micros = std::chrono::duration_cast<std::chrono::microseconds>(nodes[i].exclusive).count();
+    if(micros == 0) continue;
+
+    // the path from the root, outermost name first
+    std::vector<std::size_t> path;
+    for(std::size_t n = i; n != 0; n = nodes[n].parent)
+      path.push_back(nodes[n].name);
+
+    for(auto it = path.rbegin(); it != path.rend(); ++it){
+      if(it != path.rbegin()) out << ';';
+      out << *names[*it].text;
+    }
+    out << ' ' << micros << '\n';
+  }
+}
+
+const std::string & profiled_name(const Atom & op){
+  static const std::string anonymous("lambda");
+  return (op.isSymbol() || op.isString()) ? op.asSymbol() : anonymous;
+}
+
+Profiler::Scope::Scope(Profiler * profiler) noexcept
+  : profiler(profiler), saved(EvalContext::current().profiler()),
+    depth(profiler ? profiler->depth() : 0) {
+  EvalContext::current().setProfiler(profiler);
+}
+
+Profiler::Scope::~Scope(){
+  if(profiler)
+    profiler->unwind(depth);
+  EvalContext::current().setProfiler(saved);
+}
@@ -0,0 +1,151 @@
+/*! \file profiler.hpp
+Defines the Profiler, which times evaluation by procedure, lambda and
+special form.
+ */
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+// system includes
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// module includes
+#include "atom.hpp"
+
+/*! \class Profiler
+\brief Attributes evaluation time and calls to the names being evaluated.
+
+The evaluators report each call of a built-in procedure, each lambda body
+(named by the symbol the lambda was called through) and each special form
+they evaluate as an enter/leave pair, when a profiler is installed on the
+evaluating thread (see Scope). The profiler keeps the tree of calls, from
+which it reports inclusive and exclusive time per name and writes folded
+stacks for flame-graph tools.
+
+Time is inclusive of everything evaluated inside a call; a name that
+recurses is counted once, for its outermost call. Only the installing
+thread is profiled: the workers of a pmap are not, their time is that of
+the pmap form.
+ */
+class Profiler {
+public:
+
+  /// Time and calls of one name
+  struct Entry {
+    std::string name;
+    std::size_t calls;
+    double inclusive; //< seconds
+    double exclusive; //< seconds
+  };
+
+  Profiler();
+
+  /*! Start timing a call nested in the calls open now
+    \param name the name timed, which must outlive the profiler; interned
+    symbol names do
+   */
+  void enter(const std::string & name);
+
+  /// Stop timing the innermost open call
+  void leave() noexcept;
+
+  /// Stop timing the innermost open call and start timing name in its place, for a tail call
+  void replace(const std::string & name);
+
+  /// Number of open calls
+  std::size_t depth() const noexcept;
+
+  /// Stop timing open calls until depth() is depth, for calls abandoned by an exception
+  void unwind(std::size_t depth) noexcept;
+
+  /// Per-name totals, most exclusive time first
+  std::vector<Entry> entries() const;
+
+  /// Write a table of entries()
+  void report(std::ostream & out) const;
+
+  /*! Write one line per call stack, "outer;inner;innermost N", where N is
+    the exclusive time in microseconds, the input of flamegraph.pl and
+    similar tools
+   */
+  void writeFolded(std::ostream & out) const;
+
+  /*! \class Scope
+  \brief Installs a profiler on the calling thread while in scope, and
+  stops timing any calls left open when it ends.
+   */
+  class Scope {
+  public:
+    explicit Scope(Profiler * profiler) noexcept;
+    ~Scope();
+
+    Scope(const Scope &) = delete;
+    Scope & operator=(const Scope &) = delete;
+
+  private:
+    Profiler * profiler;
+    Profiler * saved;
+    std::size_t depth;
+  };
+
+  /*! \class Call
+  \brief Times a call while in scope, when profiler is not null.
+   */
+  class Call {
+  public:
+    Call(Profiler * profiler, const std::string & name): profiler(profiler) {
+      if(profiler) profiler->enter(name);
+    }
+    ~Call() { if(profiler) profiler->leave(); }
+
+    Call(const Call &) = delete;
+    Call & operator=(const Call &) = delete;
+
+  private:
+    Profiler * profiler;
+  };
+
+private:
+
+  typedef std::chrono::steady_clock Clock;
+
+  // a node of the call tree, one per distinct stack of names
+  struct Node {
+    std::size_t name;
+    std::size_t parent;
+    std::vector<std::pair<std::size_t, std::size_t> > children; // name, node
+    Clock::duration exclusive;
+  };
+
+  struct Name {
+    const std::string * text;
+    std::size_t calls;
+    std::size_t active; // open calls, only the outermost adds inclusive time
+    Clock::duration inclusive;
+    Clock::duration exclusive;
+  };
+
+  struct Open {
+    std::size_t node;
+    Clock::time_point start;
+    Clock::duration children;
+  };
+
+  std::size_t name_index(const std::string & name);
+  std::size_t child(std::size_t parent, std::size_t name);
+
+  std::vector<Node> nodes; // nodes[0] is the root, above every call
+  std::vector<Name> names;
+  std::unordered_map<const std::string *, std::size_t> indices;
+  std::vector<Open> open;
+};
+
+/// The name a call of op is profiled under: the symbol, or "lambda"
+const std::string & profiled_name(const Atom & op);
+
+#endif
@@ -0,0 +1,123 @@
+#include "catch.hpp"
+
+#include <sstream>
+#include <string>
+
+#include "interpreter.hpp"
+#include "profiler.hpp"
+#include "semantic_error.hpp"
+
+// the entry of the named calls, with no calls if there is none
+static Profiler::Entry entry(const Profiler & profiler, const std::string & name){
+  for(auto & e : profiler.entries()){
+    if(e.name == name) return e;
+  }
+  return Profiler::Entry{name, 0, 0, 0};
+}
+
+TEST_CASE( "Test profiler call tree", "[profiler]" ) {
+
+  const std::string outer("outer"), inner("inner");
+
+  Profiler profiler;
+  profiler.enter(outer);
+  profiler.enter(inner);
+  profiler.enter(outer);
+  REQUIRE(profiler.depth() == 3);
+  profiler.leave();
+  profiler.leave();
+  profiler.enter(inner);
+  profiler.leave();
+  profiler.leave();
+  REQUIRE(profiler.depth() == 0);
+
+  REQUIRE(entry(profiler, "outer").calls == 2);
+  REQUIRE(entry(profiler, "inner").calls == 2);
+
+  {
+    INFO("a recursive name is inclusive of its outermost call only");
+    Profiler::Entry e = entry(profiler, "outer");
+    REQUIRE(e.inclusive >= e.exclusive);
+    REQUIRE(e.inclusive >= entry(profiler, "inner").inclusive);
+  }
+
+  {
+    INFO("unwind stops the calls left open");
+    profiler.enter(outer);
+    profiler.enter(inner);
+    profiler.unwind(0);
+    REQUIRE(profiler.depth() == 0);
+    REQUIRE(entry(profiler, "outer").calls == 3);
+  }
+
+  {
+    INFO("a tail call replaces the innermost call");
+    profiler.enter(outer);
+    profiler.replace(inner);
+    REQUIRE(profiler.depth() == 1);
+    profiler.leave();
+    REQUIRE(entry(profiler, "inner").calls == 4);
+  }
+}
+
+TEST_CASE( "Test profiler folded stacks", "[profiler]" ) {
+
+  const std::string outer("outer"), inner("inner");
+
+  Profiler profiler;
+  profiler.enter(outer);
+  profiler.enter(inner);
+  for(volatile int i = 0; i < 2000000; i = i + 1) {}
+  profiler.leave();
+  profiler.leave();
+
+  std::ostringstream folded;
+  profiler.writeFolded(folded);
+  REQUIRE(folded.str().find("outer;inner ") != std::string::npos);
+}
+
+TEST_CASE( "Test profiling evaluation", "[profiler]" ) {
+
+  const std::string program =
+    "(begin (define f (lambda (x) (+ x 1))) (define g (lambda (x) (- (f (* 2 x)) 1))) (map g (list 1 2 3)))";
+
+  for(auto mode : {Interpreter::TreeWalk, Interpreter::Bytecode}){
+    Profiler profiler;
+    Interpreter interp;
+    interp.setEvalMode(mode);
+    interp.setProfiler(&profiler);
+
+    std::istringstream stream(program);
+    REQUIRE(interp.parseStream(stream));
+    interp.evaluate();
+
+    INFO("lambdas by the symbol they are called through, procedures by name");
+    REQUIRE(entry(profiler, "g").calls == 3);
+    REQUIRE(entry(profiler, "f").calls == 3);
+    REQUIRE(entry(profiler, "+").calls == 3);
+    REQUIRE(entry(profiler, "*").calls == 3);
+    REQUIRE(entry(profiler, "-").calls == 3);
+    REQUIRE(entry(profiler, "g").inclusive >= entry(profiler, "f").inclusive);
+    REQUIRE(profiler.depth() == 0);
+
+    if(mode == Interpreter::TreeWalk){
+      INFO("special forms by keyword");
+      REQUIRE(entry(profiler, "begin").calls == 1);
+      REQUIRE(entry(profiler, "map").calls == 1);
+    }
+  }
+
+  {
+    INFO("an error leaves no call open");
+    Profiler profiler;
+    Interpreter interp;
+    interp.setProfiler(&profiler);
+
+    std::istringstream stream("(begin (define h (lambda (x) (first x))) (h 1))");
+    REQUIRE(interp.parseStream(stream));
+    REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+    REQUIRE(profiler.depth() == 0);
+    REQUIRE(entry(profiler, "h").calls == 1);
+    REQUIRE(entry(profiler, "first").calls == 1);
+  }
+}
@@ -0,0 +1,124 @@
+#include "catch.hpp"
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "expression.hpp"
+#include "spsc_queue.hpp"
+#include "thread_safe_queue.hpp"
+
+TEST_CASE( "Test single producer queue order and capacity", "[queue]" ) {
+
+  SpscQueue<int> queue(3);
+  REQUIRE(queue.capacity() == 4);
+  REQUIRE(queue.empty());
+
+  int popped = 0;
+  REQUIRE_FALSE(queue.try_pop(popped));
+
+  for(int round = 0; round < 3; ++round){
+    INFO("the ring wraps around");
+    for(int i = 0; i < 4; ++i){
+      REQUIRE(queue.try_push(round * 10 + i));
+    }
+    REQUIRE_FALSE(queue.try_push(99));
+
+    for(int i = 0; i < 4; ++i){
+      REQUIRE(queue.try_pop(popped));
+      REQUIRE(popped == round * 10 + i);
+    }
+    REQUIRE(queue.empty());
+  }
+
+  {
+    INFO("a timed wait on an empty queue times out");
+    auto start = std::chrono::steady_clock::now();
+    REQUIRE_FALSE(queue.wait_for_pop(popped, std::chrono::milliseconds(20)));
+    REQUIRE(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(20));
+  }
+}
+
+TEST_CASE( "Test single producer queue between threads", "[queue]" ) {
+
+  const int n = 100000;
+  SpscQueue<std::string> requests(8);
+  SpscQueue<int> replies(2);
+
+  std::thread consumer([&](){
+    std::string s;
+    for(int i = 0; i < n; ++i){
+      requests.wait_and_pop(s);
+      replies.push(std::stoi(s));
+    }
+  });
+
+  int expected = 0;
+  bool in_order = true;
+  int reply = 0;
+  for(int i = 0; i < n; ++i){
+    requests.push(std::to_string(i));
+    while(replies.try_pop(reply)){
+      in_order = in_order && (reply == expected++);
+    }
+  }
+  while(expected < n){
+    REQUIRE(replies.wait_for_pop(reply, std::chrono::seconds(10)));
+    in_order = in_order && (reply == expected++);
+  }
+
+  consumer.join();
+  REQUIRE(in_order);
+  REQUIRE(requests.empty());
+  REQUIRE(replies.empty());
+}
+
+TEST_CASE( "Test thread safe queue timed wait", "[queue]" ) {
+
+  ThreadSafeQueue<std::string> queue;
+  std::string popped;
+  REQUIRE_FALSE(queue.wait_for_pop(popped, std::chrono::milliseconds(10)));
+
+  std::thread producer([&queue](){
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    queue.push(std::string("later"));
+  });
+  REQUIRE(queue.wait_for_pop(popped, std::chrono::seconds(10)));
+  REQUIRE(popped == "later");
+  producer.join();
+}
+
+TEST_CASE( "Test evaluation outcomes are moved through the queues", "[queue]" ) {
+
+  REQUIRE_FALSE(std::is_copy_constructible<output_type>::value);
+  REQUIRE(std::is_nothrow_move_constructible<output_type>::value);
+
+  output_type empty;
+  REQUIRE_FALSE(empty.isError());
+  REQUIRE(empty.expression() == Expression());
+
+  std::vector<Expression> items(1000, Expression(Atom(1.0)));
+  Expression list(std::move(items));
+
+  ThreadSafeQueue<output_type> results;
+  results.push(output_type::result(std::move(list)));
+  results.push(output_type::failure("Error: bad"));
+
+  SpscQueue<output_type> relay(2);
+  output_type popped;
+  while(results.try_pop(popped)){
+    relay.push(std::move(popped));
+  }
+
+  REQUIRE(relay.try_pop(popped));
+  REQUIRE_FALSE(popped.isError());
+  Expression taken = popped.takeExpression();
+  REQUIRE(taken.tailConstEnd() - taken.tailConstBegin() == 1000);
+  REQUIRE(*taken.tailConstBegin() == Expression(Atom(1.0)));
+
+  REQUIRE(relay.try_pop(popped));
+  REQUIRE(popped.isError());
+  REQUIRE(popped.message() == "Error: bad");
+}
@@ -0,0 +1,206 @@
+#include "session_pool.hpp"
+
+// system includes
+#include <algorithm>
+#include <exception>
+#include <future>
+#include <utility>
+
+// module includes
+#include "semantic_error.hpp"
+
+const std::size_t SessionPool::DefaultMaxSessions;
+const std::chrono::minutes SessionPool::DefaultIdleTimeout(10);
+
+SessionPool::SessionPool(std::size_t workers, Setup setup, const Environment & base)
+  : setup(std::move(setup)), base(base), stopping(false),
+    max_sessions(DefaultMaxSessions), idle_timeout(DefaultIdleTimeout),
+    next_sweep(Clock::now() + idle_timeout) {
+
+  if(workers == 0) workers = 1;
+
+  for(std::size_t i = 0; i < workers; ++i){
+    threads.emplace_back(&SessionPool::work, this);
+  }
+}
+
+SessionPool::~SessionPool(){
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+
+  for(auto & t : threads){
+    t.join();
+  }
+}
+
+std::size_t SessionPool::workers() const noexcept{
+  return threads.size();
+}
+
+std::size_t SessionPool::sessions() const{
+  std::lock_guard<std::mutex> lock(mutex);
+  return open.size();
+}
+
+void SessionPool::setMaxSessions(std::size_t sessions){
+  std::lock_guard<std::mutex> lock(mutex);
+  max_sessions = std::max<std::size_t>(sessions, 1);
+}
+
+std::size_t SessionPool::maxSessions() const{
+  std::lock_guard<std::mutex> lock(mutex);
+  return max_sessions;
+}
+
+void SessionPool::setIdleTimeout(std::chrono::milliseconds timeout){
+  std::lock_guard<std::mutex> lock(mutex);
+  idle_timeout = timeout;
+  next_sweep = Clock::now() + idle_timeout;
+}
+
+std::chrono::milliseconds SessionPool::idleTimeout() const{
+  std::lock_guard<std::mutex> lock(mutex);
+  return idle_timeout;
+}
+
+Interpreter SessionPool::make_interpreter() const{
+  Interpreter interp(base);
+  if(setup) setup(interp);
+  return interp;
+}
+
+void SessionPool::submit(const std::string & session, std::string program, Done done){
+
+  // a new session's interpreter is prepared before taking the lock, and
+  // dropped if another submit made the session first
+  std::shared_ptr<Session> made;
+
+  std::unique_lock<std::mutex> lock(mutex);
+  auto found = open.find(session);
+  if(found == open.end()){
+
+    // closing a session that is not open needs no room
+    if(program == "%close"){
+      lock.unlock();
+      done(output_type());
+      return;
+    }
+
+    lock.unlock();
+    made = std::make_shared<Session>(Session{session, make_interpreter(), {}, false, Clock::time_point()});
+    lock.lock();
+
+    found = open.find(session);
+    if(found == open.end()){
+      if(!make_room(Clock::now())){
+        lock.unlock();
+        done(output_type::failure("Error: too many open sessions."));
+        return;
+      }
+      found = open.emplace(session, std::move(made)).first;
+    }
+  }
+
+  std::shared_ptr<Session> s = found->second;
+  s->pending.push_back(Request{std::move(program), std::move(done)});
+  s->used = Clock::now();
+
+  // later programs under this name go to a new session
+  if(s->pending.back().program == "%close"){
+    open.erase(found);
+  }
+
+  if(!s->scheduled){
+    s->scheduled = true;
+    ready.push_back(std::move(s));
+    lock.unlock();
+    wake.notify_one();
+  }
+}
+
+output_type SessionPool::evaluate(const std::string & session, std::string program){
+
+  auto outcome = std::make_shared<std::promise<output_type> >();
+  std::future<output_type> result = outcome->get_future();
+
+  submit(session, std::move(program), [outcome](output_type && out){
+    outcome->set_value(std::move(out));
+  });
+
+  return result.get();
+}
+
+void SessionPool::work(){
+
+  std::unique_lock<std::mutex> lock(mutex);
+  while(true){
+    wake.wait(lock, [this]{ return stopping || !ready.empty(); });
+    if(ready.empty()) return; // stopping, with nothing left to run
+
+    std::shared_ptr<Session> session = std::move(ready.front());
+    ready.pop_front();
+    Request request = std::move(session->pending.front());
+    session->pending.pop_front();
+    lock.unlock();
+
+    request.done(run(*session, request.program));
+
+    // the session stays with no worker while it is idle, and otherwise
+    // goes behind the others waiting
+    lock.lock();
+    session->used = Clock::now();
+    if(session->pending.empty())
+      session->scheduled = false;
+    else
+      ready.push_back(std::move(session));
+  }
+}
+
+bool SessionPool::make_room(Clock::time_point now){
+
+  // sweeping costs a pass over the sessions, so it waits for the limit or
+  // for the timeout to come round again
+  if(open.size() < max_sessions && now < next_sweep)
+    return true;
+  next_sweep = now + idle_timeout;
+
+  for(auto s = open.begin(); s != open.end();){
+    const Session & session = *s->second;
+    if(!session.scheduled && (now - session.used >= idle_timeout))
+      s = open.erase(s);
+    else
+      ++s;
+  }
+
+  return open.size() < max_sessions;
+}
+
+output_type SessionPool::run(Session & session, const std::string & program){
+
+  if(program == "%reset"){
+    session.interp = make_interpreter();
+    return output_type();
+  }
+  if(program == "%close"){
+    return output_type();
+  }
+
+  Interpreter & interp = session.interp;
+  if(!interp.parseBuffer(program.data(), program.size())){
+    return output_type::failure("Error: Invalid Expression. Could not parse.");
+  }
+
+  try{
+    return output_type::result(interp.evaluate());
+  }
+  catch(const SemanticError & ex){
+    return output_type::failure(ex.what());
+  }
+  catch(const std::exception & ex){
+    // one session's failure must not take the others' worker down
+    return output_type::failure(std::string("Error: ") + ex.what());
+  }
+}
@@ -0,0 +1,146 @@
+/*! \file session_pool.hpp
+Defines the SessionPool, which evaluates programs for many independent
+interpreter sessions on a fixed set of worker threads.
+ */
+#ifndef SESSION_POOL_HPP
+#define SESSION_POOL_HPP
+
+// system includes
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// module includes
+#include "interpreter.hpp"
+#include "thread_safe_queue.hpp"
+
+/*! \class SessionPool
+\brief Interpreter sessions, named by the caller, sharing worker threads.
+
+Each session has its own Interpreter and so its own environment; it is made
+by the first program submitted under its name. A session's programs are
+evaluated one at a time in the order submitted; programs of different
+sessions run in parallel, one session per worker at a time, taking turns
+a program each.
+
+Two programs are commands rather than plotscript: "%reset" gives the
+session a new interpreter, and "%close" ends it, so that a later program
+under its name starts a new one.
+
+At most maxSessions() sessions are open at once. A session that has had
+nothing to run for idleTimeout() is closed when a new session needs room,
+and also every idleTimeout() as new sessions are made; a program for a new
+session that finds no room fails with an error.
+ */
+class SessionPool {
+public:
+
+  /// Prepares each new interpreter (evaluation mode, time budget, startup)
+  typedef std::function<void(Interpreter &)> Setup;
+
+  /// Receives the outcome of a program, on the worker that evaluated it
+  typedef std::function<void(output_type &&)> Done;
+
+  typedef std::chrono::steady_clock Clock;
+
+  /// Sessions open at once unless setMaxSessions says otherwise
+  static const std::size_t DefaultMaxSessions = 1024;
+
+  /// How long a session may sit idle unless setIdleTimeout says otherwise
+  static const std::chrono::minutes DefaultIdleTimeout;
+
+  /*! Start the workers
+    \param workers the number of worker threads, at least one is started
+    \param setup called on each new interpreter, may be empty
+    \param base the environment each session starts from, shared until
+    the session defines a symbol (see Environment)
+   */
+  explicit SessionPool(std::size_t workers, Setup setup = Setup(),
+                       const Environment & base = Environment());
+
+  /// Finish the programs submitted, then stop the workers
+  ~SessionPool();
+
+  SessionPool(const SessionPool &) = delete;
+  SessionPool & operator=(const SessionPool &) = delete;
+
+  /*! Queue a program for a session, returning at once
+    \param session the session's name
+    \param program the program text, or a command
+    \param done called with the outcome once the program is evaluated
+   */
+  void submit(const std::string & session, std::string program, Done done);
+
+  /// Evaluate a program for a session, waiting for its outcome
+  output_type evaluate(const std::string & session, std::string program);
+
+  /// Number of open sessions
+  std::size_t sessions() const;
+
+  /// Number of worker threads
+  std::size_t workers() const noexcept;
+
+  /// Set the most sessions open at once, at least one
+  void setMaxSessions(std::size_t sessions);
+
+  /// The most sessions open at once
+  std::size_t maxSessions() const;
+
+  /// Set how long a session may have nothing to run before it may be closed
+  void setIdleTimeout(std::chrono::milliseconds timeout);
+
+  /// How long a session may have nothing to run before it may be closed
+  std::chrono::milliseconds idleTimeout() const;
+
+private:
+
+  struct Request {
+    std::string program;
+    Done done;
+  };
+
+  struct Session {
+    std::string name;
+    Interpreter interp;
+    std::deque<Request> pending;
+    bool scheduled; // in ready, or being run by a worker
+    Clock::time_point used; // when it last had a program queued or run
+  };
+
+  // worker thread loop
+  void work();
+
+  // evaluate one program, or carry out a command, for session
+  output_type run(Session & session, const std::string & program);
+
+  // a new interpreter, prepared by setup
+  Interpreter make_interpreter() const;
+
+  // close the sessions idle since before now less the idle timeout, with
+  // the lock held; true if a new session then has room
+  bool make_room(Clock::time_point now);
+
+  Setup setup;
+  const Environment base;
+
+  mutable std::mutex mutex;
+  std::condition_variable wake;
+  std::unordered_map<std::string, std::shared_ptr<Session> > open;
+  std::deque<std::shared_ptr<Session> > ready; // sessions with programs to run
+  bool stopping;
+  std::size_t max_sessions;
+  std::chrono::milliseconds idle_timeout;
+  Clock::time_point next_sweep; // when make_room next closes idle sessions unasked
+
+  std::vector<std::thread> threads;
+};
+
+#endif
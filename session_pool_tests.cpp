@@ -0,0 +1,172 @@
+#include "catch.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "session_pool.hpp"
+#include "session_server.hpp"
+
+// the printed result of a program, or its error message
+static std::string outcome_text(output_type && outcome){
+  if(outcome.isError()) return outcome.message();
+  std::ostringstream printed;
+  printed << outcome.expression();
+  return printed.str();
+}
+
+TEST_CASE( "Test sessions are isolated and keep their environment", "[session_pool]" ) {
+
+  SessionPool pool(2);
+  REQUIRE(pool.workers() == 2);
+
+  REQUIRE_FALSE(pool.evaluate("a", "(define x 1)").isError());
+  REQUIRE_FALSE(pool.evaluate("b", "(define x 2)").isError());
+  REQUIRE(pool.sessions() == 2);
+
+  REQUIRE(outcome_text(pool.evaluate("a", "(+ x 10)")) == "(11)");
+  REQUIRE(outcome_text(pool.evaluate("b", "(+ x 10)")) == "(12)");
+  REQUIRE(pool.evaluate("a", "(define x 3)").isError());
+  REQUIRE(pool.evaluate("a", "(1 2").isError());
+
+  {
+    INFO("%reset gives the session a new environment");
+    REQUIRE_FALSE(pool.evaluate("a", "%reset").isError());
+    REQUIRE(pool.evaluate("a", "x").isError());
+    REQUIRE_FALSE(pool.evaluate("a", "(define x 4)").isError());
+  }
+
+  {
+    INFO("%close ends the session, the name may be used again");
+    REQUIRE_FALSE(pool.evaluate("b", "%close").isError());
+    REQUIRE(pool.sessions() == 1);
+    REQUIRE(pool.evaluate("b", "x").isError());
+    REQUIRE(pool.sessions() == 2);
+  }
+}
+
+TEST_CASE( "Test the number of open sessions is limited", "[session_pool]" ) {
+
+  SessionPool pool(1);
+  REQUIRE(pool.maxSessions() == SessionPool::DefaultMaxSessions);
+  pool.setMaxSessions(2);
+  pool.setIdleTimeout(std::chrono::hours(1));
+
+  REQUIRE_FALSE(pool.evaluate("a", "(define x 1)").isError());
+  REQUIRE_FALSE(pool.evaluate("b", "(define x 2)").isError());
+
+  {
+    INFO("a new session finds no room while the others are fresh");
+    output_type refused = pool.evaluate("c", "(define x 3)");
+    REQUIRE(refused.isError());
+    REQUIRE(refused.message() == "Error: too many open sessions.");
+    REQUIRE(pool.sessions() == 2);
+    REQUIRE(outcome_text(pool.evaluate("a", "(+ x 0)")) == "(1)");
+  }
+
+  {
+    INFO("closing a session that is not open needs no room");
+    REQUIRE_FALSE(pool.evaluate("c", "%close").isError());
+    REQUIRE_FALSE(pool.evaluate("b", "%close").isError());
+    REQUIRE_FALSE(pool.evaluate("c", "(define x 3)").isError());
+    REQUIRE(pool.sessions() == 2);
+  }
+
+  {
+    INFO("idle sessions are closed to make room");
+    pool.setIdleTimeout(std::chrono::milliseconds(0));
+    REQUIRE_FALSE(pool.evaluate("d", "(define x 4)").isError());
+
+    // c may still be finishing on the worker when d is made, but a is not
+    REQUIRE(pool.sessions() <= 2);
+    REQUIRE(outcome_text(pool.evaluate("a", "(+ x 0)")) ==
+            "Error during evaluation: unknown symbol");
+  }
+}
+
+TEST_CASE( "Test session programs run in order, sessions in parallel", "[session_pool]" ) {
+
+  const int sessions = 8, programs = 50;
+
+  std::mutex mutex;
+  std::map<std::string, std::vector<std::string> > results;
+
+  {
+    SessionPool pool(3, [](Interpreter & interp){ interp.setEvalMode(Interpreter::Bytecode); });
+
+    // each program needs the definition made by the one before it
+    for(int p = 0; p < programs; ++p){
+      for(int s = 0; s < sessions; ++s){
+        std::string name = "s" + std::to_string(s);
+        std::string program = (p == 0)
+          ? "(define k0 " + std::to_string(s) + ")"
+          : "(define k" + std::to_string(p) + " (+ k" + std::to_string(p - 1) + " 1))";
+
+        pool.submit(name, program, [&mutex, &results, name](output_type && outcome){
+          std::string text = outcome_text(std::move(outcome));
+          std::lock_guard<std::mutex> lock(mutex);
+          results[name].push_back(text);
+        });
+      }
+    }
+  } // the pool finishes what was submitted
+
+  REQUIRE(results.size() == static_cast<std::size_t>(sessions));
+  for(int s = 0; s < sessions; ++s){
+    const std::vector<std::string> & r = results["s" + std::to_string(s)];
+    REQUIRE(r.size() == static_cast<std::size_t>(programs));
+    REQUIRE(r.back() == "(" + std::to_string(s + programs - 1) + ")");
+  }
+}
+
+TEST_CASE( "Test session server protocol", "[session_pool]" ) {
+
+  const std::string path = "/tmp/plotscript_test_" + std::to_string(::getpid()) + ".sock";
+
+  SessionPool pool(2);
+  SessionServer server(pool, path);
+  std::thread serving([&server](){ server.run(); });
+
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  std::strcpy(address.sun_path, path.c_str());
+  REQUIRE(::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0);
+
+  // requests go out without waiting for responses
+  REQUIRE(write_request(fd, ServerRequest{"one", "(define a 2)"}));
+  REQUIRE(write_request(fd, ServerRequest{"two", "(first 1)"}));
+  REQUIRE(write_request(fd, ServerRequest{"one", "(* a 21)"}));
+  ::shutdown(fd, SHUT_WR);
+
+  std::vector<ServerResponse> one, two;
+  ServerResponse response;
+  while(read_response(fd, response)){
+    (response.session == "one" ? one : two).push_back(response);
+  }
+  ::close(fd);
+
+  REQUIRE(one.size() == 2);
+  REQUIRE_FALSE(one[0].error);
+  REQUIRE(one[0].text == "(2)");
+  REQUIRE_FALSE(one[1].error);
+  REQUIRE(one[1].text == "(42)");
+
+  REQUIRE(two.size() == 1);
+  REQUIRE(two[0].error);
+  REQUIRE(two[0].text == "Error in call to first: argument to first is not a list.");
+
+  server.stop();
+  serving.join();
+}
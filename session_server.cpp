@@ -0,0 +1,223 @@
+#include "session_server.hpp"
+
+// system includes
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+// read exactly size bytes, false at end of stream or on an error
+bool read_all(int fd, char * data, std::size_t size){
+  while(size > 0){
+    ssize_t got = ::read(fd, data, size);
+    if(got < 0 && errno == EINTR) continue;
+    if(got <= 0) return false;
+    data += got;
+    size -= static_cast<std::size_t>(got);
+  }
+  return true;
+}
+
+// write all of data, false if the socket was closed; a closed peer must
+// not raise SIGPIPE
+bool write_all(int fd, const char * data, std::size_t size){
+  while(size > 0){
+    ssize_t put = ::send(fd, data, size, MSG_NOSIGNAL);
+    if(put < 0 && errno == EINTR) continue;
+    if(put <= 0) return false;
+    data += put;
+    size -= static_cast<std::size_t>(put);
+  }
+  return true;
+}
+
+void put_length(std::string & frame, std::size_t length){
+  for(int shift = 24; shift >= 0; shift -= 8){
+    frame.push_back(static_cast<char>((length >> shift) & 0xff));
+  }
+}
+
+bool read_length(int fd, std::uint32_t & length){
+  unsigned char bytes[4];
+  if(!read_all(fd, reinterpret_cast<char *>(bytes), 4)) return false;
+  length = (std::uint32_t(bytes[0]) << 24) | (std::uint32_t(bytes[1]) << 16) |
+           (std::uint32_t(bytes[2]) << 8) | std::uint32_t(bytes[3]);
+  return length <= MaxFrameField;
+}
+
+bool read_text(int fd, std::uint32_t length, std::string & text){
+  text.resize(length);
+  return (length == 0) || read_all(fd, &text[0], length);
+}
+
+}
+
+bool read_request(int fd, ServerRequest & request){
+
+  std::uint32_t session_length, program_length;
+  return read_length(fd, session_length) && read_length(fd, program_length) &&
+    read_text(fd, session_length, request.session) &&
+    read_text(fd, program_length, request.program);
+}
+
+bool write_request(int fd, const ServerRequest & request){
+
+  std::string frame;
+  frame.reserve(8 + request.session.size() + request.program.size());
+  put_length(frame, request.session.size());
+  put_length(frame, request.program.size());
+  frame += request.session;
+  frame += request.program;
+  return write_all(fd, frame.data(), frame.size());
+}
+
+bool read_response(int fd, ServerResponse & response){
+
+  std::uint32_t session_length, text_length;
+  char error;
+  if(!read_length(fd, session_length) || !read_all(fd, &error, 1) || !read_length(fd, text_length))
+    return false;
+
+  response.error = (error != 0);
+  return read_text(fd, session_length, response.session) &&
+    read_text(fd, text_length, response.text);
+}
+
+bool write_response(int fd, const ServerResponse & response){
+
+  std::string frame;
+  frame.reserve(9 + response.session.size() + response.text.size());
+  put_length(frame, response.session.size());
+  frame.push_back(response.error ? 1 : 0);
+  put_length(frame, response.text.size());
+  frame += response.session;
+  frame += response.text;
+  return write_all(fd, frame.data(), frame.size());
+}
+
+/***********************************************************************
+A connection is shared by its reader thread and the callbacks of its
+requests still in the pool, and closed when the last of them lets go: the
+peer sees the end of the stream after its last response, and a response is
+never written to a reused descriptor.
+**********************************************************************/
+
+struct SessionServer::Connection {
+  explicit Connection(int fd): fd(fd) {}
+  ~Connection() { ::close(fd); }
+
+  int fd;
+  std::mutex writing; // one response at a time
+};
+
+SessionServer::SessionServer(SessionPool & pool, const std::string & path)
+  : pool(pool), path(path), listener(-1), stopped(false) {
+
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if(path.empty() || path.size() >= sizeof(address.sun_path))
+    throw std::runtime_error("Error: invalid socket path " + path);
+  std::strcpy(address.sun_path, path.c_str());
+
+  listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if(listener < 0)
+    throw std::runtime_error(std::string("Error: could not make socket: ") + std::strerror(errno));
+
+  ::unlink(path.c_str());
+  if(::bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+     ::listen(listener, SOMAXCONN) != 0){
+    std::string reason = std::strerror(errno);
+    ::close(listener);
+    throw std::runtime_error("Error: could not listen on " + path + ": " + reason);
+  }
+}
+
+SessionServer::~SessionServer(){
+
+  stop();
+
+  // end the readers blocked on their connections; the responses still to
+  // come fail to write and are dropped
+  for(auto & r : readers){
+    if(auto connection = r.connection.lock())
+      ::shutdown(connection->fd, SHUT_RDWR);
+  }
+  for(auto & r : readers){
+    r.thread.join();
+  }
+
+  ::close(listener);
+  ::unlink(path.c_str());
+}
+
+void SessionServer::stop() noexcept{
+  stopped.store(true);
+  ::shutdown(listener, SHUT_RDWR);
+}
+
+void SessionServer::run(){
+
+  while(!stopped.load()){
+    int fd = ::accept(listener, nullptr, nullptr);
+    if(fd < 0){
+      if(errno == EINTR || errno == ECONNABORTED) continue;
+      break; // stopped, or the socket failed
+    }
+
+    reap();
+
+    auto connection = std::make_shared<Connection>(fd);
+    auto finished = std::make_shared<std::atomic<bool> >(false);
+    readers.push_back(Reader{connection, std::thread(), finished});
+    readers.back().thread = std::thread([this, connection, finished](){
+      serve(connection);
+      finished->store(true);
+    });
+  }
+}
+
+void SessionServer::reap(){
+  for(auto r = readers.begin(); r != readers.end();){
+    if(r->finished->load()){
+      r->thread.join();
+      r = readers.erase(r);
+    }
+    else{
+      ++r;
+    }
+  }
+}
+
+void SessionServer::serve(std::shared_ptr<Connection> connection){
+
+  ServerRequest request;
+  while(read_request(connection->fd, request)){
+
+    std::string session = request.session;
+    pool.submit(request.session, std::move(request.program),
+                [connection, session](output_type && outcome){
+
+      ServerResponse response{session, outcome.isError(), std::string()};
+      if(outcome.isError()){
+        response.text = outcome.message();
+      }
+      else{
+        std::ostringstream printed;
+        printed << outcome.expression();
+        response.text = printed.str();
+      }
+
+      std::lock_guard<std::mutex> lock(connection->writing);
+      write_response(connection->fd, response);
+    });
+  }
+}
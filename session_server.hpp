@@ -0,0 +1,110 @@
+/*! \file session_server.hpp
+Defines the SessionServer, which serves a SessionPool over a Unix-domain
+socket, and the frames of its protocol.
+ */
+#ifndef SESSION_SERVER_HPP
+#define SESSION_SERVER_HPP
+
+// system includes
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <thread>
+
+// module includes
+#include "session_pool.hpp"
+
+/*! \struct ServerRequest
+\brief A program for a session.
+
+On the wire: the session name's length and the program's length, each as a
+4-byte big-endian unsigned integer, then the name and the program.
+ */
+struct ServerRequest {
+  std::string session;
+  std::string program;
+};
+
+/*! \struct ServerResponse
+\brief The outcome of a program: its printed result, or its error message.
+
+On the wire: the session name's length, 1 byte that is 1 for an error and
+0 for a result, and the text's length, then the name and the text. The
+lengths are as in a request.
+ */
+struct ServerResponse {
+  std::string session;
+  bool error;
+  std::string text;
+};
+
+/// Longest name, program or text accepted in a frame
+const std::uint32_t MaxFrameField = 64u << 20;
+
+/// Read a request from a socket, false at end of stream or on a bad frame
+bool read_request(int fd, ServerRequest & request);
+
+/// Write a request to a socket, false if it was closed
+bool write_request(int fd, const ServerRequest & request);
+
+/// Read a response from a socket, false at end of stream or on a bad frame
+bool read_response(int fd, ServerResponse & response);
+
+/// Write a response to a socket, false if it was closed
+bool write_response(int fd, const ServerResponse & response);
+
+/*! \class SessionServer
+\brief Accepts connections on a Unix-domain socket and evaluates the
+requests read from them in a SessionPool.
+
+A connection may send any number of requests without waiting for their
+responses. The responses of one session come back in the order of its
+requests; those of different sessions in the order they finish. Any
+connection may use any session.
+ */
+class SessionServer {
+public:
+
+  /*! Listen on a new socket at path, replacing a stale one
+    \throws std::runtime_error if the socket cannot be made
+   */
+  SessionServer(SessionPool & pool, const std::string & path);
+
+  /// Close the socket and its connections, and remove it from the file system
+  ~SessionServer();
+
+  SessionServer(const SessionServer &) = delete;
+  SessionServer & operator=(const SessionServer &) = delete;
+
+  /// Accept and serve connections until stop()
+  void run();
+
+  /// Make run() return; safe to call from a signal handler
+  void stop() noexcept;
+
+private:
+
+  struct Connection;
+
+  // read requests from a connection until it ends
+  void serve(std::shared_ptr<Connection> connection);
+
+  // join the threads of connections that have ended
+  void reap();
+
+  SessionPool & pool;
+  std::string path;
+  int listener;
+  std::atomic<bool> stopped;
+
+  struct Reader {
+    std::weak_ptr<Connection> connection;
+    std::thread thread;
+    std::shared_ptr<std::atomic<bool> > finished;
+  };
+  std::list<Reader> readers;
+};
+
+#endif
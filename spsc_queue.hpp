@@ -0,0 +1,168 @@
+/*! \file spsc_queue.hpp
+Defines the SpscQueue, a bounded queue between one producing and one
+consuming thread, used to pass commands to and results from the
+interpreter kernel.
+ */
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+
+// system includes
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+/*! \class SpscQueue
+\brief A bounded ring of slots written by one thread and read by another.
+
+try_push and try_pop take no lock and allocate nothing: the slots are made
+once, and values are moved in and out of them. The blocking forms wait on
+a condition variable only when the ring is empty (or full), and the other
+side takes the lock to wake them only when a waiter has said it is
+waiting, so a hand-off to a thread that is not asleep costs two atomic
+operations.
+
+At most one thread may push and at most one may pop at a time; either may
+change between uses provided the change is synchronized, as it is by
+joining the old thread and starting the new.
+ */
+template<typename T>
+class SpscQueue {
+public:
+
+  /// Make a queue holding at least capacity values
+  explicit SpscQueue(std::size_t capacity = 64)
+    : slots(round_up(capacity)), mask(slots.size() - 1),
+      head(0), tail(0), consumer_waiting(false), producer_waiting(false) {}
+
+  SpscQueue(const SpscQueue &) = delete;
+  SpscQueue & operator=(const SpscQueue &) = delete;
+
+  /// Number of values the queue holds when full
+  std::size_t capacity() const noexcept { return slots.size(); }
+
+  /// True if no value is queued
+  bool empty() const noexcept {
+    return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+  }
+
+  /// Queue value unless the queue is full, returning false if it is
+  bool try_push(T && value){
+    std::size_t t = tail.load(std::memory_order_relaxed);
+    if(t - head.load(std::memory_order_acquire) == slots.size())
+      return false;
+
+    slots[t & mask] = std::move(value);
+    tail.store(t + 1, std::memory_order_release);
+    wake(consumer_waiting, consumer_wake);
+    return true;
+  }
+
+  /// Queue value, waiting while the queue is full
+  void push(T value){
+    while(!try_push(std::move(value))){
+      std::unique_lock<std::mutex> lock(mutex);
+      wait(lock, producer_waiting, producer_wake, [this]{ return !full(); });
+    }
+  }
+
+  /// Take the oldest value unless the queue is empty, returning false if it is
+  bool try_pop(T & popped_value){
+    std::size_t h = head.load(std::memory_order_relaxed);
+    if(h == tail.load(std::memory_order_acquire))
+      return false;
+
+    popped_value = std::move(slots[h & mask]);
+    head.store(h + 1, std::memory_order_release);
+    wake(producer_waiting, producer_wake);
+    return true;
+  }
+
+  /// Take the oldest value, waiting while the queue is empty
+  void wait_and_pop(T & popped_value){
+    while(!try_pop(popped_value)){
+      std::unique_lock<std::mutex> lock(mutex);
+      wait(lock, consumer_waiting, consumer_wake, [this]{ return !empty(); });
+    }
+  }
+
+  /*! Take the oldest value, waiting at most timeout for one to be queued
+    \return false if the queue was still empty at the timeout
+   */
+  template<typename Rep, typename Period>
+  bool wait_for_pop(T & popped_value, const std::chrono::duration<Rep, Period> & timeout){
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while(!try_pop(popped_value)){
+      std::unique_lock<std::mutex> lock(mutex);
+      if(!wait_until(lock, consumer_waiting, consumer_wake, [this]{ return !empty(); }, deadline))
+        return try_pop(popped_value);
+    }
+    return true;
+  }
+
+private:
+
+  static std::size_t round_up(std::size_t n){
+    std::size_t size = 1;
+    while(size < n) size <<= 1;
+    return size;
+  }
+
+  bool full() const noexcept {
+    return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire) == slots.size();
+  }
+
+  /* The waiter sets its flag and then rechecks the ring; the other side
+     moves its index and then reads the flag. The fences order each store
+     before the following load, so either the waiter sees the change or
+     the other side sees the flag and notifies under the lock, which the
+     waiter holds until it sleeps. */
+  void wake(std::atomic<bool> & waiting, std::condition_variable & cv){
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(waiting.load(std::memory_order_relaxed)){
+      std::lock_guard<std::mutex> lock(mutex);
+      cv.notify_one();
+    }
+  }
+
+  template<typename Ready>
+  void wait(std::unique_lock<std::mutex> & lock, std::atomic<bool> & waiting,
+            std::condition_variable & cv, Ready ready){
+    waiting.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(!ready())
+      cv.wait(lock);
+    waiting.store(false, std::memory_order_relaxed);
+  }
+
+  template<typename Ready, typename TimePoint>
+  bool wait_until(std::unique_lock<std::mutex> & lock, std::atomic<bool> & waiting,
+                  std::condition_variable & cv, Ready ready, const TimePoint & deadline){
+    waiting.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool in_time = ready() || cv.wait_until(lock, deadline) == std::cv_status::no_timeout;
+    waiting.store(false, std::memory_order_relaxed);
+    return in_time;
+  }
+
+  std::vector<T> slots;
+  const std::size_t mask;
+
+  // the indices only increase, slot i is slots[i & mask]; each is written
+  // by one side, padded so the two sides do not share a cache line
+  std::atomic<std::size_t> head;
+  char head_pad[64 - sizeof(std::atomic<std::size_t>)];
+  std::atomic<std::size_t> tail;
+  char tail_pad[64 - sizeof(std::atomic<std::size_t>)];
+
+  std::atomic<bool> consumer_waiting;
+  std::atomic<bool> producer_waiting;
+  std::mutex mutex;
+  std::condition_variable consumer_wake;
+  std::condition_variable producer_wake;
+};
+
+#endif
@@ -0,0 +1,104 @@
+/*! \file symbol_map.hpp
+Defines the SymbolMap, the table of bindings of a global environment.
+ */
+#ifndef SYMBOL_MAP_HPP
+#define SYMBOL_MAP_HPP
+
+// system includes
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// module includes
+#include "atom.hpp"
+
+/*! \class SymbolMap
+\brief A map from interned SymbolIds to values, sized by its own entries.
+
+Symbol ids are dense over the whole process, and symbols made at run time
+are interned as well, so a table indexed by id grows with everything ever
+interned. A SymbolMap instead hashes ids into an open
+addressed index of (id, position) pairs, probed linearly, and keeps the
+values together in insertion order: a lookup is a multiply, a short probe
+and an array access, and copying the map copies only what it holds.
+
+There is no erase; a binding is replaced by assigning to it.
+ */
+template<typename T>
+class SymbolMap {
+public:
+
+  /// Make an empty map
+  SymbolMap(): slots(MinSlots), shift(64 - MinSlotBits) {}
+
+  /// The value bound to id, nullptr if there is none
+  const T * find(SymbolId id) const noexcept {
+    for(std::size_t i = home(id);; i = (i + 1) & (slots.size() - 1)){
+      const Slot & slot = slots[i];
+      if(slot.id == id) return &values[slot.position];
+      if(slot.id == NoSymbolId) return nullptr;
+    }
+  }
+
+  /// The value bound to id, default constructed first if there is none
+  T & operator[](SymbolId id){
+    std::size_t i = probe(id);
+    if(slots[i].id == id) return values[slots[i].position];
+
+    // keep the index at most half full so probes stay short
+    if(2 * (values.size() + 1) > slots.size()){
+      grow();
+      i = probe(id);
+    }
+    slots[i].id = id;
+    slots[i].position = values.size();
+    values.emplace_back();
+    return values.back();
+  }
+
+  /// Number of ids bound
+  std::size_t size() const noexcept {
+    return values.size();
+  }
+
+private:
+
+  static const unsigned MinSlotBits = 6;
+  static const std::size_t MinSlots = std::size_t(1) << MinSlotBits;
+
+  struct Slot {
+    Slot(): id(NoSymbolId), position(0) {}
+    SymbolId id;
+    std::size_t position;
+  };
+
+  // the first slot to probe for id, by Fibonacci hashing
+  std::size_t home(SymbolId id) const noexcept {
+    return static_cast<std::size_t>((std::uint64_t(id) * 0x9E3779B97F4A7C15ull) >> shift);
+  }
+
+  // the slot holding id, or the empty slot where it would go
+  std::size_t probe(SymbolId id) const noexcept {
+    std::size_t i = home(id);
+    while(slots[i].id != id && slots[i].id != NoSymbolId){
+      i = (i + 1) & (slots.size() - 1);
+    }
+    return i;
+  }
+
+  // double the index and place the entries again; the values do not move
+  void grow(){
+    std::vector<Slot> old(slots.size() * 2);
+    old.swap(slots);
+    --shift;
+    for(const Slot & slot : old){
+      if(slot.id != NoSymbolId) slots[probe(slot.id)] = slot;
+    }
+  }
+
+  std::vector<Slot> slots; // a power of two of them
+  unsigned shift;          // 64 less log2 of the number of slots
+  std::vector<T> values;
+};
+
+#endif
@@ -0,0 +1,189 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <limits>
+
+namespace {
+
+// the pool and queue of the calling thread, when it is a worker
+thread_local const ThreadPool * worker_pool = nullptr;
+thread_local std::size_t worker_index = 0;
+
+// the state shared by the chunks of one parallel_for
+struct Group {
+  explicit Group(std::size_t chunks)
+    : remaining(chunks), first_failed(std::numeric_limits<std::size_t>::max()),
+      errors(chunks) {}
+
+  std::mutex mutex;
+  std::condition_variable done;
+  std::size_t remaining; // guarded by mutex
+  std::atomic<std::size_t> first_failed;
+  std::vector<std::exception_ptr> errors;
+};
+
+}
+
+ThreadPool::ThreadPool(std::size_t workers)
+  : queued(0), next_queue(0), stopping(false) {
+
+  for(std::size_t i = 0; i < workers; ++i){
+    queues.emplace_back(new Queue);
+  }
+  for(std::size_t i = 0; i < workers; ++i){
+    threads.emplace_back(&ThreadPool::work, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool(){
+
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+
+  for(auto & t : threads){
+    t.join();
+  }
+}
+
+ThreadPool & ThreadPool::shared(){
+
+  // the calling thread works too, so leave it a hardware thread
+  static ThreadPool pool(std::thread::hardware_concurrency() > 1 ?
+                         std::thread::hardware_concurrency() - 1 : 0);
+  return pool;
+}
+
+std::size_t ThreadPool::workers() const noexcept{
+  return threads.size();
+}
+
+std::size_t ThreadPool::home() noexcept{
+  return (worker_pool == this) ? worker_index : (next_queue++ % queues.size());
+}
+
+void ThreadPool::push(Job && job){
+
+  Queue & queue = *queues[home()];
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.jobs.push_back(std::move(job));
+  }
+  ++queued;
+
+  // take the sleep lock so a worker between its check and its wait is not
+  // missed by the notification
+  { std::lock_guard<std::mutex> lock(sleep_mutex); }
+  wake.notify_one();
+}
+
+bool ThreadPool::run_one(std::size_t home){
+
+  for(std::size_t k = 0; k < queues.size(); ++k){
+    Queue & queue = *queues[(home + k) % queues.size()];
+
+    Job job;
+    {
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if(queue.jobs.empty())
+        continue;
+
+      // own queue newest first, for locality; steal oldest first
+      if(k == 0){
+        job = std::move(queue.jobs.back());
+        queue.jobs.pop_back();
+      }
+      else{
+        job = std::move(queue.jobs.front());
+        queue.jobs.pop_front();
+      }
+    }
+    --queued;
+
+    job();
+    return true;
+  }
+
+  return false;
+}
+
+void ThreadPool::work(std::size_t index){
+
+  worker_pool = this;
+  worker_index = index;
+
+  while(true){
+    if(run_one(index))
+      continue;
+
+    std::unique_lock<std::mutex> lock(sleep_mutex);
+    wake.wait(lock, [this](){ return stopping || (queued > 0); });
+    if(stopping && (queued == 0))
+      return;
+  }
+}
+
+void ThreadPool::parallel_for(std::size_t n, const std::function<void(std::size_t, std::size_t)> & body){
+
+  if(n == 0)
+    return;
+
+  if(threads.empty() || (n == 1)){
+    body(0, n);
+    return;
+  }
+
+  // a few chunks per thread, so stealing can even out uneven elements
+  std::size_t chunks = std::min(n, 4 * (threads.size() + 1));
+  Group group(chunks);
+
+  for(std::size_t c = 0; c < chunks; ++c){
+    std::size_t first = (n * c) / chunks;
+    std::size_t last = (n * (c + 1)) / chunks;
+
+    push([&group, &body, c, first, last](){
+      if(c < group.first_failed){
+        try{
+          body(first, last);
+        }
+        catch(...){
+          group.errors[c] = std::current_exception();
+
+          std::size_t failed = group.first_failed;
+          while((c < failed) && !group.first_failed.compare_exchange_weak(failed, c)) {}
+        }
+      }
+
+      // the waiting thread returns once remaining is zero, so the group
+      // must not be touched after the lock is released
+      std::lock_guard<std::mutex> lock(group.mutex);
+      if(--group.remaining == 0)
+        group.done.notify_all();
+    });
+  }
+
+  // help with queued jobs (ours or others') until every chunk is done
+  std::size_t start = home();
+  while(true){
+    {
+      std::lock_guard<std::mutex> lock(group.mutex);
+      if(group.remaining == 0)
+        break;
+    }
+
+    if(!run_one(start)){
+      std::unique_lock<std::mutex> lock(group.mutex);
+      group.done.wait_for(lock, std::chrono::microseconds(200),
+                          [&group](){ return group.remaining == 0; });
+    }
+  }
+
+  for(auto & error : group.errors){
+    if(error)
+      std::rethrow_exception(error);
+  }
+}
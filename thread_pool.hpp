@@ -0,0 +1,84 @@
+/*! \file thread_pool.hpp
+Defines the ThreadPool, a work-stealing pool used by the parallel map form.
+ */
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+// system includes
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*! \class ThreadPool
+\brief A fixed set of worker threads, each with its own job queue.
+
+A worker runs the newest job of its own queue and, when that is empty,
+steals the oldest job of another worker's queue. A thread waiting in
+parallel_for runs queued jobs itself until its own are done, so a job may
+call parallel_for again (a nested pmap) without deadlocking the pool.
+ */
+class ThreadPool {
+public:
+
+  /// Start a pool of the given number of workers (0 runs everything inline)
+  explicit ThreadPool(std::size_t workers);
+
+  /// Stop the workers, once their queues are empty
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool & operator=(const ThreadPool &) = delete;
+
+  /// The process-wide pool, one worker per additional hardware thread
+  static ThreadPool & shared();
+
+  /// Number of worker threads
+  std::size_t workers() const noexcept;
+
+  /*! Run body over [0, n), split into contiguous chunks run in parallel.
+    \param n the number of indices
+    \param body called as body(first, last) for each chunk [first, last)
+    \throws the exception thrown by the chunk with the lowest first index;
+    chunks after a failed one may be skipped, chunks before it are not
+   */
+  void parallel_for(std::size_t n, const std::function<void(std::size_t, std::size_t)> & body);
+
+private:
+
+  typedef std::function<void()> Job;
+
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Job> jobs;
+  };
+
+  // worker thread loop
+  void work(std::size_t index);
+
+  // queue a job, on the calling worker's own queue if it is one
+  void push(Job && job);
+
+  // run one queued job, preferring the newest of queues[home]
+  bool run_one(std::size_t home);
+
+  // the queue the calling thread prefers
+  std::size_t home() noexcept;
+
+  std::vector<std::unique_ptr<Queue> > queues;
+  std::vector<std::thread> threads;
+
+  std::atomic<std::size_t> queued;
+  std::atomic<std::size_t> next_queue;
+
+  std::mutex sleep_mutex;
+  std::condition_variable wake;
+  bool stopping;
+};
+
+#endif
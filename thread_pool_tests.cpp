@@ -0,0 +1,79 @@
+#include "catch.hpp"
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+TEST_CASE( "Test thread pool covers every index once", "[thread_pool]" ) {
+
+  ThreadPool pool(3);
+  REQUIRE(pool.workers() == 3);
+
+  for(std::size_t n : {0, 1, 2, 15, 1000}){
+    std::vector<int> hits(n, 0);
+    pool.parallel_for(n, [&hits](std::size_t first, std::size_t last){
+      for(std::size_t i = first; i < last; ++i)
+        ++hits[i];
+    });
+
+    for(std::size_t i = 0; i < n; ++i){
+      REQUIRE(hits[i] == 1);
+    }
+  }
+}
+
+TEST_CASE( "Test thread pool runs inline without workers", "[thread_pool]" ) {
+
+  ThreadPool pool(0);
+
+  std::size_t calls = 0;
+  pool.parallel_for(10, [&calls](std::size_t first, std::size_t last){
+    REQUIRE(first == 0);
+    REQUIRE(last == 10);
+    ++calls;
+  });
+  REQUIRE(calls == 1);
+}
+
+TEST_CASE( "Test thread pool rethrows the earliest error", "[thread_pool]" ) {
+
+  ThreadPool pool(3);
+
+  // every chunk from index 100 on fails; the one holding 100 is reported
+  std::size_t reported = 0;
+  try{
+    pool.parallel_for(1000, [](std::size_t first, std::size_t last){
+      if(last > 100)
+        throw std::out_of_range(std::to_string(first));
+    });
+  }
+  catch(const std::out_of_range & ex){
+    reported = std::stoul(ex.what());
+  }
+  REQUIRE(reported <= 100);
+  REQUIRE(reported > 0);
+
+  // the pool is still usable afterwards
+  std::atomic<std::size_t> total(0);
+  pool.parallel_for(100, [&total](std::size_t first, std::size_t last){
+    total += last - first;
+  });
+  REQUIRE(total == 100);
+}
+
+TEST_CASE( "Test thread pool nested parallel_for", "[thread_pool]" ) {
+
+  ThreadPool pool(2);
+
+  std::atomic<std::size_t> total(0);
+  pool.parallel_for(20, [&](std::size_t first, std::size_t last){
+    for(std::size_t i = first; i < last; ++i){
+      pool.parallel_for(50, [&total](std::size_t a, std::size_t b){
+        total += b - a;
+      });
+    }
+  });
+  REQUIRE(total == 20 * 50);
+}
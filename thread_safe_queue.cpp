@@ -21,6 +21,16 @@ void ThreadSafeQueue<T>::push(const T& value) {
 }
 
 
+template<typename T>
+void ThreadSafeQueue<T>::push(T&& value) {
+  std::unique_lock<std::mutex> lock(the_mutex);
+  thread_queue.push(std::move(value));
+
+  lock.unlock();
+  the_condition_variable.notify_one();
+}
+
+
 // Try and pop value off top of queue, return false if queue is empty
 template<typename T>
 bool ThreadSafeQueue<T>::try_pop(T& popped_value) {
@@ -28,7 +38,7 @@ bool ThreadSafeQueue<T>::try_pop(T& popped_value) {
   if(thread_queue.empty())
     return false;
 
-  popped_value = thread_queue.front();
+  popped_value = std::move(thread_queue.front());
   thread_queue.pop();
   return true;
 }
@@ -41,9 +51,27 @@ void ThreadSafeQueue<T>::wait_and_pop(T& popped_value) {
   while(thread_queue.empty())
     the_condition_variable.wait(lock);
 
-  popped_value = thread_queue.front();
+  popped_value = std::move(thread_queue.front());
+  thread_queue.pop();
+}
+
+template<typename T>
+bool ThreadSafeQueue<T>::wait_for_pop(T& popped_value, std::chrono::milliseconds timeout) {
+  std::unique_lock<std::mutex> lock(the_mutex);
+
+  if(!the_condition_variable.wait_for(lock, timeout, [this]{ return !thread_queue.empty(); }))
+    return false;
+
+  popped_value = std::move(thread_queue.front());
   thread_queue.pop();
+  return true;
 }
 
 template class ThreadSafeQueue<std::string>;
-template class ThreadSafeQueue<output_type>;
+
+// output_type is move-only, so every member but the copying push
+template bool ThreadSafeQueue<output_type>::empty() const;
+template void ThreadSafeQueue<output_type>::push(output_type&& value);
+template bool ThreadSafeQueue<output_type>::try_pop(output_type& popped_value);
+template void ThreadSafeQueue<output_type>::wait_and_pop(output_type& popped_value);
+template bool ThreadSafeQueue<output_type>::wait_for_pop(output_type& popped_value, std::chrono::milliseconds timeout);
@@ -3,24 +3,68 @@
 #ifndef THREAD_SAFE_QUEUE_HPP
 #define THREAD_SAFE_QUEUE_HPP
 
+#include <chrono>
 #include <thread>
 #include <queue>
 #include <mutex>
 #include <atomic>
 #include <condition_variable>
 #include <string>
+#include <utility>
 
 #include "expression.hpp"
 #include "semantic_error.hpp"
 
-// So we can differentiate between error output and correct result output
-struct output_type {
-  bool isError;
-  Expression exp_result;
-  SemanticError err_result;
+/*! \class output_type
+\brief The outcome of evaluating one command, sent from the interpreter
+kernel: either the resulting expression or the message of the error.
+
+The outcome is move-only, so a large result (a plot of many items and
+their properties) crosses threads by moving, never by copying. A
+default-constructed outcome is an empty result and allocates nothing.
+ */
+class output_type {
+public:
+
+  output_type() noexcept : error(false) {}
+
+  output_type(output_type &&) noexcept = default;
+  output_type & operator=(output_type &&) noexcept = default;
+
+  output_type(const output_type &) = delete;
+  output_type & operator=(const output_type &) = delete;
+
+  /// Make the outcome of a successful evaluation
+  static output_type result(Expression && exp) noexcept {
+    output_type out;
+    out.exp_result = std::move(exp);
+    return out;
+  }
+
+  /// Make the outcome of a failed evaluation
+  static output_type failure(std::string message) noexcept {
+    output_type out;
+    out.error = true;
+    out.err_message = std::move(message);
+    return out;
+  }
 
-  output_type() : output_type(true, Expression(), SemanticError(std::string("Error"))) {};
-  output_type(bool isErr, Expression exp, SemanticError error) : isError(isErr), exp_result(exp), err_result(error) {};
+  /// True if the evaluation failed
+  bool isError() const noexcept { return error; }
+
+  /// The resulting expression, when not isError()
+  const Expression & expression() const noexcept { return exp_result; }
+
+  /// Move the resulting expression out, when not isError()
+  Expression takeExpression() noexcept { return std::move(exp_result); }
+
+  /// The error message, when isError()
+  const std::string & message() const noexcept { return err_message; }
+
+private:
+  bool error;
+  Expression exp_result;
+  std::string err_message;
 };
 
 template<typename T>
@@ -29,12 +73,17 @@ public:
 
   void push(T const& value);
 
+  void push(T&& value);
+
   bool empty() const;
 
   bool try_pop(T& popped_value);
 
   void wait_and_pop(T& popped_value);
 
+  // Wait at most timeout for a value, return false if none was pushed in time
+  bool wait_for_pop(T& popped_value, std::chrono::milliseconds timeout);
+
 private:
   std::queue<T> thread_queue;
   mutable std::mutex the_mutex;
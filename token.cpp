@@ -2,7 +2,12 @@
 
 // system includes
 #include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <sstream>
 #include "semantic_error.hpp"
 
 // define constants for special characters
@@ -31,56 +36,174 @@ std::string Token::asString() const{
 }
 
 
-// add token to sequence unless it is empty, clears token
-void store_ifnot_empty(std::string & token, TokenSequenceType & seq){
-  if(!token.empty()){
-    seq.emplace_back(token);
-    token.clear();
+TokenSpanSequenceType lex(const char * data, std::size_t size){
+
+  TokenSpanSequenceType tokens;
+
+  const char * p = data;
+  const char * end = data + size;
+
+  // start of the STRING token being scanned, nullptr between tokens
+  const char * start = nullptr;
+
+  // add the token being scanned, if any, ending at last
+  auto store_ifnot_empty = [&](const char * last){
+    if(start != nullptr){
+      tokens.push_back(TokenSpan{Token::STRING, std::size_t(start - data), std::size_t(last - start)});
+      start = nullptr;
+    }
+  };
+
+  while(p != end){
+    char c = *p;
+
+    if(c == COMMENTCHAR){
+      store_ifnot_empty(p);
+
+      // chomp until the end of the line
+      p = static_cast<const char *>(std::memchr(p, '\n', end - p));
+      if(p == nullptr) break;
+      ++p;
+    }
+    else if((c == OPENCHAR) || (c == CLOSECHAR)){
+      store_ifnot_empty(p);
+      tokens.push_back(TokenSpan{(c == OPENCHAR) ? Token::OPEN : Token::CLOSE,
+                                 std::size_t(p - data), 1});
+      ++p;
+    }
+    else if(std::isspace(static_cast<unsigned char>(c))){
+      store_ifnot_empty(p);
+      ++p;
+    }
+    else if(c == '\"'){
+      // a string runs to the closing quote, whatever it contains
+      if(start == nullptr) start = p;
+      const char * close = static_cast<const char *>(std::memchr(p + 1, '\"', end - (p + 1)));
+      p = (close == nullptr) ? end : close + 1;
+    }
+    else{
+      if(start == nullptr) start = p;
+      ++p;
+    }
   }
+  store_ifnot_empty(end);
+
+  return tokens;
 }
 
 TokenSequenceType tokenize(std::istream & seq){
+
+  std::string buffer;
+  if(seq.rdbuf() != nullptr){
+    std::ostringstream contents;
+    contents << seq.rdbuf();
+    buffer = contents.str();
+  }
+  seq.setstate(std::ios::eofbit);
+
   TokenSequenceType tokens;
-  std::string token;
+  for(auto & span : lex(buffer.data(), buffer.size())){
+    if(span.type == Token::STRING)
+      tokens.emplace_back(buffer.substr(span.offset, span.length));
+    else
+      tokens.emplace_back(span.type);
+  }
 
-  while(true){
-    char c = seq.get();
-    if(seq.eof()) break;
+  return tokens;
+}
 
-    if(c == COMMENTCHAR){
-      // chomp until the end of the line
-      while((!seq.eof()) && (c != '\n')){
-         c = seq.get();
+// powers of ten exactly representable as a double
+static const double exact_powers_of_ten[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+NumberScan scan_number(const char * first, const char * last, double & value){
+
+  const char * p = first;
+
+  bool negative = false;
+  if((p != last) && ((*p == '+') || (*p == '-'))){
+    negative = (*p == '-');
+    ++p;
+  }
+
+  // significant digits, up to 19 of them, and the power of ten they are
+  // scaled by because of a decimal point
+  std::uint64_t mantissa = 0;
+  int digits = 0;
+  int scale = 0;
+  bool truncated = false;
+  bool found_mantissa = false;
+  bool found_point = false;
+
+  for(; p != last; ++p){
+    if(std::isdigit(static_cast<unsigned char>(*p))){
+      found_mantissa = true;
+      if((mantissa == 0) && (*p == '0')){
+        if(found_point) --scale;
+      }
+      else if(digits < 19){
+        mantissa = mantissa*10 + (*p - '0');
+        ++digits;
+        if(found_point) --scale;
       }
-      if(seq.eof()) break;
+      else{
+        truncated = true;
+      }
+    }
+    else if((*p == '.') && !found_point){
+      found_point = true;
     }
-    else if(c == OPENCHAR){
-      store_ifnot_empty(token, tokens);
-      tokens.push_back(Token::TokenType::OPEN);
+    else{
+      break;
     }
-    else if(c == CLOSECHAR){
-      store_ifnot_empty(token, tokens);
-      tokens.push_back(Token::TokenType::CLOSE);
+  }
+
+  if(!found_mantissa){
+    return NotANumber;
+  }
+
+  int exponent = 0;
+  if((p != last) && ((*p == 'e') || (*p == 'E'))){
+    ++p;
+
+    bool negative_exponent = false;
+    if((p != last) && ((*p == '+') || (*p == '-'))){
+      negative_exponent = (*p == '-');
+      ++p;
     }
-    else if(isspace(c)){
-      store_ifnot_empty(token, tokens);
+
+    const char * exponent_digits = p;
+    for(; (p != last) && std::isdigit(static_cast<unsigned char>(*p)); ++p){
+      if(exponent < 100000) exponent = exponent*10 + (*p - '0');
     }
-    else if(c == '\"') {
-      token.push_back(c);
-       c = seq.get();
-      while(c != '\"') {
-        token.push_back(c);
-        c = seq.get();
-      }
-      token.push_back(c);
+
+    // a stream reads the exponent marker, so a missing exponent is an error
+    if(p == exponent_digits){
+      return NotANumber;
     }
-    else{
-      token.push_back(c);
+
+    if(negative_exponent) exponent = -exponent;
+  }
+
+  int power = scale + exponent;
+
+  if(!truncated && (digits <= 15) && (power >= -22) && (power <= 22)){
+    // both the mantissa and the power of ten are exact, so one correctly
+    // rounded operation gives the correctly rounded result
+    double m = static_cast<double>(mantissa);
+    value = (power >= 0) ? m*exact_powers_of_ten[power] : m/exact_powers_of_ten[-power];
+    if(negative) value = -value;
+  }
+  else{
+    std::string text(first, p);
+    value = std::strtod(text.c_str(), nullptr);
+
+    if(std::isinf(value)){
+      return NotANumber;
     }
-    //std::cout << token << '\n';
   }
-  store_ifnot_empty(token, tokens);
 
-  //std::cout << "Size: " << tokens.size() << '\n';
-  return tokens;
+  return (p == last) ? Number : NumberPrefix;
 }
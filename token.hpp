@@ -4,8 +4,10 @@ Defines the Token and TokenSequence types, and associated functions.
 #ifndef TOKEN_HPP
 #define TOKEN_HPP
 
+#include <cstddef>
 #include <deque>
 #include <istream>
+#include <vector>
 
 /*! \class Token
   \brief Value class representing a token.
@@ -59,4 +61,55 @@ Ignores any whitespace and comments (from any ";" to end-of-line).
 */
 TokenSequenceType tokenize(std::istream & seq);
 
+/*! \struct TokenSpan
+\brief A token located in a source buffer, without a copy of its text.
+
+For a STRING token the text is the length characters starting at offset;
+OPEN and CLOSE tokens span their single character.
+ */
+struct TokenSpan {
+  Token::TokenType type;
+  std::size_t offset;
+  std::size_t length;
+};
+
+/// The token spans of a buffer, in order
+typedef std::vector<TokenSpan> TokenSpanSequenceType;
+
+/*! \fn TokenSpanSequenceType lex(const char * data, std::size_t size)
+\brief Split a contiguous buffer into a sequence of token spans
+
+\param data the first character of the buffer
+\param size the number of characters in the buffer
+\return The sequence of token spans into data
+
+Splits the buffer exactly as tokenize splits a stream, except that a comment
+always ends the token before it and an unterminated string runs to the end
+of the buffer. tokenize is implemented with lex.
+*/
+TokenSpanSequenceType lex(const char * data, std::size_t size);
+
+/*! \enum NumberScan
+\brief How much of a token scan_number could read as a number
+ */
+enum NumberScan { NotANumber,  //< the token does not start with a number
+                  Number,      //< the whole token is a number
+                  NumberPrefix //< a number followed by other characters
+};
+
+/*! \fn NumberScan scan_number(const char * first, const char * last, double & value)
+\brief Read the number at the start of the characters [first, last)
+
+\param first the first character of the token
+\param last one past the last character of the token
+\param value set to the number read, when the result is not NotANumber
+\return whether none, all or only a prefix of the token is a number
+
+Accepts the same numbers, with the same values, as extracting a double
+from a std::istream in the classic locale: an optional sign, digits with an
+optional decimal point, and an optional exponent. A number that overflows a
+double is NotANumber. Common short numbers are converted without strtod.
+*/
+NumberScan scan_number(const char * first, const char * last, double & value);
+
 #endif
@@ -73,3 +73,72 @@ TEST_CASE( "Test tokenize", "[token]" ) {
   REQUIRE(tokens.empty());
 }
 
+TEST_CASE( "Test lex spans", "[token]" ) {
+
+  std::string program = "(begin ; note\n  (define a 12.5)\n)";
+
+  TokenSpanSequenceType spans = lex(program.data(), program.size());
+
+  REQUIRE(spans.size() == 8);
+
+  REQUIRE(spans[0].type == Token::OPEN);
+  REQUIRE(spans[0].offset == 0);
+
+  REQUIRE(spans[1].type == Token::STRING);
+  REQUIRE(program.substr(spans[1].offset, spans[1].length) == "begin");
+
+  REQUIRE(spans[2].type == Token::OPEN);
+
+  REQUIRE(program.substr(spans[3].offset, spans[3].length) == "define");
+  REQUIRE(program.substr(spans[4].offset, spans[4].length) == "a");
+  REQUIRE(program.substr(spans[5].offset, spans[5].length) == "12.5");
+
+  REQUIRE(spans[6].type == Token::CLOSE);
+  REQUIRE(spans[7].type == Token::CLOSE);
+  REQUIRE(spans[7].offset == program.size() - 1);
+}
+
+TEST_CASE( "Test lex on an unterminated string", "[token]" ) {
+
+  std::string program = "(\"abc";
+
+  TokenSpanSequenceType spans = lex(program.data(), program.size());
+
+  REQUIRE(spans.size() == 2);
+  REQUIRE(program.substr(spans[1].offset, spans[1].length) == "\"abc");
+}
+
+TEST_CASE( "Test scan_number", "[token]" ) {
+
+  auto scan = [](const std::string & text, double & value){
+    return scan_number(text.data(), text.data() + text.size(), value);
+  };
+
+  double value = 0;
+
+  REQUIRE(scan("12", value) == Number);
+  REQUIRE(value == 12);
+
+  REQUIRE(scan("-0.25", value) == Number);
+  REQUIRE(value == -0.25);
+
+  REQUIRE(scan("+1e3", value) == Number);
+  REQUIRE(value == 1000);
+
+  REQUIRE(scan(".5", value) == Number);
+  REQUIRE(value == 0.5);
+
+  REQUIRE(scan("0.1", value) == Number);
+  REQUIRE(value == 0.1);
+
+  REQUIRE(scan("123456789012345678901234", value) == Number);
+  REQUIRE(value == 123456789012345678901234.0);
+
+  REQUIRE(scan("1abc", value) == NumberPrefix);
+  REQUIRE(scan("1.2.3", value) == NumberPrefix);
+
+  REQUIRE(scan("abc", value) == NotANumber);
+  REQUIRE(scan("-", value) == NotANumber);
+  REQUIRE(scan("1e", value) == NotANumber);
+  REQUIRE(scan("1e400", value) == NotANumber);
+}
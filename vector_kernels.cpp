@@ -0,0 +1,214 @@
+#include "vector_kernels.hpp"
+
+#include <cmath>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define VECTOR_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+/***********************************************************************
+Scalar kernels, the reference for the vector ones. Each processes the
+elements from index first on, so the vector kernels finish with them.
+**********************************************************************/
+
+namespace {
+
+inline double apply(ArithOp op, double a, double b) noexcept {
+  switch(op){
+  case AddOp: return a + b;
+  case SubOp: return a - b;
+  case MulOp: return a * b;
+  case DivOp: return a / b;
+  }
+  return a;
+}
+
+void scalar_op(ArithOp op, double * acc, const double * x, std::size_t first, std::size_t n) noexcept {
+  for(std::size_t i = first; i < n; ++i)
+    acc[i] = apply(op, acc[i], x[i]);
+}
+
+void scalar_op(ArithOp op, double * acc, double x, std::size_t first, std::size_t n) noexcept {
+  for(std::size_t i = first; i < n; ++i)
+    acc[i] = apply(op, acc[i], x);
+}
+
+void scalar_negate(double * acc, std::size_t first, std::size_t n) noexcept {
+  for(std::size_t i = first; i < n; ++i)
+    acc[i] = -acc[i];
+}
+
+void scalar_sqrt(double * acc, std::size_t first, std::size_t n) noexcept {
+  for(std::size_t i = first; i < n; ++i)
+    acc[i] = std::sqrt(acc[i]);
+}
+
+void scalar_op_array(ArithOp op, double * acc, const double * x, std::size_t n) noexcept {
+  scalar_op(op, acc, x, 0, n);
+}
+
+void scalar_op_broadcast(ArithOp op, double * acc, double x, std::size_t n) noexcept {
+  scalar_op(op, acc, x, 0, n);
+}
+
+void scalar_negate_all(double * acc, std::size_t n) noexcept {
+  scalar_negate(acc, 0, n);
+}
+
+void scalar_sqrt_all(double * acc, std::size_t n) noexcept {
+  scalar_sqrt(acc, 0, n);
+}
+
+#ifdef VECTOR_KERNELS_X86
+
+/***********************************************************************
+SSE2 kernels, two doubles at a time. SSE2 is part of x86-64, so these need
+no target attribute there.
+**********************************************************************/
+
+__attribute__((target("sse2")))
+inline __m128d sse2_apply(ArithOp op, __m128d a, __m128d b) noexcept {
+  switch(op){
+  case AddOp: return _mm_add_pd(a, b);
+  case SubOp: return _mm_sub_pd(a, b);
+  case MulOp: return _mm_mul_pd(a, b);
+  case DivOp: return _mm_div_pd(a, b);
+  }
+  return a;
+}
+
+__attribute__((target("sse2")))
+void sse2_op_array(ArithOp op, double * acc, const double * x, std::size_t n) noexcept {
+  std::size_t i = 0;
+  for(; i + 2 <= n; i += 2)
+    _mm_storeu_pd(acc + i, sse2_apply(op, _mm_loadu_pd(acc + i), _mm_loadu_pd(x + i)));
+  scalar_op(op, acc, x, i, n);
+}
+
+__attribute__((target("sse2")))
+void sse2_op_broadcast(ArithOp op, double * acc, double x, std::size_t n) noexcept {
+  const __m128d b = _mm_set1_pd(x);
+  std::size_t i = 0;
+  for(; i + 2 <= n; i += 2)
+    _mm_storeu_pd(acc + i, sse2_apply(op, _mm_loadu_pd(acc + i), b));
+  scalar_op(op, acc, x, i, n);
+}
+
+__attribute__((target("sse2")))
+void sse2_negate(double * acc, std::size_t n) noexcept {
+  const __m128d sign = _mm_set1_pd(-0.0);
+  std::size_t i = 0;
+  for(; i + 2 <= n; i += 2)
+    _mm_storeu_pd(acc + i, _mm_xor_pd(_mm_loadu_pd(acc + i), sign));
+  scalar_negate(acc, i, n);
+}
+
+__attribute__((target("sse2")))
+void sse2_sqrt(double * acc, std::size_t n) noexcept {
+  std::size_t i = 0;
+  for(; i + 2 <= n; i += 2)
+    _mm_storeu_pd(acc + i, _mm_sqrt_pd(_mm_loadu_pd(acc + i)));
+  scalar_sqrt(acc, i, n);
+}
+
+/***********************************************************************
+AVX kernels, four doubles at a time, used only when the processor
+reports AVX support.
+**********************************************************************/
+
+__attribute__((target("avx")))
+inline __m256d avx_apply(ArithOp op, __m256d a, __m256d b) noexcept {
+  switch(op){
+  case AddOp: return _mm256_add_pd(a, b);
+  case SubOp: return _mm256_sub_pd(a, b);
+  case MulOp: return _mm256_mul_pd(a, b);
+  case DivOp: return _mm256_div_pd(a, b);
+  }
+  return a;
+}
+
+__attribute__((target("avx")))
+void avx_op_array(ArithOp op, double * acc, const double * x, std::size_t n) noexcept {
+  std::size_t i = 0;
+  for(; i + 4 <= n; i += 4)
+    _mm256_storeu_pd(acc + i, avx_apply(op, _mm256_loadu_pd(acc + i), _mm256_loadu_pd(x + i)));
+  scalar_op(op, acc, x, i, n);
+}
+
+__attribute__((target("avx")))
+void avx_op_broadcast(ArithOp op, double * acc, double x, std::size_t n) noexcept {
+  const __m256d b = _mm256_set1_pd(x);
+  std::size_t i = 0;
+  for(; i + 4 <= n; i += 4)
+    _mm256_storeu_pd(acc + i, avx_apply(op, _mm256_loadu_pd(acc + i), b));
+  scalar_op(op, acc, x, i, n);
+}
+
+__attribute__((target("avx")))
+void avx_negate(double * acc, std::size_t n) noexcept {
+  const __m256d sign = _mm256_set1_pd(-0.0);
+  std::size_t i = 0;
+  for(; i + 4 <= n; i += 4)
+    _mm256_storeu_pd(acc + i, _mm256_xor_pd(_mm256_loadu_pd(acc + i), sign));
+  scalar_negate(acc, i, n);
+}
+
+__attribute__((target("avx")))
+void avx_sqrt(double * acc, std::size_t n) noexcept {
+  std::size_t i = 0;
+  for(; i + 4 <= n; i += 4)
+    _mm256_storeu_pd(acc + i, _mm256_sqrt_pd(_mm256_loadu_pd(acc + i)));
+  scalar_sqrt(acc, i, n);
+}
+
+#endif
+
+// the kernels selected for this processor
+struct Kernels {
+  const char * isa;
+  void (*op_array)(ArithOp, double *, const double *, std::size_t) noexcept;
+  void (*op_broadcast)(ArithOp, double *, double, std::size_t) noexcept;
+  void (*negate)(double *, std::size_t) noexcept;
+  void (*sqrt)(double *, std::size_t) noexcept;
+};
+
+Kernels select_kernels() noexcept {
+
+#ifdef VECTOR_KERNELS_X86
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx"))
+    return Kernels{"avx", avx_op_array, avx_op_broadcast, avx_negate, avx_sqrt};
+  if(__builtin_cpu_supports("sse2"))
+    return Kernels{"sse2", sse2_op_array, sse2_op_broadcast, sse2_negate, sse2_sqrt};
+#endif
+
+  return Kernels{"scalar", scalar_op_array, scalar_op_broadcast, scalar_negate_all, scalar_sqrt_all};
+}
+
+const Kernels & kernels() noexcept {
+  static const Kernels selected = select_kernels();
+  return selected;
+}
+
+}
+
+void vector_op(ArithOp op, double * acc, const double * x, std::size_t n) noexcept {
+  kernels().op_array(op, acc, x, n);
+}
+
+void vector_op(ArithOp op, double * acc, double x, std::size_t n) noexcept {
+  kernels().op_broadcast(op, acc, x, n);
+}
+
+void vector_negate(double * acc, std::size_t n) noexcept {
+  kernels().negate(acc, n);
+}
+
+void vector_sqrt(double * acc, std::size_t n) noexcept {
+  kernels().sqrt(acc, n);
+}
+
+const char * vector_isa() noexcept {
+  return kernels().isa;
+}
@@ -0,0 +1,35 @@
+/*! \file vector_kernels.hpp
+Defines element-wise arithmetic kernels over arrays of doubles, used by the
+built-in procedures when they are applied to packed numeric lists.
+ */
+#ifndef VECTOR_KERNELS_HPP
+#define VECTOR_KERNELS_HPP
+
+#include <cstddef>
+
+/*! \enum ArithOp
+\brief The element-wise operation a kernel applies.
+ */
+enum ArithOp { AddOp, SubOp, MulOp, DivOp };
+
+/*! Combine an array with another, acc[i] = acc[i] op x[i].
+
+Kernels use AVX or SSE2 when the processor supports them, chosen once at
+first use, and a scalar loop otherwise. Every path performs the same IEEE
+operation on each element, so the results do not depend on the path taken.
+ */
+void vector_op(ArithOp op, double * acc, const double * x, std::size_t n) noexcept;
+
+/// Combine an array with a scalar, acc[i] = acc[i] op x
+void vector_op(ArithOp op, double * acc, double x, std::size_t n) noexcept;
+
+/// Negate an array in place, acc[i] = -acc[i]
+void vector_negate(double * acc, std::size_t n) noexcept;
+
+/// Take square roots in place, acc[i] = sqrt(acc[i])
+void vector_sqrt(double * acc, std::size_t n) noexcept;
+
+/// Name of the instruction set the kernels dispatch to: "avx", "sse2" or "scalar"
+const char * vector_isa() noexcept;
+
+#endif
@@ -0,0 +1,50 @@
+#include "catch.hpp"
+
+#include <cmath>
+#include <vector>
+
+#include "vector_kernels.hpp"
+
+TEST_CASE( "Test vector kernels match scalar arithmetic", "[vector_kernels]" ) {
+
+  INFO(vector_isa());
+
+  // odd lengths exercise the scalar remainder after the vector lanes
+  for(std::size_t n : {0, 1, 3, 4, 7, 17}){
+    std::vector<double> x(n), y(n);
+    for(std::size_t i = 0; i < n; ++i){
+      x[i] = 0.5 * i - 2;
+      y[i] = 3.0 / (i + 1);
+    }
+
+    std::vector<double> acc(x);
+    vector_op(AddOp, acc.data(), y.data(), n);
+    vector_op(MulOp, acc.data(), 3., n);
+    vector_op(SubOp, acc.data(), x.data(), n);
+    vector_op(DivOp, acc.data(), y.data(), n);
+    vector_negate(acc.data(), n);
+
+    for(std::size_t i = 0; i < n; ++i){
+      REQUIRE(acc[i] == -((((x[i] + y[i]) * 3.) - x[i]) / y[i]));
+    }
+
+    std::vector<double> roots(y);
+    vector_sqrt(roots.data(), n);
+    for(std::size_t i = 0; i < n; ++i){
+      REQUIRE(roots[i] == std::sqrt(y[i]));
+    }
+  }
+}
+
+TEST_CASE( "Test vector negate keeps the sign of zero", "[vector_kernels]" ) {
+
+  std::vector<double> acc = {0., -0., 1., -1., 0., -0.};
+  vector_negate(acc.data(), acc.size());
+
+  REQUIRE(std::signbit(acc[0]));
+  REQUIRE(!std::signbit(acc[1]));
+  REQUIRE(acc[2] == -1.);
+  REQUIRE(acc[3] == 1.);
+  REQUIRE(std::signbit(acc[4]));
+  REQUIRE(!std::signbit(acc[5]));
+}
@@ -0,0 +1,338 @@
+#include "vm.hpp"
+
+// system includes
+#include <iterator>
+
+// module includes
+#include "alloc_stats.hpp"
+#include "semantic_error.hpp"
+#include "eval_context.hpp"
+#include "evaluator.hpp"
+#include "optimize.hpp"
+
+// lambda calls recurse on the native stack; past this many re-entries a
+// call is handed to the tree-walker, which keeps its frames on the heap,
+// so a chain of calls may go as deep under --vm as it may tree-walking
+static const std::size_t HandOffDepth = EvalContext::MaxNativeDepth / 2;
+
+const std::size_t VirtualMachine::LambdaCapacity;
+
+Expression VirtualMachine::run(const Chunk & chunk, Environment & env){
+
+  AllocScope allocs(EvalAllocs);
+  context = &EvalContext::current();
+  profiler = context->profiler();
+
+  // a previous run may have been abandoned by an exception
+  stack.clear();
+
+  // do not keep the lambdas of earlier programs alive
+  lambdas.clear();
+
+  return execute(chunk, env, 0);
+}
+
+std::size_t VirtualMachine::cachedLambdas() const noexcept{
+  return lambdas.size();
+}
+
+Expression VirtualMachine::execute(const Chunk & chunk, Environment & env, std::size_t base){
+
+  // a tail call switches to the callee's chunk, kept alive here
+  const Chunk * code = &chunk;
+  std::shared_ptr<const Chunk> callee;
+
+  std::size_t pc = 0;
+
+  while(true){
+
+    const Instruction & ins = code->code[pc++];
+
+    switch(ins.op){
+    case OP_CONSTANT:
+      stack.push_back(code->constants[ins.a]);
+      break;
+
+    case OP_LOCAL:
+      stack.push_back(Expression(stack[base + ins.a]));
+      break;
+
+    case OP_LOOKUP:
+      {
+        const Atom & sym = code->symbols[ins.a];
+        if(env.is_exp(sym)){
+          stack.push_back(env.get_exp(sym));
+        }
+        else if(env.is_proc(sym)){
+          stack.push_back(Expression(sym));
+        }
+        else{
+          throw SemanticError("Error during evaluation: unknown symbol");
+        }
+      }
+      break;
+
+    case OP_POP:
+      stack.pop_back();
+      break;
+
+    case OP_CALL:
+      call(code->symbols[ins.a], ins.b, env);
+      break;
+
+    case OP_TAIL_CALL:
+      if(tail_call(code->symbols[ins.a], ins.b, env, base, callee)){
+        code = callee.get();
+        pc = 0;
+      }
+      break;
+
+    case OP_DEFINE:
+      {
+        static const Atom define("define");
+        if(env.is_exp(define)){
+          throw SemanticError("Error during evaluation: attempt to redefine a previously defined symbol");
+        }
+        env.add_exp(code->symbols[ins.a], stack.back());
+      }
+      break;
+
+    case OP_JUMP:
+      pc = ins.a;
+      break;
+
+    case OP_IF_NOT_PROC:
+      if(!env.is_proc(code->symbols[ins.a])) pc = ins.b;
+      break;
+
+    case OP_IF_NOT_EXP:
+      if(!env.is_exp(code->symbols[ins.a])) pc = ins.b;
+      break;
+
+    case OP_MAP_PROC:
+      {
+        Procedure proc = env.get_proc(code->symbols[ins.a]);
+        AllocScope allocs(ProcedureAllocs);
+
+        Expression::ListBuilder results;
+        results.reserve(ins.b);
+
+        std::vector<Expression> toPass(1);
+        for(std::size_t i = stack.size() - ins.b; i < stack.size(); ++i){
+          toPass[0] = std::move(stack[i]);
+          context->poll();
+          Profiler::Call timed(profiler, code->symbols[ins.a].asSymbol());
+          results.push_back(proc(toPass));
+        }
+        stack.resize(stack.size() - ins.b);
+
+        stack.push_back(results.build());
+      }
+      break;
+
+    case OP_MAP_LAMBDA:
+      {
+        Expression list = std::move(stack.back());
+        stack.pop_back();
+
+        Expression::ListBuilder results;
+        results.reserve(list.tailSize());
+
+        for(std::size_t i = 0; i < list.tailSize(); ++i){
+          stack.push_back(list.tailAt(i));
+          call(code->symbols[ins.a], 1, env);
+          results.push_back(std::move(stack.back()));
+          stack.pop_back();
+        }
+
+        stack.push_back(results.build());
+      }
+      break;
+
+    case OP_APPLY_LAMBDA:
+      {
+        Expression list = std::move(stack.back());
+        stack.pop_back();
+
+        stack.insert(stack.end(), list.getTail().begin(), list.getTail().end());
+        call(code->symbols[ins.a], list.getTail().size(), env);
+      }
+      break;
+
+    case OP_EVAL:
+      stack.push_back(code->constants[ins.a].eval(env));
+      break;
+
+    case OP_FOLDED:
+      if(fold_holds(code->constants[ins.a], env)){
+        stack.push_back(code->constants[ins.a].getTail()[0]);
+        pc = ins.b;
+      }
+      break;
+
+    case OP_ERROR:
+      throw SemanticError(code->messages[ins.a]);
+
+    case OP_RETURN:
+      {
+        Expression result = std::move(stack.back());
+        stack.pop_back();
+        return result;
+      }
+    }
+  }
+}
+
+// mirrors Expression::apply
+void VirtualMachine::call(const Atom & op, std::size_t nargs, Environment & env){
+
+  context->poll();
+
+  if(!(op.isSymbol() || op.isString()) && !op.isLambda()) {
+    throw SemanticError("Error during evaluation: procedure name not symbol or lambda.");
+  }
+
+  // must map to a proc or exp
+  if(!env.is_proc(op) && !env.is_exp(op)){
+    throw SemanticError("Error during evaluation: symbol does not name a procedure or lambda.");
+  }
+
+  std::size_t base = stack.size() - nargs;
+
+  if(env.is_exp(op)) {
+
+    Expression lambda = env.get_exp(op);
+    const std::vector<Expression> & lambda_tail = lambda.getTail();
+
+    if(lambda_tail.size() != 2)
+      throw SemanticError("Error during evaluation: symbol does not name a procedure or lambda.");
+
+    const std::vector<Expression> & lambda_list = lambda_tail[0].getTail();
+
+    if(lambda_list.size() != nargs)
+      throw SemanticError("Error in call to lambda function: invalid number of arguments.");
+
+    // a pure call is remembered under its arguments
+    const bool pure = env.is_pure(op);
+    std::vector<Expression> memo_args;
+    if(pure){
+      memo_args.assign(stack.begin() + base, stack.end());
+
+      Expression result;
+      if(env.recall(op, memo_args, result)){
+        stack.resize(base);
+        stack.push_back(std::move(result));
+        return;
+      }
+    }
+
+    if(context->nativeDepth() >= HandOffDepth){
+      std::vector<Expression> handed(std::make_move_iterator(stack.begin() + base),
+                                     std::make_move_iterator(stack.end()));
+      stack.resize(base);
+      stack.push_back(Evaluator(env).apply(op, handed));
+      return;
+    }
+
+    // lambda calls recurse on the native stack
+    EvalContext::NativeScope depth;
+    Profiler::Call timed(profiler, profiled_name(op));
+
+    // bind the arguments in a new frame chained to the caller's environment,
+    // the body reads them from the stack but callees may look them up
+    Environment frame(&env);
+
+    for(std::size_t j = 0; j < lambda_list.size(); j++) {
+      frame.add_exp(lambda_list[j].head(), stack[base + j], true);
+    }
+
+    std::shared_ptr<const Chunk> chunk = body(lambda);
+    Expression result = execute(*chunk, frame, base);
+
+    if(pure){
+      env.remember(op, memo_args, result);
+    }
+
+    stack.resize(base);
+    stack.push_back(std::move(result));
+  }
+  else {
+    Procedure proc = env.get_proc(op);
+
+    args.assign(std::make_move_iterator(stack.begin() + base),
+                std::make_move_iterator(stack.end()));
+    stack.resize(base);
+
+    AllocScope allocs(ProcedureAllocs);
+    Profiler::Call timed(profiler, profiled_name(op));
+    stack.push_back(proc(args));
+  }
+}
+
+// A lambda called in tail position of a lambda body takes over the body's
+// call frame (env) and local slots, as in the tree-walking Evaluator, so
+// tail recursion runs in constant space. Anything else is an ordinary call.
+bool VirtualMachine::tail_call(const Atom & op, std::size_t nargs, Environment & env,
+                               std::size_t base, std::shared_ptr<const Chunk> & callee){
+
+  if(!op.isSymbol() || !env.is_exp(op)){
+    call(op, nargs, env);
+    return false;
+  }
+
+  context->poll();
+
+  Expression lambda = env.get_exp(op);
+  const std::vector<Expression> & lambda_tail = lambda.getTail();
+
+  if(lambda_tail.size() != 2)
+    throw SemanticError("Error during evaluation: symbol does not name a procedure or lambda.");
+
+  const std::vector<Expression> & lambda_list = lambda_tail[0].getTail();
+
+  if(lambda_list.size() != nargs)
+    throw SemanticError("Error in call to lambda function: invalid number of arguments.");
+
+  // the arguments become the local slots
+  std::size_t top = stack.size() - nargs;
+  for(std::size_t j = 0; j < nargs; ++j){
+    stack[base + j] = std::move(stack[top + j]);
+  }
+  stack.resize(base + nargs);
+
+  for(std::size_t j = 0; j < lambda_list.size(); j++) {
+    env.add_exp(lambda_list[j].head(), stack[base + j], true);
+  }
+
+  // the body's own call is timed as a call of op from here on
+  if(profiler)
+    profiler->replace(op.asSymbol());
+
+  callee = body(lambda);
+  return true;
+}
+
+std::shared_ptr<const Chunk> VirtualMachine::body(const Expression & lambda){
+
+  // copies of a lambda value share its (immutable) tail storage
+  const void * key = &lambda.getTail();
+
+  auto found = lambdas.find(key);
+  if(found != lambdas.end()){
+    return found->second.chunk;
+  }
+
+  // chunks still running are owned by their callers, not only by the cache
+  if(lambdas.size() >= LambdaCapacity){
+    lambdas.clear();
+  }
+
+  CachedLambda entry;
+  entry.lambda = lambda;
+  entry.chunk = std::make_shared<Chunk>(compile_lambda(lambda.getTail()[0], lambda.getTail()[1]));
+
+  std::shared_ptr<const Chunk> chunk = entry.chunk;
+  lambdas.emplace(key, std::move(entry));
+
+  return chunk;
+}
@@ -0,0 +1,91 @@
+/*! \file vm.hpp
+Defines the VirtualMachine, a stack machine executing compiled bytecode
+(see bytecode.hpp).
+ */
+#ifndef VM_HPP
+#define VM_HPP
+
+// system includes
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// module includes
+#include "bytecode.hpp"
+#include "environment.hpp"
+#include "eval_context.hpp"
+#include "expression.hpp"
+#include "profiler.hpp"
+
+/*! \class VirtualMachine
+\brief Executes Chunks against an Environment.
+
+All chunks share one value stack. A lambda call leaves its arguments on the
+stack, where they serve as the callee's local slots, and evaluates the body
+in a call frame chained to the caller's environment, exactly as the
+tree-walker does. A lambda called in tail position reuses the caller's frame
+and slots. Lambda bodies are compiled on first call and cached by the
+identity of the lambda's (shared, immutable) tail storage. The cache holds
+the lambdas it compiled, so it lasts one run and is emptied when it reaches
+LambdaCapacity, as the CallCache is.
+
+Globals are looked up by symbol at each use (one probe of the global
+SymbolMap), not through slots resolved at compile time: a program may
+define a global after the code reading it was compiled.
+ */
+class VirtualMachine {
+public:
+
+  /// Number of compiled lambda bodies kept before the cache is emptied
+  static const std::size_t LambdaCapacity = 1024;
+
+  /*! Run a compiled program.
+    \param chunk the compiled program
+    \param env the environment to evaluate in
+    \return the value of the program
+    \throws SemanticError when a semantic error is encountered
+   */
+  Expression run(const Chunk & chunk, Environment & env);
+
+  /// Number of compiled lambda bodies in the cache
+  std::size_t cachedLambdas() const noexcept;
+
+private:
+
+  // execute a chunk whose local slots start at stack index base
+  Expression execute(const Chunk & chunk, Environment & env, std::size_t base);
+
+  // call op with the top nargs stack values, replacing them with the result
+  void call(const Atom & op, std::size_t nargs, Environment & env);
+
+  // call op in tail position of the lambda body whose frame is env and whose
+  // locals start at base; true with the callee's chunk when the body's frame
+  // was reused, false after an ordinary call
+  bool tail_call(const Atom & op, std::size_t nargs, Environment & env,
+                 std::size_t base, std::shared_ptr<const Chunk> & callee);
+
+  // the compiled body of a lambda expression
+  std::shared_ptr<const Chunk> body(const Expression & lambda);
+
+  struct CachedLambda {
+    Expression lambda; // keeps the keyed tail storage alive
+    std::shared_ptr<const Chunk> chunk;
+  };
+
+  // the value stack
+  std::vector<Expression> stack;
+
+  // reused argument buffer for procedure calls
+  std::vector<Expression> args;
+
+  // compiled lambda bodies, keyed by the address of the lambda's tail
+  std::unordered_map<const void *, CachedLambda> lambdas;
+
+  // the context of the running thread, taken by run
+  EvalContext * context = nullptr;
+
+  // the profiler of the running thread, taken by run; usually null
+  Profiler * profiler = nullptr;
+};
+
+#endif
@@ -0,0 +1,209 @@
+#include "catch.hpp"
+
+#include <string>
+#include <sstream>
+#include <vector>
+
+#include "semantic_error.hpp"
+#include "interpreter.hpp"
+#include "bytecode.hpp"
+#include "parse.hpp"
+#include "token.hpp"
+#include "vm.hpp"
+
+// evaluate each program in turn in one interpreter, recording the printed
+// result or the error message of each
+static std::vector<std::string> outcomes(const std::vector<std::string> & programs,
+                                         Interpreter::EvalMode mode){
+
+  Interpreter interp;
+  interp.setEvalMode(mode);
+
+  std::vector<std::string> results;
+  for(auto & program : programs){
+    std::istringstream iss(program);
+    REQUIRE(interp.parseStream(iss));
+
+    std::ostringstream out;
+    try{
+      out << interp.evaluate();
+    }
+    catch(const SemanticError & ex){
+      out << "error: " << ex.what();
+    }
+    results.push_back(out.str());
+  }
+
+  return results;
+}
+
+static void require_same(const std::vector<std::string> & programs){
+  std::vector<std::string> walked = outcomes(programs, Interpreter::TreeWalk);
+  std::vector<std::string> compiled = outcomes(programs, Interpreter::Bytecode);
+
+  for(std::size_t i = 0; i < programs.size(); ++i){
+    INFO(programs[i]);
+    REQUIRE(walked[i] == compiled[i]);
+  }
+}
+
+TEST_CASE( "Test bytecode compilation", "[vm]" ) {
+
+  std::istringstream iss("(begin (define a 1) (+ a 2))");
+  Expression program = parse(tokenize(iss));
+
+  Chunk chunk = compile(program);
+
+  std::vector<OpCode> expected = {OP_CONSTANT, OP_DEFINE, OP_POP, OP_LOOKUP,
+                                  OP_CONSTANT, OP_CALL, OP_RETURN};
+  REQUIRE(chunk.code.size() == expected.size());
+  for(std::size_t i = 0; i < expected.size(); ++i){
+    REQUIRE(chunk.code[i].op == expected[i]);
+  }
+  REQUIRE(chunk.code[5].b == 2);
+
+  Environment env;
+  VirtualMachine vm;
+  REQUIRE(vm.run(chunk, env) == Expression(3.));
+  REQUIRE(env.get_exp(Atom("a")) == Expression(1.));
+}
+
+TEST_CASE( "Test bytecode matches the tree-walker on expressions", "[vm]" ) {
+
+  require_same({
+      "(+ 1 2 3)", "(- 4)", "(/ 1 2)", "(* I I)", "(sqrt -1)", "(^ e 2)",
+      "(list 1 2 (list 3))", "(list)", "(first (list 1 2))", "(rest (list 1 2))",
+      "(range 0 5 1)", "(length (append (list 1) 2))", "(\"a string\")",
+      "(begin (define a 1) (define b (+ a 1)) (* a b))",
+      "(a)", "(+ 1 nope)", "(1 2)", "(define a 2)", "(define define 1)",
+      "(define (f) 1)", "(begin)", "(join (list 1) (list 2 3))"
+  });
+}
+
+TEST_CASE( "Test bytecode matches the tree-walker on lambdas", "[vm]" ) {
+
+  require_same({
+      "(define inc (lambda (x) (+ x 1)))",
+      "(inc 41)",
+      "(inc 1 2)",
+      "(define sq (lambda (x) (* x x)))",
+      "(map sq (list 1 2 3))",
+      "(map inc (range 0 3 1))",
+      "(map + (range -2 2 0.5))",
+      "(map sqrt (list 1 4 9))",
+      "(pmap sq (range 0 99 1))",
+      "(pmap + (list 1 (list 2)))",
+      "(pmap nothing (list 1))",
+      "(+ (sq 3) (sq 3) (inc (sq 3)))",
+      "(map sq (list 2 2 2 I I))",
+      "(sq (list 1 2))",
+      "(apply + (list 1 2 3))",
+      "(apply inc (list 1))",
+      "(apply nothing (list 1))",
+      "(map nothing (list 1))",
+      "(apply + 3)",
+      "(define y 10)",
+      "(define dyn (lambda (x) (+ x y)))",
+      "(define outer (lambda (y) (dyn 1)))",
+      "(outer 100)",
+      "(define twice (lambda (f x) (f (f x))))",
+      "(twice inc 1)",
+      "(lambda (x y) (+ x y))",
+      "(define dup (lambda (x x) x))",
+      "(dup 1 2)",
+      "(set-property \"n\" 1 (list 1))",
+      "(get-property \"n\" (set-property \"n\" 1 (list 1)))"
+  });
+}
+
+TEST_CASE( "Test bytecode lambda cache", "[vm]" ) {
+
+  std::vector<std::string> programs = {
+    "(define f (lambda (x) (* x 2)))",
+    "(map f (range 0 10 1))",
+    "(f 3)"
+  };
+
+  Interpreter interp;
+  interp.setEvalMode(Interpreter::Bytecode);
+  REQUIRE(interp.evalMode() == Interpreter::Bytecode);
+
+  Expression result;
+  for(auto & program : programs){
+    std::istringstream iss(program);
+    REQUIRE(interp.parseStream(iss));
+    REQUIRE_NOTHROW(result = interp.evaluate());
+  }
+  REQUIRE(result == Expression(6.));
+
+  // an error abandons the stack, the next run must start clean
+  std::istringstream bad("(f 1 2)");
+  REQUIRE(interp.parseStream(bad));
+  REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+
+  std::istringstream good("(f 4)");
+  REQUIRE(interp.parseStream(good));
+  REQUIRE(interp.evaluate() == Expression(8.));
+}
+
+TEST_CASE( "Test bytecode accepts the tree-walker's depth", "[vm]" ) {
+
+  // nested deeper than the compiler recurses, and than the tree-walker's
+  // depth limit
+  auto nested = [](const std::string & head, std::size_t depth){
+    std::string program;
+    for(std::size_t i = 0; i < depth; ++i) program += "(" + head + " ";
+    return program + "0" + std::string(depth, ')');
+  };
+
+  // a chain of lambda calls, none in tail position, deeper than the
+  // bytecode machine recurses
+  std::string chain = "(begin (define f0 (lambda (x) (+ x 1)))";
+  for(std::size_t i = 1; i < 3000; ++i){
+    chain += " (define f" + std::to_string(i) + " (lambda (x) (+ 1 (f" + std::to_string(i - 1) + " x))))";
+  }
+  chain += " (f2999 0))";
+
+  std::vector<std::string> programs = {
+    nested("+ 1", 50000), nested("list", 40000), nested("- 1", 150000),
+    chain, "(begin (define g (lambda (x) (+ 1 (g x)))) (g 1))"
+  };
+
+  std::vector<std::string> compiled = outcomes(programs, Interpreter::Bytecode);
+  REQUIRE(compiled[0] == "(50000)");
+  REQUIRE(compiled[2] == "error: Error during evaluation: maximum evaluation depth exceeded");
+  REQUIRE(compiled[3] == "(3000)");
+  REQUIRE(compiled[4] == compiled[2]);
+
+  require_same(programs);
+}
+
+TEST_CASE( "Test bytecode lambda cache is bounded", "[vm]" ) {
+
+  Environment env;
+  VirtualMachine vm;
+
+  auto run = [&](const std::string & program){
+    std::istringstream iss(program);
+    return vm.run(compile(parse(tokenize(iss))), env);
+  };
+
+  REQUIRE(run("(begin (define f (lambda (x) (* x 2))) (f 3))") == Expression(6.));
+  REQUIRE(vm.cachedLambdas() == 1);
+
+  // a new run forgets the lambdas of the last
+  REQUIRE(run("(f 4)") == Expression(8.));
+  REQUIRE(vm.cachedLambdas() == 1);
+  REQUIRE(run("(+ 1 2)") == Expression(3.));
+  REQUIRE(vm.cachedLambdas() == 0);
+
+  // nor does one program with many lambdas keep them all
+  std::string calls = "(begin";
+  for(std::size_t i = 0; i < VirtualMachine::LambdaCapacity + 10; ++i){
+    std::string name = "g" + std::to_string(i);
+    calls += " (define " + name + " (lambda (x) (+ x 1))) (" + name + " " + std::to_string(i) + ")";
+  }
+  calls += ")";
+  REQUIRE(run(calls) == Expression(double(VirtualMachine::LambdaCapacity + 10)));
+  REQUIRE(vm.cachedLambdas() <= VirtualMachine::LambdaCapacity);
+}